@@ -0,0 +1,98 @@
+#include "BitrateController.h"
+#include <time.h>
+
+namespace {
+  // Weights of a new sample in the fast and the slow moving averages.
+  const double FAST_WEIGHT = 0.5;
+  const double SLOW_WEIGHT = 0.1;
+
+  // The share of the throughput a variant may use, and the smaller share
+  // it may use while the buffer is low.
+  const double SAFETY_FACTOR = 0.8;
+  const double LOW_BUFFER_SAFETY_FACTOR = 0.5;
+
+  // Below this buffer level the low safety factor applies; at or above the
+  // upswitch level a higher variant may be picked.
+  const long long LOW_BUFFER_MS = 4000;
+  const long long UPSWITCH_BUFFER_MS = 10000;
+}
+
+BitrateController::BitrateController(const MasterPlaylist& playlist)
+    : current(0), fastThroughput(0), slowThroughput(0), measured(false),
+      bufferMs(0), bufferTime(now()) {
+  for (unsigned int i = 0; i < playlist.getNumVariants(); i++) {
+    bandwidths.push_back(playlist.getVariant(i).getBandwidth());
+  }
+}
+
+void BitrateController::addSegment(unsigned int durationMs,
+                                   unsigned int bytes, long long downloadMs) {
+  drainBuffer();
+  bufferMs += durationMs;
+
+  if (bytes == 0) {
+    return;
+  }
+
+  // A download too quick for the clock still took some time.
+  if (downloadMs < 1) {
+    downloadMs = 1;
+  }
+  double sample = bytes * 8000.0 / downloadMs;
+  if (!measured) {
+    fastThroughput = slowThroughput = sample;
+    measured = true;
+  } else {
+    fastThroughput += FAST_WEIGHT * (sample - fastThroughput);
+    slowThroughput += SLOW_WEIGHT * (sample - slowThroughput);
+  }
+}
+
+unsigned int BitrateController::chooseVariant() {
+  if (!measured) {
+    return current;
+  }
+
+  long long buffer = getBufferLevel();
+  double budget = getThroughput() *
+      ((buffer < LOW_BUFFER_MS) ? LOW_BUFFER_SAFETY_FACTOR : SAFETY_FACTOR);
+
+  // The highest variant that fits; the lowest one if none does.
+  unsigned int fits = 0;
+  for (unsigned int i = 1; i < bandwidths.size(); i++) {
+    if (bandwidths[i] <= budget) {
+      fits = i;
+    }
+  }
+
+  if ((fits < current) ||
+      ((fits > current) && (buffer >= UPSWITCH_BUFFER_MS))) {
+    current = fits;
+  }
+  return current;
+}
+
+double BitrateController::getThroughput() const {
+  return (fastThroughput < slowThroughput) ? fastThroughput : slowThroughput;
+}
+
+long long BitrateController::getBufferLevel() {
+  drainBuffer();
+  return bufferMs;
+}
+
+void BitrateController::drainBuffer() {
+  // An empty buffer stalls playback, so the time spent empty is not owed.
+  long long time = now();
+  bufferMs -= time - bufferTime;
+  if (bufferMs < 0) {
+    bufferMs = 0;
+  }
+  bufferTime = time;
+}
+
+long long BitrateController::now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,101 @@
+/*********************************
+ * BitrateController - Picks which variant of a master playlist to download
+ * each segment from (adaptive bitrate selection).
+ *
+ * Two things drive the choice. The first is the download throughput,
+ * measured on every segment and smoothed by a fast and a slow moving
+ * average; the lower of the two is used, so a sudden drop is acted on at
+ * once while a sudden rise has to last. The second is the buffer level: how
+ * many milliseconds of video have been downloaded but not yet played, which
+ * is modelled from the durations of the segments handed to the player and
+ * the time that has passed since.
+ *
+ * The controller picks the highest variant whose bandwidth fits in a safe
+ * share of the throughput. It only steps up when the buffer is full enough
+ * to ride out a bad guess, and when the buffer runs low it counts on even
+ * less of the throughput, stepping down sooner.
+ *********************************/
+
+#ifndef _BITRATE_CONTROLLER_H_
+#define _BITRATE_CONTROLLER_H_
+
+#include "MasterPlaylist.h"
+#include <vector>
+
+class BitrateController {
+ public:
+  /*********************************
+   * Name:    BitrateController
+   * Purpose: Constructor of BitrateController objects. Until the first
+   *          segment is measured, the lowest variant is picked.
+   * Receive: playlist - the master playlist whose variants are chosen
+   *                     from; only their bandwidths are kept
+   * Return:  None
+   *********************************/
+  explicit BitrateController(const MasterPlaylist& playlist);
+
+  /*********************************
+   * Name:    addSegment
+   * Purpose: Records a segment handed to the player: its duration adds to
+   *          the buffer, and its download to the throughput estimate.
+   * Receive: durationMs - how long the segment plays for
+   *          bytes - the size of the segment; 0 if it was not downloaded
+   *                  (e.g. it came from a cache), so it is not measured
+   *          downloadMs - how long the download took
+   * Return:  None
+   *********************************/
+  void addSegment(unsigned int durationMs, unsigned int bytes,
+                  long long downloadMs);
+
+  /*********************************
+   * Name:    chooseVariant
+   * Purpose: Picks the variant to download the next segment from.
+   * Receive: None
+   * Return:  The variant, an index into the master playlist.
+   *********************************/
+  unsigned int chooseVariant();
+
+  /*********************************
+   * Name:    getThroughput
+   * Purpose: Looks up the throughput estimate.
+   * Receive: None
+   * Return:  Bits per second, 0 before the first measurement.
+   *********************************/
+  double getThroughput() const;
+
+  /*********************************
+   * Name:    getBufferLevel
+   * Purpose: Estimates how much video is waiting to be played.
+   * Receive: None
+   * Return:  The buffer level in milliseconds.
+   *********************************/
+  long long getBufferLevel();
+
+ private:
+  std::vector<unsigned int> bandwidths;  // increasing
+  unsigned int current;                  // the variant last picked
+  double fastThroughput;                 // bits per second
+  double slowThroughput;
+  bool measured;
+  long long bufferMs;
+  long long bufferTime;  // when bufferMs was last brought up to date
+
+  /*********************************
+   * Name:    drainBuffer
+   * Purpose: Takes the video played since the last update out of the
+   *          buffer estimate.
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void drainBuffer();
+
+  /*********************************
+   * Name:    now
+   * Purpose: Reads the monotonic clock
+   * Receive: None
+   * Return:  the current time in milliseconds
+   *********************************/
+  static long long now();
+};
+
+#endif // _BITRATE_CONTROLLER_H_
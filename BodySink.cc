@@ -0,0 +1,77 @@
+#include "BodySink.h"
+#include <errno.h>
+#include <unistd.h>
+
+BodySink::~BodySink() {
+  // Nothing to do here
+}
+
+int BodySink::receive(TCPSocket& sock, unsigned int length) {
+  const char* data;
+  int available = sock.peekData(data);
+  if (available <= 0) {
+    return 0;  // connection closed
+  }
+
+  unsigned int take = static_cast<unsigned int>(available);
+  if (take > length) {
+    take = length;
+  }
+  write(data, take);
+  sock.consumeData(take);
+  return take;
+}
+
+void StringSink::write(const char* data, unsigned int length) {
+  body.append(data, length);
+}
+
+int StringSink::receive(TCPSocket& sock, unsigned int length) {
+  return sock.readData(body, length);
+}
+
+void FdSink::write(const char* data, unsigned int length) {
+  while (length > 0) {
+    ssize_t written = ::write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::string("FdSink Exception: error writing the body");
+    }
+    data += written;
+    length -= written;
+  }
+}
+
+int FdSink::receive(TCPSocket& sock, unsigned int length) {
+  return sock.spliceData(fd, length);
+}
+
+void CountingSink::write(const char* data, unsigned int length) {
+  sink.write(data, length);
+  this->length += length;
+}
+
+void SliceSink::write(const char* data, unsigned int length) {
+  unsigned int skipped = (length < skip) ? length : skip;
+  skip -= skipped;
+  data += skipped;
+  length -= skipped;
+
+  if (length > take) {
+    length = take;
+  }
+  if (length > 0) {
+    sink.write(data, length);
+    take -= length;
+  }
+}
+
+int CountingSink::receive(TCPSocket& sock, unsigned int length) {
+  int taken = sink.receive(sock, length);
+  if (taken > 0) {
+    this->length += taken;
+  }
+  return taken;
+}
@@ -0,0 +1,196 @@
+/*********************************
+ * BodySink - Where the body of a response goes as it is received. A decoder
+ * (e.g. ChunkedDecoder) hands the sink each run of body bytes once, straight
+ * from the socket's receive buffer, so nothing is reshaped or copied in
+ * between.
+ *
+ * StringSink collects the body in a string, for playlists and other small
+ * objects that have to be parsed. FdSink writes it to a descriptor, moving
+ * it with splice(2) when the descriptor is a pipe. CountingSink sits in
+ * front of another sink and counts what reaches it, e.g. to know where to
+ * resume a download that broke off. SliceSink passes on only a given run
+ * of the body, for a server that answers a Range request with all of it.
+ *
+ * Errors are reported by throwing a std::string, like TCPSocket does.
+ *********************************/
+
+#ifndef _BODY_SINK_H_
+#define _BODY_SINK_H_
+
+#include "TCPSocket.h"
+#include <string>
+
+class BodySink {
+ public:
+  /*********************************
+   * Name:    ~BodySink
+   * Purpose: Destructor of BodySink class objects
+   * Receive: None
+   * Return:  None
+   *********************************/
+  virtual ~BodySink();
+
+  /*********************************
+   * Name:    write
+   * Purpose: Takes body bytes that are already in memory
+   * Receive: data - the first byte
+   *          length - the number of bytes
+   * Return:  None
+   *********************************/
+  virtual void write(const char* data, unsigned int length) = 0;
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Takes body bytes that are still in the socket. By default
+   *          they are passed to write() from the socket's receive buffer;
+   *          a sink that can move them some cheaper way overrides this.
+   * Receive: sock - the socket to read from
+   *          length - the most bytes to take
+   * Return:  the number of bytes taken, 0 if the connection closed
+   *********************************/
+  virtual int receive(TCPSocket& sock, unsigned int length);
+};
+
+class StringSink : public BodySink {
+ public:
+  /*********************************
+   * Name:    StringSink
+   * Purpose: Constructor, appends the body to a string
+   * Receive: body - the string; it is not cleared first
+   * Return:  None
+   *********************************/
+  explicit StringSink(std::string& body) : body(body) {
+  }
+
+  /*********************************
+   * Name:    write
+   * Purpose: Appends the bytes to the string
+   * Receive: data - the first byte
+   *          length - the number of bytes
+   * Return:  None
+   *********************************/
+  void write(const char* data, unsigned int length);
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Reads the bytes straight into the end of the string
+   * Receive: sock - the socket to read from
+   *          length - the most bytes to take
+   * Return:  the number of bytes taken, 0 if the connection closed
+   *********************************/
+  int receive(TCPSocket& sock, unsigned int length);
+
+ private:
+  std::string& body;
+};
+
+class FdSink : public BodySink {
+ public:
+  /*********************************
+   * Name:    FdSink
+   * Purpose: Constructor, writes the body to a descriptor
+   * Receive: fd - the descriptor, e.g. the video player's pipe. It is not
+   *               closed by the sink.
+   * Return:  None
+   *********************************/
+  explicit FdSink(int fd) : fd(fd) {
+  }
+
+  /*********************************
+   * Name:    write
+   * Purpose: Writes all of the bytes to the descriptor
+   * Receive: data - the first byte
+   *          length - the number of bytes
+   * Return:  None, throws a std::string if the descriptor fails
+   *********************************/
+  void write(const char* data, unsigned int length);
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Moves the bytes with TCPSocket::spliceData, so that they do
+   *          not pass through user space when fd is a pipe
+   * Receive: sock - the socket to read from
+   *          length - the most bytes to take
+   * Return:  the number of bytes taken, 0 if the connection closed
+   *********************************/
+  int receive(TCPSocket& sock, unsigned int length);
+
+ private:
+  int fd;
+};
+
+class CountingSink : public BodySink {
+ public:
+  /*********************************
+   * Name:    CountingSink
+   * Purpose: Constructor, passes the body on to another sink
+   * Receive: sink - the sink to pass the body to
+   * Return:  None
+   *********************************/
+  explicit CountingSink(BodySink& sink) : sink(sink), length(0) {
+  }
+
+  /*********************************
+   * Name:    write
+   * Purpose: Passes the bytes on and counts them
+   * Receive: data - the first byte
+   *          length - the number of bytes
+   * Return:  None
+   *********************************/
+  void write(const char* data, unsigned int length);
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Lets the other sink take the bytes from the socket its own
+   *          way, and counts them
+   * Receive: sock - the socket to read from
+   *          length - the most bytes to take
+   * Return:  the number of bytes taken, 0 if the connection closed
+   *********************************/
+  int receive(TCPSocket& sock, unsigned int length);
+
+  /*********************************
+   * Name:    getLength
+   * Purpose: Counts the bytes passed on so far
+   * Receive: None
+   * Return:  the number of bytes
+   *********************************/
+  unsigned int getLength() const {
+    return length;
+  }
+
+ private:
+  BodySink& sink;
+  unsigned int length;
+};
+
+class SliceSink : public BodySink {
+ public:
+  /*********************************
+   * Name:    SliceSink
+   * Purpose: Constructor, passes part of the body on to another sink
+   * Receive: sink - the sink to pass the part to
+   *          skip - how many bytes to drop before the part
+   *          take - the size of the part; the bytes after it are dropped
+   * Return:  None
+   *********************************/
+  SliceSink(BodySink& sink, unsigned int skip, unsigned int take)
+      : sink(sink), skip(skip), take(take) {
+  }
+
+  /*********************************
+   * Name:    write
+   * Purpose: Passes on the bytes that fall within the part
+   * Receive: data - the first byte
+   *          length - the number of bytes
+   * Return:  None
+   *********************************/
+  void write(const char* data, unsigned int length);
+
+ private:
+  BodySink& sink;
+  unsigned int skip;  // still to drop before the part
+  unsigned int take;  // still to pass on
+};
+
+#endif  // _BODY_SINK_H_
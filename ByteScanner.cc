@@ -0,0 +1,159 @@
+#include "ByteScanner.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BYTE_SCANNER_X86
+#endif
+
+namespace {
+  const char CRLF[] = {'\r', '\n'};
+  const char CRLF_CRLF[] = {'\r', '\n', '\r', '\n'};
+
+  // Every kernel finds the first position where the LEN bytes of pattern
+  // occur in [data, end), or returns NULL.
+  typedef const char* (*Kernel)(const char* data, const char* end,
+                                const char* pattern);
+
+  template <unsigned LEN>
+  const char* scanScalar(const char* data, const char* end,
+      const char* pattern) {
+    if (end - data < static_cast<ptrdiff_t>(LEN)) {
+      return NULL;
+    }
+
+    // Let memchr skip to each candidate first byte, then check the rest.
+    const char* last = end - LEN;
+    while (data <= last) {
+      data = static_cast<const char*>(memchr(data, pattern[0],
+                                             last - data + 1));
+      if (data == NULL) {
+        return NULL;
+      }
+      if (memcmp(data, pattern, LEN) == 0) {
+        return data;
+      }
+      data++;
+    }
+    return NULL;
+  }
+
+  // glibc's memchr is vectorized already, and on the short lines of headers
+  // and playlists it beats the kernels below at finding a single byte (see
+  // ByteScannerBench), so single bytes are always left to it.
+  const char* findByteMemchr(const char* data, const char* end,
+      const char* pattern) {
+    return static_cast<const char*>(memchr(data, pattern[0], end - data));
+  }
+
+#ifdef BYTE_SCANNER_X86
+  // Compare a block against each pattern byte at its own offset and AND the
+  // results: bit i of the mask survives only if the whole pattern starts at
+  // position i. Whatever is left after the last full block goes to the
+  // scalar version.
+  template <unsigned LEN>
+  const char* scanSSE2(const char* data, const char* end,
+      const char* pattern) {
+    const ptrdiff_t blockSpan = 16 + LEN - 1;
+
+    while (end - data >= blockSpan) {
+      __m128i match = _mm_cmpeq_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)),
+          _mm_set1_epi8(pattern[0]));
+      for (unsigned k = 1; k < LEN; k++) {
+        match = _mm_and_si128(match, _mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + k)),
+            _mm_set1_epi8(pattern[k])));
+      }
+
+      unsigned bits = _mm_movemask_epi8(match);
+      if (bits != 0) {
+        return data + __builtin_ctz(bits);
+      }
+      data += 16;
+    }
+    return scanScalar<LEN>(data, end, pattern);
+  }
+
+  template <unsigned LEN>
+  __attribute__((target("avx2")))
+  const char* scanAVX2(const char* data, const char* end,
+      const char* pattern) {
+    const ptrdiff_t blockSpan = 32 + LEN - 1;
+
+    while (end - data >= blockSpan) {
+      __m256i match = _mm256_cmpeq_epi8(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)),
+          _mm256_set1_epi8(pattern[0]));
+      for (unsigned k = 1; k < LEN; k++) {
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + k)),
+            _mm256_set1_epi8(pattern[k])));
+      }
+
+      unsigned bits = _mm256_movemask_epi8(match);
+      if (bits != 0) {
+        return data + __builtin_ctz(bits);
+      }
+      data += 32;
+    }
+    return scanSSE2<LEN>(data, end, pattern);
+  }
+#endif
+
+  // The kernels picked for this CPU.
+  struct Kernels {
+    Kernel findByte;
+    Kernel findPair;
+    Kernel findQuad;
+    const char* name;
+  };
+
+  Kernels selectKernels() {
+    Kernels kernels;
+#ifdef BYTE_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      kernels.findByte = findByteMemchr;
+      kernels.findPair = scanAVX2<2>;
+      kernels.findQuad = scanAVX2<4>;
+      kernels.name = "avx2";
+    } else {  // SSE2 is part of every x86-64 CPU
+      kernels.findByte = findByteMemchr;
+      kernels.findPair = scanSSE2<2>;
+      kernels.findQuad = scanSSE2<4>;
+      kernels.name = "sse2";
+    }
+#else
+    kernels.findByte = findByteMemchr;
+    kernels.findPair = scanScalar<2>;
+    kernels.findQuad = scanScalar<4>;
+    kernels.name = "scalar";
+#endif
+    return kernels;
+  }
+
+  // Picked on first use, which also makes it safe to call from other
+  // static initializers.
+  const Kernels& getKernels() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+  }
+}
+
+const char* ByteScanner::find(const char* data, const char* end, char c) {
+  return getKernels().findByte(data, end, &c);
+}
+
+const char* ByteScanner::findLineEnd(const char* data, const char* end) {
+  return getKernels().findPair(data, end, CRLF);
+}
+
+const char* ByteScanner::findHeaderEnd(const char* data, const char* end) {
+  return getKernels().findQuad(data, end, CRLF_CRLF);
+}
+
+const char* ByteScanner::getImplementation() {
+  return getKernels().name;
+}
@@ -0,0 +1,60 @@
+/*********************************
+ * ByteScanner - Finds delimiters in raw protocol data: single bytes such as
+ * '\n' or ':', the "\r\n" that ends an HTTP line and the "\r\n\r\n" that ends
+ * an HTTP header. The HTTP and playlist parsers all use it instead of
+ * walking their input one character at a time.
+ *
+ * On x86-64 the search for "\r\n" and "\r\n\r\n" runs 16 bytes at a time
+ * with SSE2, or 32 at a time with AVX2 when the CPU supports it; the choice
+ * is made once, at startup. Other machines get a plain scalar
+ * implementation with the same results. A single byte is found with
+ * memchr, which measures faster than the SIMD kernels on short lines.
+ * ByteScannerBench ("make bench") compares them.
+ *********************************/
+
+#ifndef _BYTE_SCANNER_H_
+#define _BYTE_SCANNER_H_
+
+class ByteScanner {
+ public:
+  /*********************************
+   * Name:    find
+   * Purpose: Finds the first occurrence of a byte
+   * Receive: data - where to start looking
+   *          end - one past the last byte to look at
+   *          c - the byte to look for
+   * Return:  a pointer to the byte, or NULL if it does not occur
+   *********************************/
+  static const char* find(const char* data, const char* end, char c);
+
+  /*********************************
+   * Name:    findLineEnd
+   * Purpose: Finds the first "\r\n"
+   * Receive: data - where to start looking
+   *          end - one past the last byte to look at
+   * Return:  a pointer to the '\r', or NULL if there is no complete
+   *          "\r\n" before end
+   *********************************/
+  static const char* findLineEnd(const char* data, const char* end);
+
+  /*********************************
+   * Name:    findHeaderEnd
+   * Purpose: Finds the first "\r\n\r\n", i.e. the blank line that ends an
+   *          HTTP message header
+   * Receive: data - where to start looking
+   *          end - one past the last byte to look at
+   * Return:  a pointer to the first '\r', or NULL if there is no complete
+   *          "\r\n\r\n" before end
+   *********************************/
+  static const char* findHeaderEnd(const char* data, const char* end);
+
+  /*********************************
+   * Name:    getImplementation
+   * Purpose: Tells which implementation was picked for this CPU
+   * Receive: None
+   * Return:  "avx2", "sse2" or "scalar"
+   *********************************/
+  static const char* getImplementation();
+};
+
+#endif  // _BYTE_SCANNER_H_
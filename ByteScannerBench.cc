@@ -0,0 +1,217 @@
+// Microbenchmark for ByteScanner: times the delimiter searches the parsers
+// make, on a typical HTTP response header and a VOD playlist, with three
+// implementations of each:
+//
+//   loop     - the byte-at-a-time state machines the parsers used before
+//              ByteScanner (TCPSocket::receiveHeaders,
+//              HTTPMessage::findNextLine, Playlist::readUpTo)
+//   memchr   - glibc memchr for the first byte, memcmp for the rest
+//   scanner  - ByteScanner, with whichever kernel it picked for this CPU
+//
+// Every search is repeated until it has covered BYTES_PER_RUN bytes of
+// input, and the throughput is printed in MB/s. Build with "make bench".
+
+#include "ByteScanner.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <time.h>
+
+namespace {
+  // How much input each measurement scans.
+  const unsigned long long BYTES_PER_RUN = 1ULL << 30;
+
+  // A response header as a CDN sends it for a media segment.
+  const char RESPONSE_HEADER[] =
+      "HTTP/1.1 200 OK\r\n"
+      "Date: Fri, 16 Oct 2026 07:22:58 GMT\r\n"
+      "Server: nginx/1.24.0\r\n"
+      "Content-Type: video/mp2t\r\n"
+      "Content-Length: 1504212\r\n"
+      "Connection: keep-alive\r\n"
+      "Last-Modified: Thu, 15 Oct 2026 21:04:11 GMT\r\n"
+      "ETag: \"6a1f4e2b-16f3d4\"\r\n"
+      "Accept-Ranges: bytes\r\n"
+      "Cache-Control: max-age=31536000, public\r\n"
+      "Access-Control-Allow-Origin: *\r\n"
+      "X-Cache: HIT from edge-fra-07\r\n"
+      "Age: 8172\r\n"
+      "\r\n";
+
+  // Builds a VOD playlist of count segments.
+  std::string makePlaylist(unsigned int count) {
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n"
+                           "#EXT-X-TARGETDURATION:10\n"
+                           "#EXT-X-MEDIA-SEQUENCE:0\n";
+    char line[96];
+    for (unsigned int i = 0; i < count; i++) {
+      snprintf(line, sizeof(line),
+               "#EXTINF:9.984000,\nvideo_1080p_4500k_%05u.ts\n", i);
+      playlist += line;
+    }
+    playlist += "#EXT-X-ENDLIST\n";
+    return playlist;
+  }
+
+  // The old searches.
+  const char* loopHeaderEnd(const char* data, const char* end) {
+    static const char headerEnd[] = {'\r', '\n', '\r', '\n'};
+    unsigned int matched = 0;
+    for (; (data < end) && (matched < sizeof(headerEnd)); data++) {
+      matched = (*data == headerEnd[matched]) ? matched + 1 : 0;
+    }
+    return (matched == sizeof(headerEnd)) ? data - sizeof(headerEnd) : NULL;
+  }
+
+  const char* loopLineEnd(const char* data, const char* end) {
+    static const char lineEnd[] = {'\r', '\n'};
+    unsigned int matched = 0;
+    for (; (data < end) && (matched < sizeof(lineEnd)); data++) {
+      matched = (*data == lineEnd[matched]) ? matched + 1 : 0;
+    }
+    return (matched == sizeof(lineEnd)) ? data - sizeof(lineEnd) : NULL;
+  }
+
+  const char* loopFind(const char* data, const char* end, char c) {
+    for (; data < end; data++) {
+      if (*data == c) {
+        return data;
+      }
+    }
+    return NULL;
+  }
+
+  // The same searches on memchr.
+  const char* memchrPattern(const char* data, const char* end,
+                            const char* pattern, unsigned int length) {
+    const char* last = end - length;
+    while (data <= last) {
+      data = static_cast<const char*>(memchr(data, pattern[0],
+                                             last - data + 1));
+      if ((data == NULL) || (memcmp(data, pattern, length) == 0)) {
+        return data;
+      }
+      data++;
+    }
+    return NULL;
+  }
+
+  const char* memchrHeaderEnd(const char* data, const char* end) {
+    return memchrPattern(data, end, "\r\n\r\n", 4);
+  }
+
+  const char* memchrLineEnd(const char* data, const char* end) {
+    return memchrPattern(data, end, "\r\n", 2);
+  }
+
+  const char* memchrFind(const char* data, const char* end, char c) {
+    return static_cast<const char*>(memchr(data, c, end - data));
+  }
+
+  // One implementation of each search.
+  struct Searches {
+    const char* name;
+    const char* (*headerEnd)(const char* data, const char* end);
+    const char* (*lineEnd)(const char* data, const char* end);
+    const char* (*find)(const char* data, const char* end, char c);
+  };
+
+  // What the parsers do with a buffer; each returns a sum of offsets, so
+  // the searches cannot be optimized away.
+
+  // TCPSocket: find where the header ends.
+  unsigned long scanHeaderEnd(const Searches& searches, const char* data,
+                              const char* end) {
+    return searches.headerEnd(data, end) - data;
+  }
+
+  // HTTPMessage: split the header into lines, and each line at its colon.
+  unsigned long scanHeaderFields(const Searches& searches, const char* data,
+                                 const char* end) {
+    unsigned long sum = 0;
+    const char* line = data;
+    const char* lineEnd;
+    while ((lineEnd = searches.lineEnd(line, end)) != NULL) {
+      const char* colon = searches.find(line, lineEnd, ':');
+      if (colon != NULL) {
+        sum += colon - data;
+      }
+      line = lineEnd + 2;
+    }
+    return sum;
+  }
+
+  // Playlist: split the playlist into lines.
+  unsigned long scanPlaylistLines(const Searches& searches, const char* data,
+                                  const char* end) {
+    unsigned long sum = 0;
+    const char* line = data;
+    const char* newline;
+    while ((newline = searches.find(line, end, '\n')) != NULL) {
+      sum += newline - data;
+      line = newline + 1;
+    }
+    return sum;
+  }
+
+  double nowSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+  }
+
+  // Runs one workload over the input until BYTES_PER_RUN bytes have been
+  // scanned and prints the throughput.
+  void measure(const char* workload, const Searches& searches,
+               unsigned long (*scan)(const Searches&, const char*,
+                                     const char*),
+               const std::string& input) {
+    const char* data = input.data();
+    const char* end = data + input.size();
+    unsigned long long rounds = BYTES_PER_RUN / input.size() + 1;
+
+    unsigned long sum = 0;
+    double start = nowSeconds();
+    for (unsigned long long i = 0; i < rounds; i++) {
+      sum += scan(searches, data, end);
+      // Keep the compiler from hoisting the scan out of the loop.
+      __asm__ __volatile__("" : : "g"(data) : "memory");
+    }
+    double seconds = nowSeconds() - start;
+
+    printf("%-16s %-8s %9.0f MB/s  (%lu)\n", workload, searches.name,
+           rounds * input.size() / seconds / 1e6,
+           static_cast<unsigned long>(sum / rounds));
+  }
+}
+
+int main() {
+  const Searches implementations[] = {
+    {"loop", loopHeaderEnd, loopLineEnd, loopFind},
+    {"memchr", memchrHeaderEnd, memchrLineEnd, memchrFind},
+    {"scanner", ByteScanner::findHeaderEnd, ByteScanner::findLineEnd,
+     ByteScanner::find},
+  };
+  const unsigned int count = sizeof(implementations) /
+                             sizeof(implementations[0]);
+
+  std::string header = RESPONSE_HEADER;
+  std::string playlist = makePlaylist(10000);
+
+  printf("ByteScanner kernel: %s\n", ByteScanner::getImplementation());
+  printf("header %u bytes, playlist %u bytes\n\n",
+         static_cast<unsigned int>(header.size()),
+         static_cast<unsigned int>(playlist.size()));
+
+  for (unsigned int i = 0; i < count; i++) {
+    measure("header end", implementations[i], scanHeaderEnd, header);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    measure("header fields", implementations[i], scanHeaderFields, header);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    measure("playlist lines", implementations[i], scanPlaylistLines,
+            playlist);
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include "ChunkedDecoder.h"
+#include "ByteScanner.h"
+#include <limits.h>
+
+namespace {
+  /*********************************
+   * Name:    hexValue
+   * Purpose: converts a hex digit of a chunk size
+   * Receive: c - the character
+   * Return:  the digit's value, -1 if c is not a hex digit
+   *********************************/
+  int hexValue(char c) {
+    if ((c >= '0') && (c <= '9')) {
+      return c - '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+      return c - 'a' + 10;
+    } else if ((c >= 'A') && (c <= 'F')) {
+      return c - 'A' + 10;
+    }
+    return -1;
+  }
+}
+
+ChunkedDecoder::ChunkedDecoder(BodySink& sink, bool passThrough)
+    : sink(sink), passThrough(passThrough) {
+  reset();
+}
+
+void ChunkedDecoder::reset() {
+  state = SIZE;
+  chunkSize = 0;
+  chunkLeft = 0;
+  sawDigit = false;
+  bodyLength = 0;
+  trailers.clear();
+}
+
+unsigned int ChunkedDecoder::decode(const char* data, unsigned int length) {
+  const char* next = data;
+  const char* end = data + length;
+
+  while ((next < end) && (state != DONE)) {
+    switch (state) {
+      case SIZE: {
+        int digit = hexValue(*next);
+        if (digit >= 0) {
+          if (chunkSize > (UINT_MAX >> 4)) {
+            throw std::string("ChunkedDecoder Exception: chunk too large");
+          }
+          chunkSize = (chunkSize << 4) | digit;
+          sawDigit = true;
+        } else if (!sawDigit) {
+          throw std::string("ChunkedDecoder Exception: bad chunk size");
+        } else if ((*next == ';') || (*next == ' ') || (*next == '\t')) {
+          state = EXTENSION;  // extensions are not used, skip them
+        } else if (*next == '\r') {
+          state = SIZE_LF;
+        } else if (*next == '\n') {  // tolerate a bare LF
+          next++;
+          endSizeLine();
+          break;
+        } else {
+          throw std::string("ChunkedDecoder Exception: bad chunk size");
+        }
+        next++;
+        break;
+      }
+
+      case EXTENSION: {
+        const char* newline = ByteScanner::find(next, end, '\n');
+        if (newline == NULL) {
+          next = end;  // the rest of the line comes later
+        } else {
+          next = newline + 1;
+          endSizeLine();
+        }
+        break;
+      }
+
+      case SIZE_LF:
+        if (*next != '\n') {
+          throw std::string("ChunkedDecoder Exception: bad chunk size line");
+        }
+        next++;
+        endSizeLine();
+        break;
+
+      case DATA: {
+        unsigned int take = end - next;
+        if (take > chunkLeft) {
+          take = chunkLeft;
+        }
+        if (!passThrough) {  // in pass-through, everything goes out below
+          sink.write(next, take);
+        }
+        next += take;
+        chunkLeft -= take;
+        bodyLength += take;
+        if (chunkLeft == 0) {
+          state = DATA_CR;
+        }
+        break;
+      }
+
+      case DATA_CR:
+      case DATA_LF:
+        if ((state == DATA_CR) && (*next == '\r')) {
+          state = DATA_LF;
+        } else if (*next == '\n') {  // on to the next chunk-size line
+          state = SIZE;
+          chunkSize = 0;
+          sawDigit = false;
+        } else {
+          throw std::string("ChunkedDecoder Exception: chunk data too long");
+        }
+        next++;
+        break;
+
+      case TRAILER:
+        if (*next == '\r') {
+          state = TRAILER_LF;
+          next++;
+        } else if (*next == '\n') {
+          state = DONE;
+          next++;
+        } else {
+          state = TRAILER_FIELD;  // the character is part of the field
+        }
+        break;
+
+      case TRAILER_FIELD: {
+        const char* newline = ByteScanner::find(next, end, '\n');
+        const char* lineEnd = (newline == NULL) ? end : newline + 1;
+        if (trailers.size() + (lineEnd - next) > MAX_TRAILER_LENGTH) {
+          throw std::string("ChunkedDecoder Exception: trailer too long");
+        }
+        trailers.append(next, lineEnd - next);
+        next = lineEnd;
+        if (newline != NULL) {
+          state = TRAILER;
+        }
+        break;
+      }
+
+      case TRAILER_LF:
+        if (*next != '\n') {
+          throw std::string("ChunkedDecoder Exception: bad end of body");
+        }
+        state = DONE;
+        next++;
+        break;
+
+      case DONE:
+        break;
+    }
+  }
+
+  unsigned int used = next - data;
+  if (passThrough) {
+    sink.write(data, used);
+  }
+  return used;
+}
+
+void ChunkedDecoder::receive(TCPSocket& sock) {
+  while (state != DONE) {
+    if (state == DATA) {
+      // Chunk data is the same with or without the framing, so the sink
+      // takes it straight from the socket in either mode.
+      int taken = sink.receive(sock, chunkLeft);
+      if (taken <= 0) {
+        throw std::string("ChunkedDecoder Exception: connection closed "
+                          "in the middle of a chunk");
+      }
+      chunkLeft -= taken;
+      bodyLength += taken;
+      if (chunkLeft == 0) {
+        state = DATA_CR;
+      }
+    } else {
+      const char* data;
+      int available = sock.peekData(data);
+      if (available <= 0) {
+        throw std::string("ChunkedDecoder Exception: connection closed "
+                          "before the last chunk");
+      }
+      sock.consumeData(decode(data, available));
+    }
+  }
+}
+
+void ChunkedDecoder::endSizeLine() {
+  if (chunkSize == 0) {  // the last chunk
+    state = TRAILER;
+  } else {
+    chunkLeft = chunkSize;
+    state = DATA;
+  }
+}
@@ -0,0 +1,136 @@
+/*********************************
+ * ChunkedDecoder - Streaming decoder for a body sent with
+ * "Transfer-Encoding: chunked". It is a small state machine fed the received
+ * bytes in pieces of any size; it remembers where it is inside a chunk-size
+ * line, a chunk or the trailer between calls, so the bytes are looked at
+ * once, where they were received, and the chunk data goes to a BodySink
+ * without the buffer ever being reshaped.
+ *
+ * Chunk extensions (";name=value" after the size) are skipped. Trailer
+ * fields after the last chunk are kept, as received, for getTrailers().
+ *
+ * In pass-through mode the sink receives the body exactly as it came over
+ * the wire, framing included, which is what a proxy forwarding a chunked
+ * response needs; the decoder still follows the framing to find where the
+ * body ends.
+ *
+ * A malformed body is reported by throwing a std::string.
+ *********************************/
+
+#ifndef _CHUNKED_DECODER_H_
+#define _CHUNKED_DECODER_H_
+
+#include "BodySink.h"
+#include "TCPSocket.h"
+#include <string>
+
+class ChunkedDecoder {
+ public:
+  /*********************************
+   * Name:    ChunkedDecoder
+   * Purpose: Constructor, ready for the first chunk-size line
+   * Receive: sink - where the body goes
+   *          passThrough - true to hand the sink the framing as well
+   * Return:  None
+   *********************************/
+  ChunkedDecoder(BodySink& sink, bool passThrough = false);
+
+  /*********************************
+   * Name:    reset
+   * Purpose: Gets ready for another body
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void reset();
+
+  /*********************************
+   * Name:    decode
+   * Purpose: Decodes the next piece of the body, passing the chunk data to
+   *          the sink. Stops at the end of the body.
+   * Receive: data - the next received bytes
+   *          length - the number of bytes
+   * Return:  the number of bytes used, less than length only once the body
+   *          is done; the rest belongs to whatever follows it
+   *********************************/
+  unsigned int decode(const char* data, unsigned int length);
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Reads and decodes the rest of the body from a socket. Chunk
+   *          data is handed to the sink's receive(), so e.g. an FdSink
+   *          splices it; the framing is decoded in the socket's buffer.
+   *          Bytes after the body stay in the socket for the next response.
+   * Receive: sock - the socket to read from
+   * Return:  None, throws a std::string if the connection closes early or
+   *          the body is malformed
+   *********************************/
+  void receive(TCPSocket& sock);
+
+  /*********************************
+   * Name:    isDone
+   * Purpose: Tells whether the whole body, trailer included, was decoded
+   * Receive: None
+   * Return:  true if the body is complete
+   *********************************/
+  bool isDone() const {
+    return state == DONE;
+  }
+
+  /*********************************
+   * Name:    getBodyLength
+   * Purpose: Counts the body bytes decoded so far, without the framing
+   * Receive: None
+   * Return:  the number of bytes
+   *********************************/
+  unsigned int getBodyLength() const {
+    return bodyLength;
+  }
+
+  /*********************************
+   * Name:    getTrailers
+   * Purpose: Looks up the trailer fields that followed the last chunk
+   * Receive: None
+   * Return:  the fields as received, each with its line ending; empty if
+   *          there were none
+   *********************************/
+  const std::string& getTrailers() const {
+    return trailers;
+  }
+
+ private:
+  // The most trailer bytes kept; a longer trailer is taken as an attack.
+  static const unsigned int MAX_TRAILER_LENGTH = 8192;
+
+  enum State {
+    SIZE,            // in the hex digits of a chunk-size line
+    EXTENSION,       // in a chunk extension, up to the end of the line
+    SIZE_LF,         // after the CR of a chunk-size line
+    DATA,            // in the data of a chunk
+    DATA_CR,         // after the data, before its CRLF
+    DATA_LF,         // after the CR following the data
+    TRAILER,         // at the start of a trailer line
+    TRAILER_FIELD,   // in a trailer field, up to the end of the line
+    TRAILER_LF,      // after the CR of the blank line ending the body
+    DONE
+  };
+
+  BodySink& sink;
+  bool passThrough;
+  State state;
+  unsigned int chunkSize;  // of the current chunk
+  unsigned int chunkLeft;  // data bytes still to come in the current chunk
+  bool sawDigit;           // the chunk-size line has a digit
+  unsigned int bodyLength;
+  std::string trailers;
+
+  /*********************************
+   * Name:    endSizeLine
+   * Purpose: Moves on from a finished chunk-size line, to the chunk's data
+   *          or, after the last chunk, to the trailer
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void endSizeLine();
+};
+
+#endif  // _CHUNKED_DECODER_H_
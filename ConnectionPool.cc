@@ -0,0 +1,118 @@
+#include "ConnectionPool.h"
+#include <errno.h>
+#include <poll.h>
+#include <sstream>
+
+ConnectionPool::ConnectionPool(unsigned int idleTimeout,
+    unsigned int maxIdlePerHost)
+    : idleTimeout(idleTimeout), maxIdlePerHost(maxIdlePerHost) {
+}
+
+ConnectionPool::~ConnectionPool() {
+  closeIdle();
+}
+
+TCPSocket* ConnectionPool::acquire(const URL& url, bool& reused) {
+  std::map<std::string, std::deque<IdleConnection> >::iterator it =
+      idle.find(makeKey(url));
+  time_t now = time(NULL);
+
+  if (it != idle.end()) {
+    std::deque<IdleConnection>& connections = it->second;
+
+    // Take the most recently used connection first; it is the least
+    // likely to have been timed out by the server.
+    while (!connections.empty()) {
+      IdleConnection connection = connections.back();
+      connections.pop_back();
+
+      if ((now - connection.lastUsed <= static_cast<time_t>(idleTimeout)) &&
+          !isStale(*connection.sock)) {
+        reused = true;
+        return connection.sock;
+      }
+      delete connection.sock;
+    }
+  }
+
+  reused = false;
+  TCPSocket* sock = new TCPSocket();
+  try {
+    sock->setOptions(options);  // applied once Connect creates the socket
+    sock->Connect(url);
+  } catch (std::string msg) {
+    delete sock;
+    throw msg;
+  }
+  return sock;
+}
+
+void ConnectionPool::release(const URL& url, TCPSocket* sock, bool reusable) {
+  if (!reusable || (sock->getDescriptor() < 0) || (maxIdlePerHost == 0)) {
+    delete sock;
+    return;
+  }
+
+  std::deque<IdleConnection>& connections = idle[makeKey(url)];
+  if (connections.size() >= maxIdlePerHost) {  // drop the oldest
+    delete connections.front().sock;
+    connections.pop_front();
+  }
+
+  IdleConnection connection;
+  connection.sock = sock;
+  connection.lastUsed = time(NULL);
+  connections.push_back(connection);
+}
+
+void ConnectionPool::closeIdle() {
+  for (std::map<std::string, std::deque<IdleConnection> >::iterator it =
+       idle.begin(); it != idle.end(); it++) {
+    for (size_t i = 0; i < it->second.size(); i++) {
+      delete it->second[i].sock;
+    }
+  }
+  idle.clear();
+}
+
+unsigned int ConnectionPool::getNumIdle() const {
+  unsigned int count = 0;
+  for (std::map<std::string, std::deque<IdleConnection> >::const_iterator it =
+       idle.begin(); it != idle.end(); it++) {
+    count += it->second.size();
+  }
+  return count;
+}
+
+std::string ConnectionPool::makeKey(const URL& url) {
+  std::ostringstream key;
+  // If the port is not defined, the connection goes to 80
+  key << url.getHost() << ':' << (url.isPortDefined() ? url.getPort() : 80);
+  return key.str();
+}
+
+bool ConnectionPool::isStale(TCPSocket& sock) {
+  // Nothing should arrive on an idle connection; leftovers mean the last
+  // exchange was not fully consumed.
+  if (sock.hasBufferedData()) {
+    return true;
+  }
+
+  pollfd check;
+  check.fd = sock.getDescriptor();
+  check.events = POLLIN;
+  check.revents = 0;
+
+  int ready = poll(&check, 1, 0);
+  if (ready == 0) {  // quiet, as an idle connection should be
+    return false;
+  } else if (ready < 0) {
+    return true;
+  }
+
+  // Readable while idle: either the server closed it (recv returns 0), or
+  // reset it, or sent something we did not ask for. None is reusable.
+  char peek;
+  ssize_t peeked = recv(check.fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+  return (peeked != -1) || ((errno != EAGAIN) && (errno != EWOULDBLOCK));
+}
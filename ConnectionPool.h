@@ -0,0 +1,146 @@
+/*********************************
+ * ConnectionPool - Keeps idle HTTP/1.1 keep-alive connections around so that
+ * later requests to the same server can reuse them instead of paying for a
+ * new TCP handshake (and slow-start) every time. Connections are keyed by
+ * host:port.
+ *
+ * A connection handed back to the pool is only reused while it is fresh: it
+ * is dropped once it has been idle for longer than the idle timeout, and
+ * when it is taken out of the pool it is checked for having been closed by
+ * the server in the meantime.
+ *********************************/
+
+#ifndef _CONNECTION_POOL_H_
+#define _CONNECTION_POOL_H_
+
+#include "TCPSocket.h"
+#include "URL.h"
+#include <ctime>
+#include <deque>
+#include <map>
+#include <string>
+
+class ConnectionPool {
+ public:
+  /*********************************
+   * Name:    ConnectionPool
+   * Purpose: Constructor of ConnectionPool class objects
+   * Receive: idleTimeout - seconds an idle connection is kept before it
+   *                        is closed
+   *          maxIdlePerHost - the most idle connections kept per host:port
+   * Return:  None
+   *********************************/
+  ConnectionPool(unsigned int idleTimeout = 15,
+                 unsigned int maxIdlePerHost = 4);
+
+  /*********************************
+   * Name:    ~ConnectionPool
+   * Purpose: Destructor, closes every idle connection
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~ConnectionPool();
+
+  /*********************************
+   * Name:    acquire
+   * Purpose: Hands out a connection to the server of url, reusing an idle
+   *          one if a fresh one is available and connecting otherwise.
+   * Receive: url - the URL to connect to
+   *          reused - set to true if the connection came from the pool.
+   *                   A reused connection can still turn out to have been
+   *                   closed by the server, so a request that fails on it
+   *                   before any response arrives is worth retrying.
+   * Return:  the connection; give it back with release()
+   *********************************/
+  TCPSocket* acquire(const URL& url, bool& reused);
+
+  /*********************************
+   * Name:    release
+   * Purpose: Gives a connection back. Reusable connections are kept for
+   *          the next request to the same server, others are closed.
+   * Receive: url - the URL the connection was acquired for
+   *          sock - the connection
+   *          reusable - true if the last response was read completely
+   *                     and the server agreed to keep the connection open
+   * Return:  None
+   *********************************/
+  void release(const URL& url, TCPSocket* sock, bool reusable);
+
+  /*********************************
+   * Name:    closeIdle
+   * Purpose: Closes every idle connection
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void closeIdle();
+
+  /*********************************
+   * Name:    getNumIdle
+   * Purpose: Counts the idle connections held by the pool
+   * Receive: None
+   * Return:  the number of idle connections
+   *********************************/
+  unsigned int getNumIdle() const;
+
+  /*********************************
+   * Name:    isSameServer
+   * Purpose: Checks whether two URLs can share a connection
+   * Receive: first, second - the URLs
+   * Return:  true if both are on the same host:port
+   *********************************/
+  static bool isSameServer(const URL& first, const URL& second) {
+    return makeKey(first) == makeKey(second);
+  }
+
+  /*********************************
+   * Name:    setSocketOptions
+   * Purpose: Sets the tuning options for connections made from now on.
+   *          Connections already open, idle or not, keep theirs.
+   * Receive: options - the options
+   * Return:  None
+   *********************************/
+  void setSocketOptions(const SocketOptions& options) {
+    this->options = options;
+  }
+
+  /*********************************
+   * Name:    getSocketOptions
+   * Purpose: Looks up the tuning options given to new connections
+   * Receive: None
+   * Return:  the options
+   *********************************/
+  const SocketOptions& getSocketOptions() const {
+    return options;
+  }
+
+ private:
+  // A connection waiting in the pool, and when it was last used.
+  struct IdleConnection {
+    TCPSocket* sock;
+    time_t lastUsed;
+  };
+
+  unsigned int idleTimeout;
+  unsigned int maxIdlePerHost;
+  SocketOptions options;
+  std::map<std::string, std::deque<IdleConnection> > idle;
+
+  /*********************************
+   * Name:    makeKey
+   * Purpose: Builds the host:port key for a URL
+   * Receive: url - the URL
+   * Return:  the key
+   *********************************/
+  static std::string makeKey(const URL& url);
+
+  /*********************************
+   * Name:    isStale
+   * Purpose: Checks, without blocking, whether an idle connection has
+   *          been closed by the server (or has unexpected data waiting)
+   * Receive: sock - the idle connection
+   * Return:  true if the connection must not be reused
+   *********************************/
+  static bool isStale(TCPSocket& sock);
+};
+
+#endif  // _CONNECTION_POOL_H_
@@ -0,0 +1,442 @@
+#include "EventLoop.h"
+#include <algorithm>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+namespace {
+  // The most readiness events handled per epoll_wait call.
+  const int MAX_EVENTS = 64;
+}
+
+EventLoop::EventLoop() : nextResolveId(0) {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    throw std::string("EventLoop Exception: Unable to create epoll instance");
+  }
+
+  // Resolver completions are told apart from sockets by a NULL pointer.
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, resolver.getDescriptor(), &event) < 0) {
+    close(epollFd);
+    throw std::string("EventLoop Exception: Unable to watch the resolver");
+  }
+}
+
+EventLoop::~EventLoop() {
+  for (std::map<TCPSocket*, Entry*>::iterator it = entries.begin();
+       it != entries.end(); it++) {
+    delete it->first;
+    delete it->second;
+  }
+  entries.clear();
+
+  for (size_t i = 0; i < graveyard.size(); i++) {
+    delete graveyard[i];
+  }
+  graveyard.clear();
+
+  close(epollFd);
+}
+
+void EventLoop::add(TCPSocket* sock) {
+  findEntry(sock);
+}
+
+void EventLoop::remove(TCPSocket* sock) {
+  std::map<TCPSocket*, Entry*>::iterator it = entries.find(sock);
+  if (it != entries.end()) {  // else never owned by the loop
+    forget(it);
+  }
+  delete sock;
+}
+
+TCPSocket* EventLoop::detach(TCPSocket* sock) {
+  std::map<TCPSocket*, Entry*>::iterator it = entries.find(sock);
+  if (it == entries.end()) {
+    return sock;
+  }
+
+  forget(it);
+  if (sock->getDescriptor() >= 0) {
+    sock->setNonBlocking(false);
+  }
+  return sock;
+}
+
+void EventLoop::forget(std::map<TCPSocket*, Entry*>::iterator it) {
+  Entry* entry = it->second;
+  if (entry->fd >= 0) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+  }
+  entries.erase(it);
+
+  // An operation started on the socket before it was forgotten may have
+  // queued the entry to run in the next pass, which would outlive it.
+  runnable.erase(std::remove(runnable.begin(), runnable.end(), entry),
+                 runnable.end());
+
+  // Events for this entry may still be queued in the current batch, so
+  // only mark it here and free it once the batch is over.
+  entry->removed = true;
+  entry->sock = NULL;
+  graveyard.push_back(entry);
+}
+
+void EventLoop::connect(TCPSocket* sock, const URL& url, Handler* handler,
+    int timeoutMs) {
+  Entry* entry = findEntry(sock);
+  startOperation(entry, CONNECTING, handler, timeoutMs);
+
+  // Connecting recreates the descriptor, so any old registration is void.
+  entry->fd = -1;
+  entry->events = 0;
+
+  // The connection itself is started from onResolved.
+  entry->resolveId = ++nextResolveId;
+  // If the port is not defined, connect to 80
+  resolver.resolveAsync(url.getHost(),
+                        url.isPortDefined() ? url.getPort() : 80, this,
+                        reinterpret_cast<void*>(entry->resolveId));
+}
+
+void EventLoop::onResolved(void* context,
+    const std::vector<Resolver::Address>& addresses,
+    const std::string& error) {
+  unsigned long resolveId = reinterpret_cast<unsigned long>(context);
+
+  // Find who asked; they may have been removed or timed out since.
+  Entry* entry = NULL;
+  for (std::map<TCPSocket*, Entry*>::iterator it = entries.begin();
+       it != entries.end(); it++) {
+    if (it->second->resolveId == resolveId) {
+      entry = it->second;
+      break;
+    }
+  }
+  if ((entry == NULL) || (entry->op != CONNECTING)) {
+    return;
+  }
+  entry->resolveId = 0;
+
+  // Failures are reported from advance(), like every other one.
+  bool connected = false;
+  if (!error.empty()) {
+    entry->error = error;
+  } else {
+    try {
+      connected = entry->sock->startConnect(addresses[0]);
+    } catch (std::string msg) {
+      entry->error = msg;
+    }
+  }
+  if (!entry->error.empty()) {
+    runnable.push_back(entry);
+    return;
+  }
+
+  watch(entry, EPOLLOUT);
+  if (connected) {
+    runnable.push_back(entry);
+  }
+}
+
+void EventLoop::readHeader(TCPSocket* sock, Handler* handler, int timeoutMs) {
+  Entry* entry = findEntry(sock);
+  startOperation(entry, READING_HEADER, handler, timeoutMs);
+  watch(entry, EPOLLIN);
+
+  // The header may already be sitting in the socket's buffer.
+  runnable.push_back(entry);
+}
+
+void EventLoop::readData(TCPSocket* sock, unsigned int length,
+    Handler* handler, int timeoutMs) {
+  Entry* entry = findEntry(sock);
+  startOperation(entry, READING_DATA, handler, timeoutMs);
+  entry->bytesLeft = length;
+  entry->data.clear();
+  entry->data.reserve(length);
+  watch(entry, EPOLLIN);
+
+  runnable.push_back(entry);
+}
+
+unsigned int EventLoop::getNumPending() const {
+  unsigned int pending = 0;
+  for (std::map<TCPSocket*, Entry*>::const_iterator it = entries.begin();
+       it != entries.end(); it++) {
+    if (it->second->op != IDLE) {
+      pending++;
+    }
+  }
+  return pending;
+}
+
+int EventLoop::runOnce(int maxWaitMs) {
+  int completed = 0;
+
+  // First give everything that might progress without new readiness a
+  // chance. Callbacks may queue more, which are handled next time around.
+  std::vector<Entry*> ready;
+  ready.swap(runnable);
+  for (size_t i = 0; i < ready.size(); i++) {
+    if (!ready[i]->removed && (ready[i]->op != IDLE) && advance(ready[i])) {
+      completed++;
+    }
+  }
+
+  // Work out how long we may block: not at all if there is more to do,
+  // otherwise until the caller's limit or the nearest timeout.
+  long long nearest = -1;
+  for (std::map<TCPSocket*, Entry*>::const_iterator it = entries.begin();
+       it != entries.end(); it++) {
+    const Entry* entry = it->second;
+    if ((entry->op != IDLE) && (entry->deadline >= 0) &&
+        ((nearest < 0) || (entry->deadline < nearest))) {
+      nearest = entry->deadline;
+    }
+  }
+
+  int waitMs = maxWaitMs;
+  if ((completed > 0) || !runnable.empty()) {
+    waitMs = 0;
+  } else if (getNumPending() == 0) {
+    return 0;  // nothing could ever wake us up
+  } else if (nearest >= 0) {
+    long long untilDeadline = nearest - now();
+    if (untilDeadline < 0) {
+      untilDeadline = 0;
+    }
+    if ((waitMs < 0) || (untilDeadline < waitMs)) {
+      waitMs = static_cast<int>(untilDeadline);
+    }
+  }
+
+  epoll_event events[MAX_EVENTS];
+  int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, waitMs);
+  if ((numEvents < 0) && (errno != EINTR)) {
+    throw std::string("EventLoop Exception: epoll_wait failed");
+  }
+
+  for (int i = 0; i < numEvents; i++) {
+    Entry* entry = static_cast<Entry*>(events[i].data.ptr);
+    if (entry == NULL) {  // host names resolved, connections can start
+      resolver.dispatch();
+      continue;
+    }
+    if (!entry->removed && (entry->op != IDLE) && advance(entry)) {
+      completed++;
+    }
+  }
+
+  // Expire anything that ran past its deadline. Collect first, since the
+  // callbacks may add or remove sockets.
+  long long current = now();
+  std::vector<Entry*> expired;
+  for (std::map<TCPSocket*, Entry*>::iterator it = entries.begin();
+       it != entries.end(); it++) {
+    Entry* entry = it->second;
+    if ((entry->op != IDLE) && (entry->deadline >= 0) &&
+        (current >= entry->deadline)) {
+      expired.push_back(entry);
+    }
+  }
+  for (size_t i = 0; i < expired.size(); i++) {
+    if (!expired[i]->removed && (expired[i]->op != IDLE)) {
+      fail(expired[i], "EventLoop Exception: operation timed out");
+      completed++;
+    }
+  }
+
+  for (size_t i = 0; i < graveyard.size(); i++) {
+    delete graveyard[i];
+  }
+  graveyard.clear();
+
+  return completed;
+}
+
+void EventLoop::run() {
+  while ((getNumPending() > 0) || !runnable.empty()) {
+    runOnce(-1);
+  }
+}
+
+EventLoop::Entry* EventLoop::findEntry(TCPSocket* sock) {
+  std::map<TCPSocket*, Entry*>::iterator it = entries.find(sock);
+  if (it != entries.end()) {
+    return it->second;
+  }
+
+  Entry* entry = new Entry;
+  entry->sock = sock;
+  entry->fd = -1;
+  entry->events = 0;
+  entry->op = IDLE;
+  entry->handler = NULL;
+  entry->deadline = -1;
+  entry->resolveId = 0;
+  entry->bytesLeft = 0;
+  entry->removed = false;
+  entries[sock] = entry;
+
+  // Sockets connected elsewhere still have to stop blocking.
+  if (sock->getDescriptor() >= 0) {
+    sock->setNonBlocking(true);
+  }
+  return entry;
+}
+
+void EventLoop::startOperation(Entry* entry, Operation op, Handler* handler,
+    int timeoutMs) {
+  entry->op = op;
+  entry->handler = handler;
+  entry->deadline = (timeoutMs >= 0) ? now() + timeoutMs : -1;
+  entry->resolveId = 0;
+  entry->error.clear();
+}
+
+void EventLoop::watch(Entry* entry, unsigned int events) {
+  int fd = entry->sock->getDescriptor();
+
+  if (fd < 0) {
+    if (events != 0) {
+      entry->error = "EventLoop Exception: socket is not open";
+      runnable.push_back(entry);
+    }
+    return;
+  }
+
+  // An idle socket is taken out of epoll altogether. Even with no events
+  // asked for, epoll keeps reporting errors and hangups, so a reset on an
+  // idle connection would wake the loop over and over.
+  if (events == 0) {
+    if (entry->fd >= 0) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+    }
+    entry->fd = -1;
+    entry->events = 0;
+    return;
+  }
+
+  epoll_event event;
+  event.events = events;
+  event.data.ptr = entry;
+
+  if ((fd == entry->fd) && (events == entry->events)) {
+    return;  // already registered this way
+  }
+
+  // The socket may have been closed and recreated (by a reconnect) since
+  // it was last registered, in which case the old registration is gone.
+  int result = -1;
+  if (fd == entry->fd) {
+    result = epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+  if (result < 0) {
+    result = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    if ((result < 0) && (errno == EEXIST)) {
+      result = epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+  }
+
+  if (result < 0) {
+    entry->error = "EventLoop Exception: unable to watch socket";
+    runnable.push_back(entry);
+    return;
+  }
+  entry->fd = fd;
+  entry->events = events;
+}
+
+bool EventLoop::advance(Entry* entry) {
+  TCPSocket& sock = *entry->sock;
+  Handler* handler = entry->handler;
+
+  if (!entry->error.empty()) {
+    fail(entry, entry->error);
+    return true;
+  }
+
+  // Every branch clears the operation before calling back, so the handler
+  // is free to start the next one (or remove the socket).
+  try {
+    switch (entry->op) {
+      case CONNECTING:
+        sock.finishConnect();
+        entry->op = IDLE;
+        watch(entry, 0);
+        if (handler) {
+          handler->onConnect(sock);
+        }
+        return true;
+
+      case READING_HEADER: {
+        std::string header;
+        if (!sock.tryReadHeader(header)) {
+          return false;
+        }
+        entry->op = IDLE;
+        watch(entry, 0);
+        if (handler) {
+          handler->onHeader(sock, header);
+        }
+        return true;
+      }
+
+      case READING_DATA: {
+        bool complete = true;
+        while (entry->bytesLeft > 0) {
+          int bytesRead = sock.tryReadData(entry->data, entry->bytesLeft);
+          if (bytesRead < 0) {
+            return false;  // wait for more
+          } else if (bytesRead == 0) {  // peer closed early
+            complete = false;
+            break;
+          }
+          entry->bytesLeft -= bytesRead;
+        }
+        entry->op = IDLE;
+        watch(entry, 0);
+
+        std::string data;
+        data.swap(entry->data);
+        if (handler) {
+          handler->onData(sock, data, complete);
+        }
+        return true;
+      }
+
+      case IDLE:
+        break;
+    }
+  } catch (std::string msg) {
+    fail(entry, msg);
+    return true;
+  }
+  return false;
+}
+
+void EventLoop::fail(Entry* entry, const std::string& message) {
+  Handler* handler = entry->handler;
+
+  entry->op = IDLE;
+  entry->error.clear();
+  entry->data.clear();
+  if (entry->fd >= 0) {
+    watch(entry, 0);
+  }
+
+  if (handler) {
+    handler->onError(*entry->sock, message);
+  }
+}
+
+long long EventLoop::now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,294 @@
+/*********************************
+ * EventLoop - An epoll based reactor that drives many non-blocking TCPSocket
+ * objects from a single thread. Operations (connect, readHeader, readData)
+ * are started on a socket and complete later, from inside run()/runOnce(),
+ * by calling back into a Handler. Each socket has at most one operation in
+ * flight; a handler usually starts the next one from its callback.
+ *
+ * Host names are resolved asynchronously with a Resolver whose completions
+ * the loop waits for alongside the sockets, so a slow DNS answer does not
+ * hold up the other connections.
+ *
+ * The loop owns every socket added to it and deletes them when they are
+ * removed or when the loop itself is destroyed. Errors are reported through
+ * Handler::onError rather than thrown out of run().
+ *********************************/
+
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include "Resolver.h"
+#include "TCPSocket.h"
+#include "URL.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class EventLoop : private Resolver::Handler {
+ public:
+  /*********************************
+   * Handler - Completion callbacks for operations started on the loop.
+   * Override the ones you need; the defaults do nothing.
+   *********************************/
+  class Handler {
+   public:
+    virtual ~Handler() {}
+
+    /*********************************
+     * Name:    onConnect
+     * Purpose: called once a connect operation has completed
+     * Receive: sock - the newly connected socket
+     * Return:  None
+     *********************************/
+    virtual void onConnect(TCPSocket& sock) {}
+
+    /*********************************
+     * Name:    onHeader
+     * Purpose: called once a complete message header has been received.
+     *          Body bytes that arrived with it stay buffered in sock.
+     * Receive: sock - the socket the header was read from
+     *          header - the header, including the final \r\n\r\n
+     * Return:  None
+     *********************************/
+    virtual void onHeader(TCPSocket& sock, std::string& header) {}
+
+    /*********************************
+     * Name:    onData
+     * Purpose: called once a readData operation has finished, either
+     *          because all of the requested bytes arrived or because the
+     *          peer closed the connection
+     * Receive: sock - the socket the data was read from
+     *          data - the received bytes; may be swapped out
+     *          complete - false if the connection closed early
+     * Return:  None
+     *********************************/
+    virtual void onData(TCPSocket& sock, std::string& data, bool complete) {}
+
+    /*********************************
+     * Name:    onError
+     * Purpose: called when an operation fails or times out
+     * Receive: sock - the socket the operation was running on
+     *          message - a description of the failure
+     * Return:  None
+     *********************************/
+    virtual void onError(TCPSocket& sock, const std::string& message) {}
+  };
+
+  /*********************************
+   * Name:    EventLoop
+   * Purpose: Constructor, creates the epoll instance
+   * Receive: None
+   * Return:  None
+   *********************************/
+  EventLoop();
+
+  /*********************************
+   * Name:    ~EventLoop
+   * Purpose: Destructor, deletes every socket still owned by the loop
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~EventLoop();
+
+  /*********************************
+   * Name:    add
+   * Purpose: Hands a socket over to the loop. The loop deletes it when it
+   *          is removed or when the loop is destroyed.
+   * Receive: sock - the socket to own
+   * Return:  None
+   *********************************/
+  void add(TCPSocket* sock);
+
+  /*********************************
+   * Name:    remove
+   * Purpose: Cancels any operation on the socket, closes and deletes it.
+   *          Safe to call from inside a Handler callback.
+   * Receive: sock - the socket to get rid of
+   * Return:  None
+   *********************************/
+  void remove(TCPSocket* sock);
+
+  /*********************************
+   * Name:    detach
+   * Purpose: Cancels any operation on the socket and hands it back to the
+   *          caller, open and blocking again, e.g. to keep a connection
+   *          for later requests. Safe to call from inside a Handler
+   *          callback.
+   * Receive: sock - the socket to give up
+   * Return:  the socket; the caller now owns it
+   *********************************/
+  TCPSocket* detach(TCPSocket* sock);
+
+  /*********************************
+   * Name:    connect
+   * Purpose: Starts a non-blocking connection to a URL. The socket is
+   *          added to the loop if it is not owned already.
+   * Receive: sock - the socket to connect
+   *          url - the server to connect to
+   *          handler - notified through onConnect or onError
+   *          timeoutMs - how long the connection may take, -1 for no limit
+   * Return:  None
+   *********************************/
+  void connect(TCPSocket* sock, const URL& url, Handler* handler,
+      int timeoutMs = -1);
+
+  /*********************************
+   * Name:    readHeader
+   * Purpose: Starts reading a complete message header from the socket
+   * Receive: sock - a connected socket owned by the loop
+   *          handler - notified through onHeader or onError
+   *          timeoutMs - how long to wait for the header, -1 for no limit
+   * Return:  None
+   *********************************/
+  void readHeader(TCPSocket* sock, Handler* handler, int timeoutMs = -1);
+
+  /*********************************
+   * Name:    readData
+   * Purpose: Starts reading length bytes from the socket
+   * Receive: sock - a connected socket owned by the loop
+   *          length - the number of bytes to read
+   *          handler - notified through onData or onError
+   *          timeoutMs - how long the whole read may take, -1 for no limit
+   * Return:  None
+   *********************************/
+  void readData(TCPSocket* sock, unsigned int length, Handler* handler,
+      int timeoutMs = -1);
+
+  /*********************************
+   * Name:    getNumPending
+   * Purpose: Counts the operations that have not completed yet
+   * Receive: None
+   * Return:  the number of sockets with an operation in flight
+   *********************************/
+  unsigned int getNumPending() const;
+
+  /*********************************
+   * Name:    runOnce
+   * Purpose: Waits for at most one batch of readiness events and advances
+   *          the operations they belong to, firing any callbacks
+   * Receive: maxWaitMs - the longest to block, -1 to wait until something
+   *                      happens or an operation times out
+   * Return:  the number of operations that completed or failed
+   *********************************/
+  int runOnce(int maxWaitMs = -1);
+
+  /*********************************
+   * Name:    run
+   * Purpose: Keeps calling runOnce until no operations are pending
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void run();
+
+ private:
+  enum Operation {IDLE, CONNECTING, READING_HEADER, READING_DATA};
+
+  // Everything the loop tracks for one owned socket.
+  struct Entry {
+    TCPSocket* sock;
+    int fd;              // descriptor registered with epoll, -1 if none
+    unsigned int events;  // epoll events currently registered
+    Operation op;
+    Handler* handler;
+    long long deadline;  // monotonic ms, -1 for no timeout
+    unsigned long resolveId;  // lookup in flight for a connect, 0 if none
+    unsigned int bytesLeft;
+    std::string data;
+    std::string error;   // failure to report on the next attempt
+    bool removed;
+  };
+
+  int epollFd;
+  std::map<TCPSocket*, Entry*> entries;
+
+  // Resolves host names for connect() without blocking the loop. Lookups
+  // are matched back to their entry by id, since the entry may be gone
+  // by the time the answer arrives.
+  Resolver resolver;
+  unsigned long nextResolveId;
+
+  // Entries that may be able to progress without new readiness, e.g.
+  // because their socket already has buffered bytes.
+  std::vector<Entry*> runnable;
+
+  // Entries removed during a batch, deleted once the batch is done.
+  std::vector<Entry*> graveyard;
+
+  /*********************************
+   * Name:    findEntry
+   * Purpose: Looks up (or creates) the bookkeeping for a socket
+   * Receive: sock - the socket
+   * Return:  the socket's entry
+   *********************************/
+  Entry* findEntry(TCPSocket* sock);
+
+  /*********************************
+   * Name:    startOperation
+   * Purpose: Records a new operation on an entry and arranges for it to be
+   *          attempted on the next runOnce
+   * Receive: entry - the socket's entry
+   *          op - the operation to start
+   *          handler - the handler to notify
+   *          timeoutMs - the operation's timeout, -1 for none
+   * Return:  None
+   *********************************/
+  void startOperation(Entry* entry, Operation op, Handler* handler,
+      int timeoutMs);
+
+  /*********************************
+   * Name:    watch
+   * Purpose: Makes epoll report the given events for the entry's socket
+   * Receive: entry - the socket's entry
+   *          events - EPOLLIN/EPOLLOUT, or 0 to take the socket out of
+   *                   epoll
+   * Return:  None
+   *********************************/
+  void watch(Entry* entry, unsigned int events);
+
+  /*********************************
+   * Name:    forget
+   * Purpose: Stops tracking a socket, without deleting it
+   * Receive: it - the socket's place in entries
+   * Return:  None
+   *********************************/
+  void forget(std::map<TCPSocket*, Entry*>::iterator it);
+
+  /*********************************
+   * Name:    advance
+   * Purpose: Makes as much progress as possible on the entry's operation
+   * Receive: entry - the socket's entry
+   * Return:  true if the operation completed or failed
+   *********************************/
+  bool advance(Entry* entry);
+
+  /*********************************
+   * Name:    fail
+   * Purpose: Ends the entry's operation and reports the error
+   * Receive: entry - the socket's entry
+   *          message - a description of the failure
+   * Return:  None
+   *********************************/
+  void fail(Entry* entry, const std::string& message);
+
+  /*********************************
+   * Name:    onResolved
+   * Purpose: Resolver::Handler callback; starts the actual connection once
+   *          the host name of a connect() is known
+   * Receive: context - the id of the lookup
+   *          addresses - the addresses found
+   *          error - a description of the failure, empty on success
+   * Return:  None
+   *********************************/
+  void onResolved(void* context, const std::vector<Resolver::Address>& addresses,
+                  const std::string& error);
+
+  /*********************************
+   * Name:    now
+   * Purpose: Reads the monotonic clock
+   * Receive: None
+   * Return:  the current time in milliseconds
+   *********************************/
+  static long long now();
+};
+
+#endif  // _EVENT_LOOP_H_
@@ -0,0 +1,114 @@
+// Tests for EventLoop: sockets removed from inside a callback, right
+// after the callback queued another operation on them. The loop must not
+// touch their entries once they are freed. Built with AddressSanitizer, so
+// a use after free fails the test even when it happens not to crash. Build
+// and run with "make check".
+
+#include "EventLoop.h"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+  // How many times each test drives the loop after the removal, to reach
+  // whatever the removed entry might have left queued.
+  const int EXTRA_PASSES = 3;
+
+  // Listens on a free port of the loopback address; connections complete
+  // in the backlog without ever being accepted. Returns the descriptor and
+  // sets port, or returns -1.
+  int listenLocal(unsigned short& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if ((bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) ||
+        (listen(fd, 8) < 0) ||
+        (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) < 0)) {
+      close(fd);
+      return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+  }
+
+  // Starts a header read once connected, then either removes the socket
+  // at once or lets the read time out and removes it from onError.
+  class RemovingHandler : public EventLoop::Handler {
+   public:
+    RemovingHandler(EventLoop& loop, bool removeOnConnect)
+        : loop(loop), removeOnConnect(removeOnConnect), connects(0),
+          errors(0) {
+    }
+
+    void onConnect(TCPSocket& sock) {
+      connects++;
+      loop.readHeader(&sock, this, removeOnConnect ? 1000 : 0);
+      if (removeOnConnect) {
+        loop.remove(&sock);
+      }
+    }
+
+    void onError(TCPSocket& sock, const std::string& message) {
+      errors++;
+      loop.remove(&sock);
+    }
+
+    EventLoop& loop;
+    bool removeOnConnect;
+    int connects;
+    int errors;
+  };
+
+  // Runs one test; returns true if it passed.
+  bool runTest(const char* name, const URL& url, bool removeOnConnect,
+               int expectedErrors) {
+    EventLoop loop;
+    RemovingHandler handler(loop, removeOnConnect);
+    loop.connect(new TCPSocket(), url, &handler, 1000);
+    loop.run();
+    for (int i = 0; i < EXTRA_PASSES; i++) {
+      loop.runOnce(0);
+    }
+
+    if ((handler.connects != 1) || (handler.errors != expectedErrors) ||
+        (loop.getNumPending() != 0)) {
+      printf("FAIL %s: %d connects, %d errors, %u pending\n", name,
+             handler.connects, handler.errors, loop.getNumPending());
+      return false;
+    }
+    return true;
+  }
+}
+
+int main() {
+  unsigned short port;
+  int listener = listenLocal(port);
+  if (listener < 0) {
+    printf("FAIL unable to listen on the loopback address\n");
+    return 1;
+  }
+  char urlString[64];
+  snprintf(urlString, sizeof(urlString), "http://127.0.0.1:%u/", port);
+  URL* url = URL::parse(urlString);
+
+  unsigned int failed = 0;
+  if (!runTest("remove after queueing a read", *url, true, 0)) {
+    failed++;
+  }
+  if (!runTest("remove from a timed out read", *url, false, 1)) {
+    failed++;
+  }
+
+  delete url;
+  close(listener);
+  printf("EventLoop: %u of 2 tests passed\n", 2 - failed);
+  return (failed == 0) ? 0 : 1;
+}
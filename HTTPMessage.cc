@@ -1,18 +1,63 @@
 #include "HTTPMessage.h"
+#include "ByteScanner.h"
+#include <ctype.h>
+#include <strings.h>
 #include <algorithm>
 #include <string>
 
-HTTPMessage::HTTPMessage() {
-  // Nothing to do...
+namespace {
+  // Names of the KnownHeader headers, in the order of the enum.
+  const char* const KNOWN_HEADER_NAMES[HTTPMessage::NUM_KNOWN_HEADERS] = {
+    "Content-Length", "Transfer-Encoding", "Host", "Connection",
+    "Content-Encoding"
+  };
+
+  /*********************************
+   * Name:    hashName
+   * Purpose: hashes a header name so that names differing only in case
+   *          get the same hash (FNV-1a over the lowercased name)
+   * Receive: name, length - the name
+   * Return:  the hash
+   *********************************/
+  unsigned hashName(const char* name, unsigned length) {
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0; i < length; i++) {
+      hash ^= tolower(static_cast<unsigned char>(name[i]));
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  // The hashes of KNOWN_HEADER_NAMES, worked out once.
+  struct KnownHashes {
+    unsigned values[HTTPMessage::NUM_KNOWN_HEADERS];
+
+    KnownHashes() {
+      for (int i = 0; i < HTTPMessage::NUM_KNOWN_HEADERS; i++) {
+        values[i] = hashName(KNOWN_HEADER_NAMES[i],
+                             strlen(KNOWN_HEADER_NAMES[i]));
+      }
+    }
+  };
+
+  const KnownHashes& getKnownHashes() {
+    static const KnownHashes hashes;
+    return hashes;
+  }
+}
+
+HTTPMessage::HTTPMessage() : numFields(0) {
+  for (int i = 0; i < NUM_KNOWN_HEADERS; i++) {
+    knownFields[i] = -1;
+  }
 }
 
 HTTPMessage::~HTTPMessage() {
   // Nothing to do here, either...
-  headers.clear();
 }
 
 unsigned HTTPMessage::getNumHeaderFields() const {
-  return headers.size();
+  return numFields;
 }
 
 void
@@ -20,24 +65,44 @@ HTTPMessage::getHeaderSet(
     std::vector<std::pair<std::string, std::string> >& outSet) const {
   outSet.clear();
 
-  for (std::map<std::string, std::string>::const_iterator it = headers.begin();
-       it != headers.end(); it++) {  // iterate thourhg all headers
-    std::pair<std::string, std::string> header(it->first, it->second);
+  for (unsigned i = 0; i < numFields; i++) {  // iterate through all headers
+    const HeaderField& field = getField(i);
+    std::pair<std::string, std::string> header(
+        fieldData.substr(field.nameStart, field.nameLength),
+        fieldData.substr(field.valueStart, field.valueLength));
     outSet.push_back(header);
   }
 }
 
 bool HTTPMessage::getHeaderValue(const std::string& name, std::string& outValue)
     const {
-  std::map<std::string, std::string>::const_iterator it = headers.find(name);
-  if (it != headers.end()) {  // found the header name
-    outValue = it->second;  // get the header value
+  StringSpan value = findHeaderValue(name);
+  if (value.data != NULL) {  // found the header name
+    outValue.assign(value.data, value.length);  // get the header value
     return true;
   } else {
     return false;
   }
 }
 
+StringSpan HTTPMessage::findHeaderValue(const std::string& name) const {
+  int index = findField(name.data(), name.size(),
+                        hashName(name.data(), name.size()));
+  if (index < 0) {
+    return StringSpan();
+  }
+  const HeaderField& field = getField(index);
+  return StringSpan(fieldData.data() + field.valueStart, field.valueLength);
+}
+
+StringSpan HTTPMessage::findHeaderValue(KnownHeader header) const {
+  if (knownFields[header] < 0) {
+    return StringSpan();
+  }
+  const HeaderField& field = getField(knownFields[header]);
+  return StringSpan(fieldData.data() + field.valueStart, field.valueLength);
+}
+
 void HTTPMessage::setHeaderField(const std::pair<std::string, std::string>&
     headerPair) {
   setHeaderField(headerPair.first, headerPair.second);
@@ -45,7 +110,66 @@ void HTTPMessage::setHeaderField(const std::pair<std::string, std::string>&
 
 void HTTPMessage::setHeaderField(const std::string& name,
     const std::string& value) {
-  headers[name] = value;
+  setField(name.data(), name.size(), value.data(), value.size());
+}
+
+int HTTPMessage::findField(const char* name, unsigned length, unsigned hash)
+    const {
+  for (unsigned i = 0; i < numFields; i++) {
+    const HeaderField& field = getField(i);
+    // Comparing hashes first rules out nearly every other header cheaply.
+    if ((field.hash == hash) && (field.nameLength == length) &&
+        (strncasecmp(fieldData.data() + field.nameStart, name, length) == 0)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void HTTPMessage::setField(const char* name, unsigned nameLength,
+    const char* value, unsigned valueLength) {
+  unsigned hash = hashName(name, nameLength);
+  int index = findField(name, nameLength, hash);
+
+  if (index >= 0) {  // replace the value
+    HeaderField& field = getField(index);
+    if (valueLength <= field.valueLength) {  // fits where the old one was
+      fieldData.replace(field.valueStart, valueLength, value, valueLength);
+    } else {
+      field.valueStart = fieldData.size();
+      fieldData.append(value, valueLength);
+    }
+    field.valueLength = valueLength;
+    return;
+  }
+
+  HeaderField field;
+  field.hash = hash;
+  field.nameStart = fieldData.size();
+  field.nameLength = nameLength;
+  fieldData.append(name, nameLength);
+  field.valueStart = fieldData.size();
+  field.valueLength = valueLength;
+  fieldData.append(value, valueLength);
+
+  if (numFields < INLINE_FIELDS) {
+    inlineFields[numFields] = field;
+  } else {
+    extraFields.push_back(field);
+  }
+
+  // Remember where the well-known headers are.
+  const KnownHashes& knownHashes = getKnownHashes();
+  for (int i = 0; i < NUM_KNOWN_HEADERS; i++) {
+    if ((knownHashes.values[i] == hash) &&
+        (strlen(KNOWN_HEADER_NAMES[i]) == nameLength) &&
+        (strncasecmp(KNOWN_HEADER_NAMES[i], name, nameLength) == 0)) {
+      knownFields[i] = numFields;
+      break;
+    }
+  }
+
+  numFields++;
 }
 
 bool HTTPMessage::parseFields(const char* data, unsigned length) {
@@ -54,12 +178,16 @@ bool HTTPMessage::parseFields(const char* data, unsigned length) {
   const char* dataEnd = data + length;
   bool foundEoh = false;  // found end-of-header CRLF
 
+  // All the names and values together take less room than the header,
+  // so this is the only allocation the fields need.
+  fieldData.reserve(fieldData.size() + length);
+
   while (data < dataEnd) {
     // Figure out where this header line ends.  Check if it's a
     // blank line (signifying the end of the headers), and make
     // sure it has an ending at all (if it doesn't, we haven't read
     // the complete header yet).
-    const char* lineEnd = findNextLine(data, length);
+    const char* lineEnd = findNextLine(data, dataEnd - data);
 
     if (lineEnd == (data + lineEnding.length())) {  // lineEnding == "\r\n"
       foundEoh = true;
@@ -73,31 +201,26 @@ bool HTTPMessage::parseFields(const char* data, unsigned length) {
 
     // Figure out where the break between the header name and
     // value appears.
-    const char* delimPos = data;
-    for (; (delimPos < lineEnd) &&
-      (*delimPos != headerDelimiter); delimPos++) {
-    }
+    const char* delimPos = ByteScanner::find(data, lineEnd, headerDelimiter);
     // If it doesn't, we've got a bad header.
-    if (delimPos >= lineEnd) {
+    if (delimPos == NULL) {
       break;
     }
 
     // Grab out the name & value.  Trim any crud off the value
     // that we can.
-    std::string name, value;
-    name = std::string(data, static_cast<size_t>(delimPos - data));
-    value = std::string(delimPos + 1,
-        static_cast<size_t>(lineEnd - delimPos - 1));
-
-    size_t ltrimPos = value.find_first_not_of(" \t\r\n");
-    size_t rtrimPos = value.find_last_not_of(" \t\r\n");
-    if (ltrimPos != std::string::npos) {
-      value = std::string(value, ltrimPos, rtrimPos);
-    } else {
-      value = "";
+    const char* valueStart = delimPos + 1;
+    const char* valueEnd = lineEnd;
+    while ((valueStart < valueEnd) &&
+           isspace(static_cast<unsigned char>(*valueStart))) {
+      valueStart++;
+    }
+    while ((valueEnd > valueStart) &&
+           isspace(static_cast<unsigned char>(*(valueEnd - 1)))) {
+      valueEnd--;
     }
 
-    setHeaderField(name, value);
+    setField(data, delimPos - data, valueStart, valueEnd - valueStart);
 
     // Jump to the next line, for the next header.
     data = lineEnd + lineEnding.length();
@@ -106,15 +229,27 @@ bool HTTPMessage::parseFields(const char* data, unsigned length) {
   return foundEoh;
 }
 
+void HTTPMessage::setHeaderFields(const HTTPParser& parser) {
+  // As with parseFields, one allocation covers every name and value.
+  fieldData.reserve(fieldData.size() + parser.getHeaderLength());
+
+  for (unsigned i = 0; i < parser.getNumHeaders(); i++) {
+    StringSpan name = parser.getHeaderName(i);
+    StringSpan value = parser.getHeaderValue(i);
+    setField(name.data, name.length, value.data, value.length);
+  }
+}
+
 
 void HTTPMessage::print(std::string& outputString) const {
-  // Append the contents of our headers one-by-one.
-  for (std::map<std::string, std::string>::const_iterator it = headers.begin();
-      it != headers.end(); it++) {
-    outputString += it->first;
+  // Append the contents of our headers one-by-one, in the order they
+  // were set.
+  for (unsigned i = 0; i < numFields; i++) {
+    const HeaderField& field = getField(i);
+    outputString.append(fieldData, field.nameStart, field.nameLength);
     outputString += headerDelimiter;
     outputString += " ";
-    outputString += it->second;
+    outputString.append(fieldData, field.valueStart, field.valueLength);
     outputString += lineEnding;
   }
 
@@ -124,22 +259,29 @@ void HTTPMessage::print(std::string& outputString) const {
 
 
 void HTTPMessage::print(char* outputBuffer, unsigned bufferLength) const {
-  const char delimString[] = {headerDelimiter, ' ', '\0'};
-
-  for (std::map<std::string, std::string>::const_iterator it = headers.begin();
-      it != headers.end(); it++) {
-    copyIfRoom(outputBuffer, it->first.c_str(), bufferLength);
-    copyIfRoom(outputBuffer, delimString, bufferLength);
-    copyIfRoom(outputBuffer, it->second.c_str(), bufferLength);
-    copyIfRoom(outputBuffer, lineEnding.c_str(), bufferLength);
+  // Same as above, straight into the caller's buffer.
+  for (unsigned i = 0; i < numFields; i++) {
+    const HeaderField& field = getField(i);
+    copyIfRoom(outputBuffer, fieldData.data() + field.nameStart,
+               field.nameLength, bufferLength);
+    copyIfRoom(outputBuffer, ": ", 2, bufferLength);
+    copyIfRoom(outputBuffer, fieldData.data() + field.valueStart,
+               field.valueLength, bufferLength);
+    copyIfRoom(outputBuffer, lineEnding.data(), lineEnding.size(),
+               bufferLength);
   }
-
-  copyIfRoom(outputBuffer, lineEnding.c_str(), bufferLength);
+  copyIfRoom(outputBuffer, lineEnding.data(), lineEnding.size(),
+             bufferLength);
 }
 
 
 void HTTPMessage::copyIfRoom(char*& outputBuffer,
     const char* dataString, unsigned& remainingLength) const {
+  copyIfRoom(outputBuffer, dataString, strlen(dataString), remainingLength);
+}
+
+void HTTPMessage::copyIfRoom(char*& outputBuffer, const char* data,
+    unsigned dataLength, unsigned& remainingLength) const {
   // Quit now if there's nothing at all that we can do.
   if (remainingLength == 0) {
     return;
@@ -147,13 +289,12 @@ void HTTPMessage::copyIfRoom(char*& outputBuffer,
 
   // Figure out how much data we've got to copy, given the remaining
   // space.
-  unsigned dataLength = strlen(dataString);
   if (dataLength > remainingLength) {
     dataLength = remainingLength;
   }
 
   // copy exactly that much.  Advance the buffer pointer accordingly.
-  memcpy(outputBuffer, dataString, dataLength);
+  memcpy(outputBuffer, data, dataLength);
   remainingLength -= dataLength;
   outputBuffer += dataLength;
 
@@ -163,25 +304,14 @@ void HTTPMessage::copyIfRoom(char*& outputBuffer,
 
 const char* HTTPMessage::findNextLine(const char* data, unsigned length)
     const {
-  // Go character-by-character through the data until we either get past
-  // the end or we get past a line-ending std::string.  Note that in the latter
-  // case, we intentionally move a character past the line ending, so
-  // the returned pointer will point to the *next* line.
-  const char* dataEnd = data + length;
-  unsigned endCharsFound = 0;
-  while ((data < dataEnd) && (endCharsFound < lineEnding.length())) {
-    if (*data == lineEnding[endCharsFound]) {
-      endCharsFound++;
-    } else {
-      endCharsFound = 0;
-    }
-
-    data++;
-  }
+  // Look for the line-ending std::string.  Note that we intentionally move
+  // past the line ending, so the returned pointer will point to the *next*
+  // line.
+  const char* lineEnd = ByteScanner::findLineEnd(data, data + length);
 
   // If we found the line end, great.  If not, boo.
-  if (endCharsFound >= lineEnding.length()) {
-    return data;
+  if (lineEnd != NULL) {
+    return lineEnd + lineEnding.length();
   } else {
     return NULL;
   }
@@ -2,13 +2,20 @@
  * HTTPMessage - Base class for HTTP requests and responses. Defines the
  * methods for accessing the various headers on a request/response. Also
  * defines some internal things that are shared by the request/response classes.
+ *
+ * Header names are case-insensitive, as HTTP says. The headers live in one
+ * string holding every name and value back to back, indexed by a small
+ * array of fields kept inside the object, so a typical message allocates
+ * once for all of its headers. The few headers every response is asked
+ * for (see KnownHeader) are found without searching.
  *********************************/
 
 #ifndef _HTTP_MESSAGE_H_
 #define _HTTP_MESSAGE_H_
 
+#include "HTTPParser.h"
+#include "StringSpan.h"
 #include <string.h>
-#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -23,6 +30,17 @@ namespace {
 
 class HTTPMessage {
  public:
+  // Headers looked up for nearly every message; their positions are
+  // remembered as they are set.
+  enum KnownHeader {
+    CONTENT_LENGTH,
+    TRANSFER_ENCODING,
+    HOST,
+    CONNECTION,
+    CONTENT_ENCODING,
+    NUM_KNOWN_HEADERS
+  };
+
   /*********************************
    * Name:    ~HTTPMessage
    * Purpose: destructor of HTTPMessage class objects
@@ -54,8 +72,9 @@ class HTTPMessage {
       const;
 
   /*********************************
-   * Name: 
-   * Purpose: retrieves the value of the header with the given name.
+   * Name:    getHeaderValue
+   * Purpose: retrieves the value of the header with the given name,
+   *          ignoring case.
    * Receive: name - the name of the header to look up.
    *          outValue - Will be set to that header's value, if it is 
    *                     found. If no header with that name is found, 
@@ -66,6 +85,25 @@ class HTTPMessage {
    *********************************/
   bool getHeaderValue(const std::string& name, std::string& outValue) const;
 
+  /*********************************
+   * Name:    findHeaderValue
+   * Purpose: looks up the value of the header with the given name, ignoring
+   *          case, without copying it
+   * Receive: name - the name of the header to look up
+   * Return:  the value; its data is NULL if there is no such header. It
+   *          stays valid until a header of the message is changed.
+   *********************************/
+  StringSpan findHeaderValue(const std::string& name) const;
+
+  /*********************************
+   * Name:    findHeaderValue
+   * Purpose: looks up the value of a well-known header without searching
+   * Receive: header - which header
+   * Return:  the value; its data is NULL if there is no such header. It
+   *          stays valid until a header of the message is changed.
+   *********************************/
+  StringSpan findHeaderValue(KnownHeader header) const;
+
   /*********************************
    * Name:    setHeaderField
    * Purpose: Updates the message to have the given header field.  
@@ -105,6 +143,14 @@ class HTTPMessage {
    *********************************/
   bool parseFields(const char* data, unsigned length);
 
+  /*********************************
+   * Name:    setHeaderFields
+   * Purpose: copies the header fields a parser found into the message
+   * Receive: parser - a parser that has parsed a complete header
+   * Return:  None
+   *********************************/
+  void setHeaderFields(const HTTPParser& parser);
+
   /*********************************
    * Name:    print
    * Purpose: construct a string that represents this message, for
@@ -136,9 +182,33 @@ class HTTPMessage {
   virtual void copyIfRoom(char*& outputBuffer, const char* dataString,
                           unsigned& remainingLength) const;
 
+  /*********************************
+   * Name:    copyIfRoom
+   * Purpose: copy as much of the data into the buffer as it has room for
+   * Receive: outputBuffer - the char array to store the data
+   *          data - the data to be copied
+   *          dataLength - the length of the data
+   *          remainingLength - the remaining room of the buffer
+   * Return:  None
+   *********************************/
+  void copyIfRoom(char*& outputBuffer, const char* data, unsigned dataLength,
+                  unsigned& remainingLength) const;
+
+  /*********************************
+   * Name:    setField
+   * Purpose: sets a header from raw characters, adding it or replacing
+   *          the value of the header with the same name. Unlike
+   *          setHeaderField, no std::string has to be built for it.
+   * Receive: name, nameLength - the name
+   *          value, valueLength - the value
+   * Return:  None
+   *********************************/
+  void setField(const char* name, unsigned nameLength, const char* value,
+                unsigned valueLength);
+
   /*********************************
    * Name:    findNextLine
-   * Purpose: scan the data char-by-char until a newline char is found.
+   * Purpose: scan the data until a line ending (\r\n) is found.
    * Receive: data - the char array to be scaned
    *          length - the length of the data
    * Return:  the pointer points to the beginning of next line.
@@ -146,7 +216,48 @@ class HTTPMessage {
   const char* findNextLine(const char* data, unsigned length) const;
 
  private:
-  std::map<std::string, std::string> headers;
+  // Where a header's name and value are in fieldData. Offsets rather than
+  // pointers, so that fieldData can grow and messages can be copied.
+  struct HeaderField {
+    unsigned hash;  // of the lowercased name
+    unsigned nameStart;
+    unsigned nameLength;
+    unsigned valueStart;
+    unsigned valueLength;
+  };
+
+  // Enough for the headers of most messages; more go to extraFields.
+  static const unsigned INLINE_FIELDS = 16;
+
+  std::string fieldData;
+  HeaderField inlineFields[INLINE_FIELDS];
+  std::vector<HeaderField> extraFields;
+  unsigned numFields;
+  int knownFields[NUM_KNOWN_HEADERS];  // field index, -1 if absent
+
+  /*********************************
+   * Name:    getField
+   * Purpose: finds the storage of the field with the given index
+   * Receive: index - the field's index, below numFields
+   * Return:  the field
+   *********************************/
+  HeaderField& getField(unsigned index) {
+    return (index < INLINE_FIELDS) ? inlineFields[index] :
+                                     extraFields[index - INLINE_FIELDS];
+  }
+  const HeaderField& getField(unsigned index) const {
+    return (index < INLINE_FIELDS) ? inlineFields[index] :
+                                     extraFields[index - INLINE_FIELDS];
+  }
+
+  /*********************************
+   * Name:    findField
+   * Purpose: searches the fields for a name, ignoring case
+   * Receive: name, length - the name
+   *          hash - hashName of the name
+   * Return:  the field's index, or -1 if there is none
+   *********************************/
+  int findField(const char* name, unsigned length, unsigned hash) const;
 };
 
 #endif  // _HTTP_MESSAGE_H_
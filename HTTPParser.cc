@@ -0,0 +1,165 @@
+#include "HTTPParser.h"
+#include "ByteScanner.h"
+
+namespace {
+  const char HTTP_PREFIX[] = "HTTP/";
+  const unsigned HTTP_PREFIX_LENGTH = sizeof(HTTP_PREFIX) - 1;
+
+  bool isBlank(char c) {
+    return (c == ' ') || (c == '\t');
+  }
+}
+
+HTTPParser::HTTPParser() {
+  reset();
+}
+
+void HTTPParser::reset() {
+  data = NULL;
+  status = INCOMPLETE;
+  scanned = 0;
+  startLineDone = false;
+  response = false;
+  version.start = version.length = 0;
+  reason.start = reason.length = 0;
+  method.start = method.length = 0;
+  target.start = target.length = 0;
+  statusCode = 0;
+  numHeaders = 0;
+  headerLength = 0;
+}
+
+HTTPParser::Status HTTPParser::parse(const char* data, unsigned length) {
+  this->data = data;
+  if (status != INCOMPLETE) {
+    return status;
+  }
+
+  const char* end = data + length;
+  while (scanned < length) {
+    const char* newline = ByteScanner::find(data + scanned, end, '\n');
+    if (newline == NULL) {
+      break;  // wait for the rest of the line
+    }
+
+    // Lines end in \r\n; tolerate a bare \n as well.
+    unsigned lineStart = scanned;
+    unsigned lineEnd = newline - data;
+    scanned = lineEnd + 1;
+    if ((lineEnd > lineStart) && (data[lineEnd - 1] == '\r')) {
+      lineEnd--;
+    }
+
+    if (!startLineDone) {
+      if (!parseStartLine(lineStart, lineEnd)) {
+        status = INVALID;
+        break;
+      }
+      startLineDone = true;
+    } else if (lineEnd == lineStart) {  // the blank line ending the header
+      headerLength = scanned;
+      status = COMPLETE;
+      break;
+    } else if (!parseHeaderLine(lineStart, lineEnd)) {
+      status = INVALID;
+      break;
+    }
+  }
+
+  return status;
+}
+
+StringSpan HTTPParser::findHeader(const char* name) const {
+  unsigned nameLength = strlen(name);
+  for (unsigned i = 0; i < numHeaders; i++) {
+    if (makeSpan(names[i]).equalsIgnoreCase(name, nameLength)) {
+      return makeSpan(values[i]);
+    }
+  }
+  return StringSpan();
+}
+
+bool HTTPParser::parseStartLine(unsigned start, unsigned end) {
+  const char* line = data + start;
+  const char* lineEnd = data + end;
+
+  const char* firstSpace = ByteScanner::find(line, lineEnd, ' ');
+  if ((firstSpace == NULL) || (firstSpace == line)) {
+    return false;
+  }
+  unsigned firstLength = firstSpace - line;
+
+  if ((firstLength > HTTP_PREFIX_LENGTH) &&
+      (memcmp(line, HTTP_PREFIX, HTTP_PREFIX_LENGTH) == 0)) {
+    // HTTP/1.1 200 OK -- the reason may be empty, or missing with its space
+    response = true;
+    version.start = start;
+    version.length = firstLength;
+
+    const char* code = firstSpace + 1;
+    if ((lineEnd - code < 3) || ((lineEnd - code > 3) && (code[3] != ' '))) {
+      return false;
+    }
+    statusCode = 0;
+    for (int i = 0; i < 3; i++) {
+      if ((code[i] < '0') || (code[i] > '9')) {
+        return false;
+      }
+      statusCode = statusCode * 10 + (code[i] - '0');
+    }
+    if ((statusCode < 100) || (statusCode >= 600)) {
+      return false;
+    }
+
+    const char* reasonStart = (lineEnd - code > 3) ? code + 4 : lineEnd;
+    reason.start = reasonStart - data;
+    reason.length = lineEnd - reasonStart;
+    return true;
+  }
+
+  // GET /path HTTP/1.1
+  const char* secondSpace = ByteScanner::find(firstSpace + 1, lineEnd, ' ');
+  if ((secondSpace == NULL) || (secondSpace == firstSpace + 1) ||
+      (lineEnd - secondSpace - 1 <= static_cast<int>(HTTP_PREFIX_LENGTH)) ||
+      (memcmp(secondSpace + 1, HTTP_PREFIX, HTTP_PREFIX_LENGTH) != 0)) {
+    return false;
+  }
+  response = false;
+  method.start = start;
+  method.length = firstLength;
+  target.start = firstSpace + 1 - data;
+  target.length = secondSpace - firstSpace - 1;
+  version.start = secondSpace + 1 - data;
+  version.length = lineEnd - secondSpace - 1;
+  return true;
+}
+
+bool HTTPParser::parseHeaderLine(unsigned start, unsigned end) {
+  if (numHeaders == MAX_HEADERS) {
+    return false;
+  }
+
+  const char* line = data + start;
+  const char* lineEnd = data + end;
+  const char* colon = ByteScanner::find(line, lineEnd, ':');
+  // No name, or a continuation line (obsolete folding): not supported.
+  if ((colon == NULL) || (colon == line) || isBlank(*line)) {
+    return false;
+  }
+
+  const char* valueStart = colon + 1;
+  const char* valueEnd = lineEnd;
+  while ((valueStart < valueEnd) && isBlank(*valueStart)) {
+    valueStart++;
+  }
+  while ((valueEnd > valueStart) && isBlank(*(valueEnd - 1))) {
+    valueEnd--;
+  }
+
+  names[numHeaders].start = start;
+  names[numHeaders].length = colon - line;
+  values[numHeaders].start = valueStart - data;
+  values[numHeaders].length = valueEnd - valueStart;
+  numHeaders++;
+  return true;
+}
@@ -0,0 +1,236 @@
+/*********************************
+ * HTTPParser - Incremental parser for the header of an HTTP message. It is
+ * fed the received bytes as they arrive, as often as needed, and picks up
+ * where the previous call stopped, so a header split over any number of
+ * reads is only looked at once.
+ *
+ * Nothing is copied and nothing is allocated: the start line and the
+ * header fields are remembered as offsets into the caller's buffer and
+ * handed out as StringSpan views of it. The buffer may be moved between
+ * calls (TCPSocket compacts its receive buffer), as long as its contents
+ * are kept; views are relative to the data passed to the latest parse().
+ *
+ * Both responses ("HTTP/1.1 200 OK") and requests ("GET / HTTP/1.1") are
+ * understood; isResponse() tells which one was seen.
+ *********************************/
+
+#ifndef _HTTP_PARSER_H_
+#define _HTTP_PARSER_H_
+
+#include "StringSpan.h"
+
+class HTTPParser {
+ public:
+  enum Status {
+    INCOMPLETE,  // more data is needed
+    COMPLETE,    // the whole header, up to the blank line, has been parsed
+    INVALID      // the data is not an HTTP header
+  };
+
+  // The most header fields a message may have.
+  static const unsigned MAX_HEADERS = 64;
+
+  /*********************************
+   * Name:    HTTPParser
+   * Purpose: Constructor, ready to parse a new message
+   * Receive: None
+   * Return:  None
+   *********************************/
+  HTTPParser();
+
+  /*********************************
+   * Name:    reset
+   * Purpose: Forgets the current message, to parse another one
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void reset();
+
+  /*********************************
+   * Name:    parse
+   * Purpose: Continues parsing. Only complete lines not seen by an earlier
+   *          call are looked at.
+   * Receive: data - the message so far, from its first byte. May be at a
+   *                 different address than in the previous call, but the
+   *                 bytes given before must be unchanged.
+   *          length - the number of bytes available, at least as many as
+   *                   in the previous call
+   * Return:  the status after this call; once COMPLETE or INVALID, further
+   *          calls return the same thing
+   *********************************/
+  Status parse(const char* data, unsigned length);
+
+  /*********************************
+   * Name:    getStatus
+   * Purpose: Looks up the result of the latest parse()
+   * Receive: None
+   * Return:  the status
+   *********************************/
+  Status getStatus() const {
+    return status;
+  }
+
+  /*********************************
+   * Name:    getHeaderLength
+   * Purpose: Looks up the length of the complete header, including the
+   *          blank line ending it, which is where the body starts
+   * Receive: None
+   * Return:  the length in bytes, 0 unless the status is COMPLETE
+   *********************************/
+  unsigned getHeaderLength() const {
+    return headerLength;
+  }
+
+  /*********************************
+   * Name:    isResponse
+   * Purpose: Tells whether the start line was a status line
+   * Receive: None
+   * Return:  true for a response, false for a request
+   *********************************/
+  bool isResponse() const {
+    return response;
+  }
+
+  /*********************************
+   * Name:    getVersion
+   * Purpose: Looks up the HTTP version, e.g. "HTTP/1.1"
+   * Receive: None
+   * Return:  a view of the version
+   *********************************/
+  StringSpan getVersion() const {
+    return makeSpan(version);
+  }
+
+  /*********************************
+   * Name:    getStatusCode
+   * Purpose: Looks up the status code of a response
+   * Receive: None
+   * Return:  the status code, 0 for a request
+   *********************************/
+  unsigned getStatusCode() const {
+    return statusCode;
+  }
+
+  /*********************************
+   * Name:    getReason
+   * Purpose: Looks up the reason phrase of a response, e.g. "Not Found"
+   * Receive: None
+   * Return:  a view of the reason, empty if the server sent none
+   *********************************/
+  StringSpan getReason() const {
+    return makeSpan(reason);
+  }
+
+  /*********************************
+   * Name:    getMethod
+   * Purpose: Looks up the method of a request, e.g. "GET"
+   * Receive: None
+   * Return:  a view of the method, empty for a response
+   *********************************/
+  StringSpan getMethod() const {
+    return makeSpan(method);
+  }
+
+  /*********************************
+   * Name:    getTarget
+   * Purpose: Looks up the target of a request, e.g. "/index.m3u8"
+   * Receive: None
+   * Return:  a view of the target, empty for a response
+   *********************************/
+  StringSpan getTarget() const {
+    return makeSpan(target);
+  }
+
+  /*********************************
+   * Name:    getNumHeaders
+   * Purpose: Counts the header fields parsed so far
+   * Receive: None
+   * Return:  the number of fields
+   *********************************/
+  unsigned getNumHeaders() const {
+    return numHeaders;
+  }
+
+  /*********************************
+   * Name:    getHeaderName
+   * Purpose: Looks up the name of a header field
+   * Receive: index - the field's position, below getNumHeaders()
+   * Return:  a view of the name
+   *********************************/
+  StringSpan getHeaderName(unsigned index) const {
+    return makeSpan(names[index]);
+  }
+
+  /*********************************
+   * Name:    getHeaderValue
+   * Purpose: Looks up the value of a header field, without the spaces
+   *          around it
+   * Receive: index - the field's position, below getNumHeaders()
+   * Return:  a view of the value
+   *********************************/
+  StringSpan getHeaderValue(unsigned index) const {
+    return makeSpan(values[index]);
+  }
+
+  /*********************************
+   * Name:    findHeader
+   * Purpose: Looks up the value of the first header field with a name,
+   *          ignoring case
+   * Receive: name - the NUL-terminated name
+   * Return:  a view of the value; its data is NULL if there is no such
+   *          field
+   *********************************/
+  StringSpan findHeader(const char* name) const;
+
+ private:
+  // A piece of the message, as an offset from its first byte.
+  struct Range {
+    unsigned start;
+    unsigned length;
+  };
+
+  const char* data;  // as given to the latest parse()
+  Status status;
+  unsigned scanned;  // offset of the first line not parsed yet
+  bool startLineDone;
+  bool response;
+
+  Range version;
+  Range reason;
+  Range method;
+  Range target;
+  unsigned statusCode;
+
+  Range names[MAX_HEADERS];
+  Range values[MAX_HEADERS];
+  unsigned numHeaders;
+  unsigned headerLength;
+
+  /*********************************
+   * Name:    parseStartLine
+   * Purpose: Splits the first line into its parts
+   * Receive: start, end - the line's offsets, without the line ending
+   * Return:  true if the line is a status line or a request line
+   *********************************/
+  bool parseStartLine(unsigned start, unsigned end);
+
+  /*********************************
+   * Name:    parseHeaderLine
+   * Purpose: Splits a header line into name and value
+   * Receive: start, end - the line's offsets, without the line ending
+   * Return:  true if the line is a valid header field
+   *********************************/
+  bool parseHeaderLine(unsigned start, unsigned end);
+
+  /*********************************
+   * Name:    makeSpan
+   * Purpose: Turns a range into a view of the latest data
+   * Receive: range - the range
+   * Return:  the view
+   *********************************/
+  StringSpan makeSpan(const Range& range) const {
+    return StringSpan(data + range.start, range.length);
+  }
+};
+
+#endif  // _HTTP_PARSER_H_
@@ -1,4 +1,7 @@
 #include "HTTPRequest.h"
+#include <cctype>
+#include <climits>
+#include <sstream>
 
 using namespace std;
 
@@ -13,28 +16,11 @@ HTTPRequest::~HTTPRequest() {
 }
 
 HTTPRequest *HTTPRequest::receive(TCPSocket& sock) {
-  HTTPRequest *request;
-  std::string incomingRequestString;
-  std::string aLine;
-  int zeroCount = 0;  // number of attempt to read from socket
-
-  sock.readLine(aLine);  // get a line from the TCPSocket
-
-  while (aLine != "\r\n") {
-    incomingRequestString += aLine;
-    aLine.clear();  // clear the variable before using it again
-    if (sock.readLine(aLine) == 0) {  // failed to get data from the TCPSocket
-      zeroCount++;
-      if (zeroCount >= 1000) {
-        break;
-      }
-    }
-  }
-  incomingRequestString.append("\r\n");
-
-  request = HTTPRequest::parse(incomingRequestString.c_str(),
-                               incomingRequestString.size());
-  return request;
+  // Parse the header where it was received instead of collecting it line
+  // by line, so a request costs one pass over its bytes.
+  HTTPParser parser;
+  sock.readHeader(parser);
+  return HTTPRequest::parse(parser);
 }
 
 HTTPRequest* HTTPRequest::parse(const char* data, unsigned length) {
@@ -119,6 +105,43 @@ HTTPRequest* HTTPRequest::parse(const std::string& requestString) {
   return HTTPRequest::parse(requestString.c_str(), requestString.size());
 }
 
+HTTPRequest* HTTPRequest::parse(const HTTPParser& parser) {
+  if ((parser.getStatus() != HTTPParser::COMPLETE) || parser.isResponse()) {
+    return NULL;
+  }
+
+  // The parser has checked the request line already.
+  StringSpan method = parser.getMethod();
+  StringSpan target = parser.getTarget();
+  StringSpan version = parser.getVersion();
+
+  HTTPRequest* request = new HTTPRequest();
+  request->method.assign(method.data, method.length);
+  request->version.assign(version.data, version.length);
+  request->setHeaderFields(parser);
+
+  // A request sent to a proxy names the whole URL; keep only the path,
+  // e.g. http://www.cse.msu.edu/~cse422 becomes /~cse422.
+  const char scheme[] = "http://";
+  const unsigned schemeLength = sizeof(scheme) - 1;
+  const char* path = target.data;
+  const char* end = target.data + target.length;
+  if ((target.length > schemeLength) &&
+      (strncasecmp(path, scheme, schemeLength) == 0)) {
+    path += schemeLength;
+    while ((path < end) && (*path != '/')) {
+      path++;
+    }
+    if (path == end) {
+      request->path = "/";
+      return request;
+    }
+  }
+  request->path.assign(path, end - path);
+
+  return request;
+}
+
 HTTPRequest* HTTPRequest::createGetRequest(const std::string& path,
     const std::string& version) {
   HTTPRequest* request = new HTTPRequest("GET", path, version);
@@ -142,9 +165,94 @@ const std::string HTTPRequest::getUrl() const {
 }
 
 void HTTPRequest::getHost(std::string& outHost) const {
-  if (!getHeaderValue("Host", outHost)) {
-    outHost = "";
+  outHost = findHeaderValue(HOST).str();
+}
+
+bool HTTPRequest::isKeepAlive() const {
+  StringSpan connection = findHeaderValue(CONNECTION);
+  bool found = (connection.data != NULL);
+
+  // Header values are case-insensitive tokens.
+  if (version == "HTTP/1.0") {
+    return found && connection.containsIgnoreCase("keep-alive");
   }
+  return !found || !connection.containsIgnoreCase("close");
+}
+
+namespace {
+  /*********************************
+   * Name:    parseNumber
+   * Purpose: reads a decimal number from a header value
+   * Receive: next - the first digit; moved past the last one
+   *          end - the end of the value
+   *          number - set to the number
+   * Return:  true if there was at least one digit and the number fits
+   *********************************/
+  bool parseNumber(const char*& next, const char* end,
+                   unsigned long long& number) {
+    const char* start = next;
+    number = 0;
+    while ((next < end) && isdigit(static_cast<unsigned char>(*next))) {
+      if (number > (ULLONG_MAX - 9) / 10) {
+        return false;
+      }
+      number = number * 10 + (*next - '0');
+      next++;
+    }
+    return next > start;
+  }
+}
+
+HTTPRequest::RangeStatus HTTPRequest::getRange(
+    unsigned long long objectLength, unsigned long long& first,
+    unsigned long long& last) const {
+  StringSpan range = findHeaderValue("Range");
+  const char prefix[] = "bytes=";
+  const unsigned prefixLength = sizeof(prefix) - 1;
+  if ((range.length <= prefixLength) ||
+      (strncasecmp(range.data, prefix, prefixLength) != 0)) {
+    return WHOLE_OBJECT;
+  }
+
+  // Parse into locals: first and last are only the caller's to change
+  // once the range is known to be PARTIAL.
+  const char* next = range.data + prefixLength;
+  const char* end = range.data + range.length;
+  unsigned long long from;
+  unsigned long long to;
+  if (*next == '-') {
+    // bytes=-count, the last count bytes
+    unsigned long long count;
+    next++;
+    if (!parseNumber(next, end, count) || (next != end)) {
+      return WHOLE_OBJECT;
+    }
+    if ((count == 0) || (objectLength == 0)) {
+      return UNSATISFIABLE;
+    }
+    from = (count < objectLength) ? objectLength - count : 0;
+    to = objectLength - 1;
+  } else {
+    // bytes=first- or bytes=first-last
+    if (!parseNumber(next, end, from) || (next == end) || (*next++ != '-')) {
+      return WHOLE_OBJECT;
+    }
+    if (next == end) {
+      to = ULLONG_MAX;
+    } else if (!parseNumber(next, end, to) || (next != end) || (to < from)) {
+      return WHOLE_OBJECT;
+    }
+    if (from >= objectLength) {
+      return UNSATISFIABLE;
+    }
+    if (to >= objectLength) {
+      to = objectLength - 1;
+    }
+  }
+
+  first = from;
+  last = to;
+  return PARTIAL;
 }
 
 void HTTPRequest::print(std::string& outputString) const {
@@ -174,3 +282,15 @@ void HTTPRequest::print(char* outputBuffer, unsigned bufferLength) const {
 
   HTTPMessage::print(outputBuffer, bufferLength);
 }
+
+void HTTPRequest::setRange(unsigned int first) {
+  std::ostringstream range;
+  range << "bytes=" << first << "-";
+  setHeaderField("Range", range.str());
+}
+
+void HTTPRequest::setRange(unsigned int first, unsigned int last) {
+  std::ostringstream range;
+  range << "bytes=" << first << "-" << last;
+  setHeaderField("Range", range.str());
+}
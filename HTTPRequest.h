@@ -25,6 +25,13 @@
 
 class HTTPRequest : public HTTPMessage {
  public:
+  // What a Range header asks for, see getRange.
+  enum RangeStatus {
+    WHOLE_OBJECT,   // no Range header, or one that is not understood
+    PARTIAL,        // one range of bytes that the object has
+    UNSATISFIABLE   // a range that starts past the end of the object
+  };
+
   /*********************************
    * Name:    HTTPRequest
    * Purpose: constructor, constructs a new HTTPRequest. Note that 
@@ -76,6 +83,18 @@ class HTTPRequest : public HTTPMessage {
    *********************************/
   static HTTPRequest* parse(const std::string& requestString);
 
+  /*********************************
+   * Name:    parse
+   * Purpose: constructs an HTTPRequest object from a header that has
+   *          already been parsed, e.g. by TCPSocket::readHeader, without
+   *          parsing it again.
+   * Receive: parser - the parser holding the header
+   * Return:  An HTTPRequest for the header. If the parser does not hold
+   *          a complete request header, a NULL pointer will be returned
+   *          instead.
+   *********************************/
+  static HTTPRequest* parse(const HTTPParser& parser);
+
   /*********************************
    * Name:    createGetRequest
    * Purpose: Constructs a new HTTP GET request, with a header or 
@@ -104,7 +123,9 @@ class HTTPRequest : public HTTPMessage {
    * Return:  receive a piece of data from the socket, until a line 
    *          with only CLRF is found, which means it is the end of 
    *          the header. Create an HTTPRequest object from that 
-   *          header.
+   *          header, or return NULL if it is not a request. Throws a
+   *          std::string if the connection closes, times out or sends
+   *          a malformed header.
    *********************************/
   static HTTPRequest* receive(TCPSocket& socket);
 
@@ -157,6 +178,34 @@ class HTTPRequest : public HTTPMessage {
    *********************************/
   void getHost(std::string& outHost) const;
 
+  /*********************************
+   * Name:    isKeepAlive
+   * Purpose: Checks if the client wants the connection kept open after
+   *          this request, from the version and the Connection header.
+   *          HTTP/1.1 connections persist unless the client says
+   *          "close"; HTTP/1.0 ones only if it says "keep-alive".
+   * Receive: None
+   * Return:  true if the connection can carry another request
+   *********************************/
+  bool isKeepAlive() const;
+
+  /*********************************
+   * Name:    getRange
+   * Purpose: Works out which part of an object a "Range: bytes=..."
+   *          header asks for: "first-", "first-last" or the suffix
+   *          "-count". A list of several ranges is not supported and is
+   *          treated like no Range header at all, which the HTTP
+   *          specification allows.
+   * Receive: objectLength - the length of the whole object
+   *          first - set to the offset of the first byte wanted
+   *          last - set to the offset of the last byte wanted, inclusive
+   * Return:  PARTIAL with first and last set, WHOLE_OBJECT, or
+   *          UNSATISFIABLE; first and last are left alone unless PARTIAL
+   *********************************/
+  RangeStatus getRange(unsigned long long objectLength,
+                       unsigned long long& first,
+                       unsigned long long& last) const;
+
   /*********************************
    * Name:    print
    * Purpose: Prints the request object to a text string, suitable 
@@ -223,6 +272,36 @@ class HTTPRequest : public HTTPMessage {
     setHeaderField("Host", host);
   }
 
+  /*********************************
+   * Name:    setKeepAlive
+   * Purpose: Sets the Connection header to ask the server to keep the
+   *          connection open for further requests, or to close it.
+   * Receive: keepAlive - true for a persistent connection
+   * Return:  None
+   *********************************/
+  void setKeepAlive(bool keepAlive) {
+    setHeaderField("Connection", keepAlive ? "keep-alive" : "close");
+  }
+
+  /*********************************
+   * Name:    setRange
+   * Purpose: Asks for the object from a byte offset to its end, with a
+   *          "Range: bytes=first-" header, e.g. to resume a download
+   * Receive: first - the offset of the first byte wanted
+   * Return:  None
+   *********************************/
+  void setRange(unsigned int first);
+
+  /*********************************
+   * Name:    setRange
+   * Purpose: Asks for part of the object, with a "Range: bytes=first-last"
+   *          header
+   * Receive: first - the offset of the first byte wanted
+   *          last - the offset of the last byte wanted, inclusive
+   * Return:  None
+   *********************************/
+  void setRange(unsigned int first, unsigned int last);
+
  private:
   std::string method;
   std::string path;
@@ -0,0 +1,148 @@
+// Tests for HTTPRequest::getRange: every Range header is parsed out of a
+// received request the way originServer sees it, and the result and the
+// first/last offsets are checked. Headers that are malformed or list
+// several ranges must come back as WHOLE_OBJECT with first and last left
+// as the caller set them. Build and run with "make check".
+
+#include "HTTPRequest.h"
+#include <cstdio>
+#include <string>
+
+namespace {
+  // The length of the object the ranges in CASES are applied to.
+  const unsigned long long OBJECT_LENGTH = 1000;
+
+  // The length of the object for LARGE_CASES: 6 GiB, past what 32 bits hold.
+  const unsigned long long LARGE_OBJECT_LENGTH = 6442450944ULL;
+
+  // What first and last hold before getRange is called, so a range that is
+  // not PARTIAL can be seen to leave them alone.
+  const unsigned long long UNTOUCHED = 12345;
+
+  struct RangeCase {
+    const char* range;    // the Range header value, NULL for none
+    HTTPRequest::RangeStatus status;
+    unsigned long long first;   // expected if PARTIAL, else UNTOUCHED
+    unsigned long long last;
+  };
+
+  const RangeCase CASES[] = {
+    // no header, or not a byte range
+    {NULL, HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"items=0-99", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+
+    // one range the object has
+    {"bytes=0-99", HTTPRequest::PARTIAL, 0, 99},
+    {"Bytes=10-10", HTTPRequest::PARTIAL, 10, 10},
+    {"bytes=100-", HTTPRequest::PARTIAL, 100, 999},
+    {"bytes=500-5000", HTTPRequest::PARTIAL, 500, 999},
+    {"bytes=-100", HTTPRequest::PARTIAL, 900, 999},
+    {"bytes=-5000", HTTPRequest::PARTIAL, 0, 999},
+    {"bytes=0-99999999999", HTTPRequest::PARTIAL, 0, 999},
+
+    // ranges past the end of the object
+    {"bytes=1000-", HTTPRequest::UNSATISFIABLE, UNTOUCHED, UNTOUCHED},
+    {"bytes=1000-2000", HTTPRequest::UNSATISFIABLE, UNTOUCHED, UNTOUCHED},
+    {"bytes=-0", HTTPRequest::UNSATISFIABLE, UNTOUCHED, UNTOUCHED},
+    {"bytes=99999999999-", HTTPRequest::UNSATISFIABLE, UNTOUCHED, UNTOUCHED},
+
+    // malformed
+    {"bytes=5-3", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=5-x", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=x-5", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=5", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=-", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=--5", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=-5x", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=99999999999999999999-", HTTPRequest::WHOLE_OBJECT, UNTOUCHED,
+     UNTOUCHED},
+    {"bytes=0-99999999999999999999", HTTPRequest::WHOLE_OBJECT, UNTOUCHED,
+     UNTOUCHED},
+    {"bytes=-99999999999999999999", HTTPRequest::WHOLE_OBJECT, UNTOUCHED,
+     UNTOUCHED},
+
+    // several ranges
+    {"bytes=0-1,5-6", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=0-1, 5-6", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=0-,5-6", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=-5,0-1", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=5-3,0-1", HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+  };
+
+  const RangeCase LARGE_CASES[] = {
+    {NULL, HTTPRequest::WHOLE_OBJECT, UNTOUCHED, UNTOUCHED},
+    {"bytes=0-", HTTPRequest::PARTIAL, 0, 6442450943ULL},
+    {"bytes=5000000000-", HTTPRequest::PARTIAL, 5000000000ULL,
+     6442450943ULL},
+    {"bytes=4294967296-4294967305", HTTPRequest::PARTIAL, 4294967296ULL,
+     4294967305ULL},
+    {"bytes=-1000", HTTPRequest::PARTIAL, 6442449944ULL, 6442450943ULL},
+    {"bytes=6442450944-", HTTPRequest::UNSATISFIABLE, UNTOUCHED, UNTOUCHED},
+  };
+
+  const char* statusName(HTTPRequest::RangeStatus status) {
+    switch (status) {
+      case HTTPRequest::WHOLE_OBJECT:
+        return "WHOLE_OBJECT";
+      case HTTPRequest::PARTIAL:
+        return "PARTIAL";
+      case HTTPRequest::UNSATISFIABLE:
+        return "UNSATISFIABLE";
+    }
+    return "?";
+  }
+
+  // Runs one case against an object of objectLength bytes; returns true if
+  // it passed.
+  bool runCase(const RangeCase& test, unsigned long long objectLength) {
+    std::string text = "GET /seg0.ts HTTP/1.1\r\nHost: localhost\r\n";
+    if (test.range != NULL) {
+      text += "Range: ";
+      text += test.range;
+      text += "\r\n";
+    }
+    text += "\r\n";
+
+    const char* name = (test.range != NULL) ? test.range : "(no Range)";
+    HTTPRequest* request = HTTPRequest::parse(text);
+    if (request == NULL) {
+      printf("FAIL %s: the request did not parse\n", name);
+      return false;
+    }
+
+    unsigned long long first = UNTOUCHED;
+    unsigned long long last = UNTOUCHED;
+    HTTPRequest::RangeStatus status = request->getRange(objectLength, first,
+                                                        last);
+    delete request;
+
+    if ((status != test.status) || (first != test.first) ||
+        (last != test.last)) {
+      printf("FAIL %s: got %s %llu-%llu, expected %s %llu-%llu\n", name,
+             statusName(status), first, last, statusName(test.status),
+             test.first, test.last);
+      return false;
+    }
+    return true;
+  }
+}
+
+int main() {
+  const unsigned int numCases = sizeof(CASES) / sizeof(CASES[0]);
+  const unsigned int numLarge = sizeof(LARGE_CASES) / sizeof(LARGE_CASES[0]);
+  const unsigned int count = numCases + numLarge;
+  unsigned int failed = 0;
+  for (unsigned int i = 0; i < numCases; i++) {
+    if (!runCase(CASES[i], OBJECT_LENGTH)) {
+      failed++;
+    }
+  }
+  for (unsigned int i = 0; i < numLarge; i++) {
+    if (!runCase(LARGE_CASES[i], LARGE_OBJECT_LENGTH)) {
+      failed++;
+    }
+  }
+  printf("getRange: %u of %u cases passed\n", count - failed, count);
+  return (failed == 0) ? 0 : 1;
+}
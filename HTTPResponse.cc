@@ -1,4 +1,37 @@
 #include "HTTPResponse.h"
+#include <cctype>
+#include <climits>
+#include <cstdio>
+
+pthread_mutex_t HTTPResponse::dateLock = PTHREAD_MUTEX_INITIALIZER;
+time_t HTTPResponse::dateSecond = 0;
+char HTTPResponse::dateString[HTTPResponse::DATE_LENGTH + 1];
+
+namespace {
+  // Long enough for any unsigned long long in decimal.
+  const unsigned MAX_DIGITS = 20;
+
+  /*********************************
+   * Name:    formatNumber
+   * Purpose: writes a number in decimal, without going through a stream
+   * Receive: number - the number
+   *          buffer - room for MAX_DIGITS characters
+   * Return:  the number of characters written; no NUL is added
+   *********************************/
+  unsigned formatNumber(unsigned long long number, char* buffer) {
+    char digits[MAX_DIGITS];
+    unsigned count = 0;
+    do {
+      digits[count++] = '0' + (number % 10);
+      number /= 10;
+    } while (number > 0);
+
+    for (unsigned i = 0; i < count; i++) {
+      buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+  }
+}
 
 HTTPResponse::HTTPResponse(unsigned statusCode, const std::string& statusDesc,
     const std::string& version, const std::string& content) {
@@ -10,7 +43,19 @@ HTTPResponse::HTTPResponse(unsigned statusCode, const std::string& statusDesc,
   setHeaderField("Content-Type", "text/html");
   setHeaderField("Server", "MSU/CSE422/SS17-Section001");
   setHeaderField("Connection", "close");  // non-persistent
-  setHeaderField("Date", buildTime().c_str());
+  setDate();
+}
+
+// The parser has checked the response line already. None of the defaults
+// the public constructor sets are wanted here: the header fields and Date
+// are the ones the server sent.
+HTTPResponse::HTTPResponse(const HTTPParser& parser)
+    : statusCode(parser.getStatusCode()), chunked(false) {
+  StringSpan version = parser.getVersion();
+  StringSpan reason = parser.getReason();
+  this->version.assign(version.data, version.length);
+  statusDesc.assign(reason.data, reason.length);
+  setHeaderFields(parser);
 }
 
 HTTPResponse::~HTTPResponse() {
@@ -21,142 +66,66 @@ HTTPResponse::~HTTPResponse() {
 
 // NOTE:
 // People parse the response differently. The way they slice the header
-// varies as well. In this implementation The header MUST END WITH \r\n\r\n.
+// varies as well. In this implementation the header must end with a blank
+// line; HTTPParser does the slicing.
 //
-// Examines the HTTP response header in the buffer: data. Make sure the
-// header is good.
+// If the response is not correctly formatted, or not complete, return a
+// NULL pointer.
+HTTPResponse *HTTPResponse::parse(const char* data, unsigned length) {
+  HTTPParser parser;
+  parser.parse(data, length);
+  return parse(parser);
+}
+
+// Builds the response straight from the parser's views of the received
+// header, copying each piece only once into the object.
 //
 // If the request succeeded, the "Content-Length" indicates the length
 // of the response body. According to that value, we know how many
 // bytes we need to recevie.
-//
-// If the request failed, or if the response is not correctly formatted
-// return a NULL pointer and release all resource.
-HTTPResponse *HTTPResponse::parse(const char* data, unsigned length) {
-  HTTPResponse *response = new HTTPResponse();
-
-  // Separate the opening line (for the response) from the rest.
-  // find the starting position of the first header (which is the second line)
-  const char* firstHeader = response->findNextLine(data, length);
-
-  if (firstHeader == NULL) {
-    // Not even a complete first line...
-    delete response;
-    return NULL;
-  }
-  size_t firstLineLen = static_cast<size_t>(firstHeader - data);
-  std::string responseLine(data, firstLineLen - 2);
-
-  // parse the pieces of the response.
-  size_t statusCodePos = responseLine.find(" ");
-  size_t statusDescPos = std::string::npos;
-  if (statusCodePos != std::string::npos) {
-    response->setVersion(responseLine.substr(0, statusCodePos));
-    statusDescPos = responseLine.find(" ", statusCodePos + 1);
-  }
-
-  if (statusDescPos != std::string::npos) {
-    std::string statusCodeStr =
-        responseLine.substr(statusCodePos + 1,
-            statusDescPos - statusCodePos - 1);
-    response->setStatusCode(statusCodeStr);  // statusCode is updated in it
-
-    if ((response->statusCode < 100) || (response->statusCode >= 600)) {
-      // bad status code
-      delete response;
-      return NULL;
-    }
-
-    response->setStatusDesc(responseLine.substr(statusDescPos + 1));
-  } else {  // Missing fields = bad response.
-    delete response;
+HTTPResponse *HTTPResponse::parse(const HTTPParser& parser) {
+  if ((parser.getStatus() != HTTPParser::COMPLETE) || !parser.isResponse()) {
     return NULL;
   }
 
-  // Have the header lines parsed now; response line is okay.
-  // Handled in HTTPMessage.cc
-  bool headersOkay = response->parseFields(firstHeader, length - firstLineLen);
+  HTTPResponse *response = new HTTPResponse(parser);
 
-  std::string transferEncoding;
-  response->getHeaderValue("Transfer-Encoding", transferEncoding);
+  StringSpan transferEncoding =
+      response->findHeaderValue(TRANSFER_ENCODING);
 
-  if (transferEncoding.find("chunked") != std::string::npos) {
+  if (transferEncoding.containsIgnoreCase("chunked")) {
     // chunked transfer encoding
     response->chunked = true;
   } else {  // default transfer encoding
     response->chunked = false;
   }
 
-  if (headersOkay) {
-    return response;
-  } else {
-    delete response;
-    return NULL;
-  }
+  return response;
 }
 
 HTTPResponse* HTTPResponse::createStandardResponse(
-    unsigned contentLen, unsigned statusCode, const std::string& statusDesc,
-    const std::string& version) {
+    unsigned long long contentLen, unsigned statusCode,
+    const std::string& statusDesc,
+    const std::string& version, bool keepAlive) {
   HTTPResponse* response = new HTTPResponse(statusCode, statusDesc, version);
 
   // Assume we're not bothering with chunked/gzipped data.
   response->setHeaderField("Content-Encoding", "identity");
   response->setHeaderField("Transfer-Encoding", "identity");
 
-  // Also assume that we don't want to have to keep track of connections and
-  // we use only non-persistent connection
-  response->setHeaderField("Connection", "close");
+  // Unless the caller is keeping track of connections, use only
+  // non-persistent connections.
+  response->setKeepAlive(keepAlive);
 
-  // HTTP requires responses to include the data of construction.
-  // Therefore, let's set that.
-  char timeBuffer[128];
-  time_t responseTime = time(NULL);
-  strftime(timeBuffer, sizeof(timeBuffer) / sizeof(char),
-    "%a, %d %b %Y %H:%M:%S %Z", gmtime(&responseTime));
-  response->setHeaderField("Date", timeBuffer);
+  // HTTP requires responses to include the data of construction; the
+  // constructor has set that already.
 
   // Finally, we know how long the body's going to be, so set that, too.
-  std::ostringstream lengthStr;
-  lengthStr << contentLen;
-  response->setHeaderField("Content-Length", lengthStr.str());
+  response->setContentLength(contentLen);
 
   return response;
 }
 
-// For the client, it needs to remove the chunkLen from the data std::string
-// because the client is storing the data as a file. The chunk length
-// is no longer needed anymore. However, for proxies, they need to keep the
-// chunk length, so that the forwarded response body can be decoded/received
-// by the clients.
-int HTTPResponse::getChunkSize(std::string &data) {
-  int chunkLen;      // The value we want to obtain
-  int chunkLenStrEnd;  // The var to hold the end of chunk length std::string
-  std::stringstream ss;   // For hex to in conversion
-
-  chunkLenStrEnd = data.find("\r\n");  // Find the first CLRF
-  std::string chunkLenStr;
-  if (chunkLenStrEnd != std::string::npos) {
-    chunkLenStr = data.substr(0, chunkLenStrEnd);
-  } else {
-    return chunkLenStrEnd;
-  }
-  // take the chunk length std::string out
-
-  // convert the chunk length std::string hex to int
-  ss << std::hex << chunkLenStr;
-  ss >> chunkLen;
-
-  // reorganize the data
-  // remove the chunk length std::string and the CLRF
-  data = data.substr(chunkLenStrEnd + 2, data.length() - chunkLenStrEnd - 2);
-
-  // cout << "chunkLenStr: " << chunkLenStr << std::endl;
-  // cout << "chunkLen:   " << chunkLen << std::endl;
-
-  return chunkLen;
-}
-
 void HTTPResponse::receiveHeader(TCPSocket& sock, std::string& responseHeader,
     std::string& responseBody) {
   try {
@@ -176,30 +145,112 @@ int HTTPResponse::receiveBody(TCPSocket& sock, std::string& responseBody,
   }
 }
 
+int HTTPResponse::receiveBody(TCPSocket& sock, int fd, int bytesLeft) {
+  return sock.spliceData(fd, bytesLeft);
+}
+
 int HTTPResponse::receiveLine(TCPSocket& sock, std::string& data) {
   return sock.readLine(data);
 }
 
+namespace {
+  /*********************************
+   * Name:    parseNumber
+   * Purpose: reads a decimal number from a header value
+   * Receive: next - the first digit; moved past the last one
+   *          end - the end of the value
+   *          number - set to the number
+   * Return:  true if there was at least one digit and the number fits
+   *********************************/
+  bool parseNumber(const char*& next, const char* end, unsigned int& number) {
+    const char* start = next;
+    number = 0;
+    while ((next < end) && isdigit(static_cast<unsigned char>(*next))) {
+      if (number > (UINT_MAX - 9) / 10) {
+        return false;
+      }
+      number = number * 10 + (*next - '0');
+      next++;
+    }
+    return next > start;
+  }
+}
+
 const int HTTPResponse::getContentLen() const {
-  int len = 0;
-  std::string len_str;
-  if (getHeaderValue("Content-Length", len_str) == true) {
-    std::istringstream conv(len_str);
-    conv >> len;
-    return len;
+  StringSpan lenStr = findHeaderValue(CONTENT_LENGTH);
+  if (lenStr.data == NULL) {
+    return -1;
+  }
+
+  // The value is not NUL-terminated, so convert it by hand. Anything but
+  // digits, or a length past INT_MAX, leaves the body's end unknown.
+  const char* next = lenStr.data;
+  const char* end = lenStr.data + lenStr.length;
+  unsigned int len;
+  if (!parseNumber(next, end, len) || (next != end) ||
+      (len > static_cast<unsigned int>(INT_MAX))) {
+    throw std::string("HTTPResponse Exception: bad Content-Length");
+  }
+  return len;
+}
+
+bool HTTPResponse::getContentRange(unsigned int& first, unsigned int& last,
+    int& length) const {
+  StringSpan range = findHeaderValue("Content-Range");
+  const char prefix[] = "bytes ";
+  const unsigned prefixLength = sizeof(prefix) - 1;
+  if ((range.length <= prefixLength) ||
+      (strncasecmp(range.data, prefix, prefixLength) != 0)) {
+    return false;
+  }
+
+  // bytes first-last/length, where length may be *
+  const char* next = range.data + prefixLength;
+  const char* end = range.data + range.length;
+  if (!parseNumber(next, end, first) || (next == end) || (*next++ != '-') ||
+      !parseNumber(next, end, last) || (next == end) || (*next++ != '/') ||
+      (last < first)) {
+    return false;
+  }
+
+  unsigned int total;
+  if ((next + 1 == end) && (*next == '*')) {
+    length = -1;
+  } else if (parseNumber(next, end, total) && (next == end) &&
+             (last < total)) {
+    length = total;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool HTTPResponse::isKeepAlive() const {
+  StringSpan connection = findHeaderValue(CONNECTION);
+  bool found = (connection.data != NULL);
+
+  // Header values are case-insensitive tokens.
+  if (version == "HTTP/1.0") {
+    return found && connection.containsIgnoreCase("keep-alive");
   }
-  return -1;
+  return !found || !connection.containsIgnoreCase("close");
 }
 
 void HTTPResponse::print(std::string& outputString) const {
+  // clear() keeps the string's storage, so a reused string only grows
+  // when a header is longer than any printed into it before.
   outputString.clear();
-  // Have the sstream library format the response line for us, since we
-  // need to turn the status code back into a std::string somehow.
-  std::ostringstream responseLine;
-  responseLine << version << " " << statusCode << " " << statusDesc;
 
-  // Take that and toss on the ending to get the first line...
-  outputString = responseLine.str();
+  // Format the status code by hand rather than with a stream...
+  char code[MAX_DIGITS];
+  unsigned codeLength = formatNumber(statusCode, code);
+
+  // ...and append the first line piece by piece...
+  outputString += version;
+  outputString += ' ';
+  outputString.append(code, codeLength);
+  outputString += ' ';
+  outputString += statusDesc;
   outputString += lineEnding;
 
   // ...and then add the associated headers.
@@ -207,49 +258,88 @@ void HTTPResponse::print(std::string& outputString) const {
 }
 
 void HTTPResponse::print(char* outputBuffer, unsigned bufferLen) const {
-  // Similar business, though we have to be more choosy with how we
-  // apply sstream.
-  std::ostringstream codeStr;
-  codeStr << statusCode;
+  // Similar business, copied straight into the caller's buffer.
+  char code[MAX_DIGITS];
+  unsigned codeLength = formatNumber(statusCode, code);
 
-  copyIfRoom(outputBuffer, version.c_str(), bufferLen);
-  copyIfRoom(outputBuffer, " ", bufferLen);
-  copyIfRoom(outputBuffer, codeStr.str().c_str(), bufferLen);
-  copyIfRoom(outputBuffer, " ", bufferLen);
-  copyIfRoom(outputBuffer, statusDesc.c_str(), bufferLen);
+  copyIfRoom(outputBuffer, version.data(), version.size(), bufferLen);
+  copyIfRoom(outputBuffer, " ", 1, bufferLen);
+  copyIfRoom(outputBuffer, code, codeLength, bufferLen);
+  copyIfRoom(outputBuffer, " ", 1, bufferLen);
+  copyIfRoom(outputBuffer, statusDesc.data(), statusDesc.size(), bufferLen);
 
-  copyIfRoom(outputBuffer, lineEnding.c_str(), bufferLen);
+  copyIfRoom(outputBuffer, lineEnding.data(), lineEnding.size(), bufferLen);
 
   HTTPMessage::print(outputBuffer, bufferLen);
 }
 
+void HTTPResponse::setContent(const std::string& content) {
+  this->content = content;
+  setContentLength(content.size());
+}
+
 void HTTPResponse::send(TCPSocket& sock) {
   std::string outgoingBuffer;
+  send(sock, outgoingBuffer);
+}
+
+void HTTPResponse::send(TCPSocket& sock, std::string& outgoingBuffer) {
   print(outgoingBuffer);
-  outgoingBuffer.append(content);
-  sock.writeString(outgoingBuffer);
+
+  // Send the header and the body straight from where they are, instead of
+  // copying a possibly large body onto the end of the header.
+  struct iovec buffers[2];
+  buffers[0].iov_base = (void *)outgoingBuffer.data();
+  buffers[0].iov_len = outgoingBuffer.size();
+  buffers[1].iov_base = (void *)content.data();
+  buffers[1].iov_len = content.size();
+  sock.writeBuffers(buffers, 2);
+}
+
+void HTTPResponse::setContentLength(unsigned long long length) {
+  char digits[MAX_DIGITS];
+  unsigned numDigits = formatNumber(length, digits);
+  setField("Content-Length", 14, digits, numDigits);
 }
 
-std::string HTTPResponse::buildTime() {
-  // format a time
-  time_t t;
-  struct tm *ts;
-  char result[38];
-  static char wdayName[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri",
-                                "Sat"};
-  static char monName[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
-                                "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-
-  // get the time
-  t = time(NULL);
-  ts = gmtime(&t);
-
-  // format the time std::string according to the specification,
-  // e.g. Sun, 06 Nov 1994 08:49:37 GMT)
-  snprintf(result, sizeof(result), "%.3s, %.2d %.3s %d %.2d:%.2d:%.2d GMT",
-       wdayName[ts->tm_wday], ts->tm_mday, monName[ts->tm_mon],
-       1900+ts->tm_year, ts->tm_hour, ts->tm_min, ts->tm_sec);
-  return std::string(result);
+void HTTPResponse::setDate() {
+  char date[DATE_LENGTH + 1];
+  getDate(date);
+  setField("Date", 4, date, DATE_LENGTH);
+}
+
+void HTTPResponse::getDate(char* buffer) {
+  // Every response in the same second carries the same Date, so only the
+  // first one of each second pays for gmtime_r() and the formatting.
+  time_t now = time(NULL);
+  pthread_mutex_lock(&dateLock);
+  if (now != dateSecond) {
+    formatDate(now, dateString);
+    dateSecond = now;
+  }
+  memcpy(buffer, dateString, DATE_LENGTH + 1);
+  pthread_mutex_unlock(&dateLock);
+}
+
+void HTTPResponse::formatDate(time_t time, char* buffer) {
+  static const char wdayName[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu",
+                                      "Fri", "Sat"};
+  static const char monName[12][4] = {"Jan", "Feb", "Mar", "Apr", "May",
+                                      "Jun", "Jul", "Aug", "Sep", "Oct",
+                                      "Nov", "Dec"};
+  struct tm ts;
+  gmtime_r(&time, &ts);
+
+  // format the time according to the specification,
+  // e.g. Sun, 06 Nov 1994 08:49:37 GMT; each field is cut to the digits
+  // the format has room for, so the date always fits in DATE_LENGTH
+  unsigned year = static_cast<unsigned>(1900 + ts.tm_year) % 10000;
+  snprintf(buffer, DATE_LENGTH + 1,
+       "%.3s, %02u %.3s %04u %02u:%02u:%02u GMT",
+       wdayName[ts.tm_wday], static_cast<unsigned>(ts.tm_mday) % 100,
+       monName[ts.tm_mon], year, static_cast<unsigned>(ts.tm_hour) % 100,
+       static_cast<unsigned>(ts.tm_min) % 100,
+       static_cast<unsigned>(ts.tm_sec) % 100);
 }
 
 void HTTPResponse::buildStatus() {
@@ -257,6 +347,12 @@ void HTTPResponse::buildStatus() {
     case 200:
       statusDesc = "OK";
       break;
+    case 206:
+      statusDesc = "Partial Content";
+      break;
+    case 304:
+      statusDesc = "Not Modified";
+      break;
     case 400:
       statusDesc = "Bad request";
       break;
@@ -266,6 +362,9 @@ void HTTPResponse::buildStatus() {
     case 404:
       statusDesc = "Not Found";
       break;
+    case 416:
+      statusDesc = "Range Not Satisfiable";
+      break;
     case 500:
       statusDesc = "Internal server error";
       break;
@@ -10,6 +10,10 @@
  * set up for you.  The HTTP specification mandates these headers, and some
  * clients may expect them.
  *
+ * Printing and sending a response builds no temporary strings: the status
+ * line and headers are written straight into the output, and the Date header
+ * comes from a process-wide string that is formatted at most once a second.
+ *
  * Also see the HTTPMessage class for methods that can be used to query and
  * set the response headers.
  *********************************/
@@ -19,15 +23,18 @@
 
 #include "HTTPMessage.h"
 #include "TCPSocket.h"
+#include <pthread.h>
 #include <string>
 #include <cstdlib>
-#include <cstdio>
 #include <ctime>
 #include <sstream>
 
 
 class HTTPResponse : public HTTPMessage {
  public:
+  // The length of a Date header value, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+  static const unsigned DATE_LENGTH = 29;
+
   /*********************************
    * Name:    HTTPResponse 
    * Purpose: Constructs a new HTTPResponse. Note that nothing is done 
@@ -63,6 +70,17 @@ class HTTPResponse : public HTTPMessage {
    *********************************/
   static HTTPResponse *parse(const char* data, unsigned length);
 
+  /*********************************
+   * Name:    parse
+   * Purpose: Construct an HTTPResponse object from a header that has
+   *          already been parsed, e.g. by TCPSocket::readHeader, without
+   *          parsing it again.
+   * Receive: parser - the parser holding the header
+   * Return:  a pointer to an HTTPResponse object, if the parser holds a
+   *          complete response header. NULL otherwise
+   *********************************/
+  static HTTPResponse *parse(const HTTPParser& parser);
+
   /*********************************
    * Name:    createStandardResponse
    * Purpose: Constructs a new HTTPResponse with some mandatory header 
@@ -70,28 +88,22 @@ class HTTPResponse : public HTTPMessage {
    *          which sets no fields for you at all). Assumes that you 
    *          will be sending back some kind of message body, and that 
    *          the message body will be sent verbatim (i.e. not compressed).
-   *          Also assumes that the connection will be closed immediately 
-   *          (non-persistent connection) after the send ends.
+   *          Unless keepAlive is set, also assumes that the connection 
+   *          will be closed immediately (non-persistent connection) after 
+   *          the send ends.
    * Receive: contentLen - The length of the message body that will 
    *                       be sent following this response.
    *          statusCode - The code representing the response status (e.g. 500).
    *          statusDesc - A short description of the response code's meaning.
    *          version - The HTTP version used to transmit the response.
+   *          keepAlive - true to leave the connection open for further
+   *                      requests once the body has been sent.
    * Return:  An HTTPResponse created for the given input, containing
    *          all of the mandatory headers.
    *********************************/
-  static HTTPResponse* createStandardResponse(unsigned contentLen,
+  static HTTPResponse* createStandardResponse(unsigned long long contentLen,
       unsigned statusCode = 0, const std::string& statusDesc = "",
-      const std::string& version = "HTTP/1.1");
-
-  /*********************************
-   * Name:    getChunkSize
-   * Purpose: for a given data, extract the chunk length
-   * Receive: data - the data as std::string
-   * Return:  the extracted chunk length
-   *          note that the chunk length is removed from data std::string.
-   *********************************/
-  static int getChunkSize(std::string& data);
+      const std::string& version = "HTTP/1.1", bool keepAlive = false);
 
   /*********************************
    * Name:    receiveHeader
@@ -115,6 +127,18 @@ class HTTPResponse : public HTTPMessage {
    *********************************/
   int receiveBody(TCPSocket& sock, std::string& body, int bytesLeft = BUFFER_SIZE);
 
+  /*********************************
+   * Name:    receiveBody
+   * Purpose: move the desired number of bytes of body from the socket
+   *          straight into a file descriptor (e.g. the video player's 
+   *          pipe), without copying them into a string first
+   * Receive: sock - the TCPSocket to receive from
+   *          fd - the descriptor to write the body to
+   *          bytesLeft - the number of bytes to move
+   * Return:  the number of bytes moved.
+   *********************************/
+  int receiveBody(TCPSocket& sock, int fd, int bytesLeft);
+
   /*********************************
    * Name:    receiveLine 
    * Purpose: receive until a newline char is found
@@ -128,10 +152,24 @@ class HTTPResponse : public HTTPMessage {
    * Name:    getContentLen
    * Purpose: from the header, extract the "Content-Length"
    * Receive: None
-   * Return:  the content length as int
+   * Return:  the content length as int, -1 if there is none. Throws a
+   *          std::string if the value is not a number up to INT_MAX.
    *********************************/
   const int getContentLen() const;
 
+  /*********************************
+   * Name:    getContentRange
+   * Purpose: from the header of a 206 Partial Content response, extract
+   *          the "Content-Range", e.g. "bytes 100-199/1000"
+   * Receive: first - set to the offset of the first byte sent
+   *          last - set to the offset of the last byte sent, inclusive
+   *          length - set to the length of the whole object, -1 if the
+   *                   server did not say ("*")
+   * Return:  true if the header is there and well-formed
+   *********************************/
+  bool getContentRange(unsigned int& first, unsigned int& last,
+                       int& length) const;
+
   /*********************************
    * Name:    getVersion 
    * Purpose: Looks up the version of the HTTP response (e.g. HTTP/1.1).
@@ -183,6 +221,28 @@ class HTTPResponse : public HTTPMessage {
     return chunked;
   }
 
+  /*********************************
+   * Name:    isKeepAlive
+   * Purpose: Checks if the connection may be reused after this response,
+   *          from the version and the Connection header. HTTP/1.1 
+   *          connections persist unless the server says "close"; HTTP/1.0
+   *          ones only persist if the server says "keep-alive".
+   * Receive: None
+   * Return:  true if the connection can carry another request
+   *********************************/
+  bool isKeepAlive() const;
+
+  /*********************************
+   * Name:    setKeepAlive
+   * Purpose: Sets the Connection header to tell the client whether the 
+   *          connection stays open after this response.
+   * Receive: keepAlive - true for a persistent connection
+   * Return:  None
+   *********************************/
+  void setKeepAlive(bool keepAlive) {
+    setHeaderField("Connection", keepAlive ? "keep-alive" : "close");
+  }
+
   /*********************************
    * Name:    print
    * Purpose: prints the response object to a text string, suitable 
@@ -254,22 +314,61 @@ class HTTPResponse : public HTTPMessage {
    * Receive: content - The text string to set as the response's description.
    * Return:  None
    *********************************/
-  void setContent(const std::string& content) {
-    this->content = content;
-    std::stringstream out;
-    out << content.size();
-    setHeaderField("Content-Length", out.str().c_str());
-  }
+  void setContent(const std::string& content);
 
   /*********************************
    * Name:    send 
-   * Purpose: Send this response to this TCP socket sock
+   * Purpose: Send this response to this TCP socket sock. The header and
+   *          the content are handed to the socket as separate buffers, so
+   *          the content is never copied.
    * Receive: sock - the socket to send to
    * Return:  None
    *********************************/
   void send(TCPSocket& sock);
 
+  /*********************************
+   * Name:    send
+   * Purpose: Same as above, but prints the header into a buffer the
+   *          caller keeps between responses, e.g. one per connection.
+   *          Once the buffer has grown to fit a header, sending another
+   *          one allocates nothing.
+   * Receive: sock - the socket to send to
+   *          headerBuffer - the reusable buffer; its contents are replaced
+   * Return:  None
+   *********************************/
+  void send(TCPSocket& sock, std::string& headerBuffer);
+
+  /*********************************
+   * Name:    getDate
+   * Purpose: Copies the current time, formatted for a Date header. The
+   *          string is shared by the whole process and only formatted
+   *          again when the second changes.
+   * Receive: buffer - room for DATE_LENGTH characters and a NUL
+   * Return:  None
+   *********************************/
+  static void getDate(char* buffer);
+
+  /*********************************
+   * Name:    formatDate
+   * Purpose: Formats a time the way HTTP dates are written, e.g. for a
+   *          Last-Modified header
+   * Receive: time - the time
+   *          buffer - room for DATE_LENGTH characters and a NUL
+   * Return:  None
+   *********************************/
+  static void formatDate(time_t time, char* buffer);
+
  private:
+  /*********************************
+   * Name:    HTTPResponse
+   * Purpose: Constructs a response from a parsed header, taking its status
+   *          line and header fields as they are, without the defaults or
+   *          Date stamp of the public constructor
+   * Receive: parser - a parser holding a complete response header
+   * Return:  None
+   *********************************/
+  explicit HTTPResponse(const HTTPParser& parser);
+
   /*********************************
    * Name:    buildStatus 
    * Purpose: private function that builds a data header field that matches the
@@ -280,13 +379,27 @@ class HTTPResponse : public HTTPMessage {
   void buildStatus();
 
   /*********************************
-   * Name:    buildTime  
-   * Purpose: private function that creates a current time for time-stamping
-   *          this response
+   * Name:    setContentLength
+   * Purpose: private function that sets the Content-Length header without
+   *          building a string for the number
+   * Receive: length - the length of the body
+   * Return:  None
+   *********************************/
+  void setContentLength(unsigned long long length);
+
+  /*********************************
+   * Name:    setDate
+   * Purpose: private function that time-stamps this response with the
+   *          cached Date string
    * Receive: None
-   * Return:  the string for currnet time
+   * Return:  None
    *********************************/
-  std::string buildTime();
+  void setDate();
+
+  // The process-wide Date string, and the second it was formatted for.
+  static pthread_mutex_t dateLock;
+  static time_t dateSecond;
+  static char dateString[DATE_LENGTH + 1];
 
   unsigned int statusCode;
   std::string version;
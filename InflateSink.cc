@@ -0,0 +1,86 @@
+#include "InflateSink.h"
+#include <string>
+
+InflateSink::InflateSink(BodySink& sink, Format format)
+    : sink(sink), format(format), done(false), raw(false), length(0) {
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  stream.next_in = Z_NULL;
+  stream.avail_in = 0;
+
+  // +16 accepts only a gzip header, the plain window size a zlib one.
+  int windowBits = (format == GZIP) ? MAX_WBITS + 16 : MAX_WBITS;
+  if (inflateInit2(&stream, windowBits) != Z_OK) {
+    throw std::string("InflateSink Exception: unable to set up zlib");
+  }
+}
+
+InflateSink::~InflateSink() {
+  inflateEnd(&stream);
+}
+
+void InflateSink::write(const char* data, unsigned int dataLength) {
+  bool first = (stream.total_in == 0);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream.avail_in = dataLength;
+
+  // Keep going while there is input, or while the output buffer came back
+  // full and zlib may be holding more.
+  do {
+    if (done) {
+      break;  // trailing garbage after the stream; nothing to do with it
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(output);
+    stream.avail_out = BUFFER_SIZE;
+    int result = inflate(&stream, Z_NO_FLUSH);
+
+    if ((result == Z_DATA_ERROR) && (format == DEFLATE) && !raw && first) {
+      // "deflate" is meant to be zlib-wrapped, but some servers send the
+      // bare deflate stream; start over treating it as such.
+      if (inflateReset2(&stream, -MAX_WBITS) != Z_OK) {
+        throw std::string("InflateSink Exception: unable to set up zlib");
+      }
+      raw = true;
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      stream.avail_in = dataLength;
+      continue;
+    }
+
+    if (result == Z_STREAM_END) {
+      done = true;
+    } else if ((result != Z_OK) && (result != Z_BUF_ERROR)) {
+      throw std::string("InflateSink Exception: corrupt compressed body");
+    }
+
+    unsigned int produced = BUFFER_SIZE - stream.avail_out;
+    if (produced > 0) {
+      sink.write(output, produced);
+      length += produced;
+    }
+  } while ((stream.avail_in > 0) || (stream.avail_out == 0));
+}
+
+void InflateSink::finish() {
+  if (!done) {
+    throw std::string("InflateSink Exception: compressed body cut short");
+  }
+}
+
+bool InflateSink::getFormat(const StringSpan& encoding, Format& format) {
+  if ((encoding.data == NULL) || encoding.empty() ||
+      encoding.equalsIgnoreCase("identity", 8)) {
+    return false;
+  } else if (encoding.equalsIgnoreCase("gzip", 4) ||
+             encoding.equalsIgnoreCase("x-gzip", 6)) {
+    format = GZIP;
+    return true;
+  } else if (encoding.equalsIgnoreCase("deflate", 7)) {
+    format = DEFLATE;
+    return true;
+  }
+
+  throw std::string("InflateSink Exception: unsupported content encoding ") +
+        encoding.str();
+}
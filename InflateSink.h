@@ -0,0 +1,100 @@
+/*********************************
+ * InflateSink - A BodySink that decompresses a body sent with
+ * "Content-Encoding: gzip" or "deflate" as it arrives and passes the result
+ * on to another sink. It stacks with the rest of the body path: a
+ * ChunkedDecoder feeds it the chunk data, and it feeds e.g. a StringSink
+ * or an FdSink, so a compressed, chunked playlist is unframed, inflated and
+ * stored in one pass over the received bytes.
+ *
+ * zlib does the decompressing. Errors are reported by throwing a
+ * std::string.
+ *********************************/
+
+#ifndef _INFLATE_SINK_H_
+#define _INFLATE_SINK_H_
+
+#include "BodySink.h"
+#include "StringSpan.h"
+#include <zlib.h>
+
+class InflateSink : public BodySink {
+ public:
+  enum Format {
+    GZIP,     // gzip (RFC 1952), also "x-gzip"
+    DEFLATE   // zlib (RFC 1950), or the raw deflate some servers send
+  };
+
+  /*********************************
+   * Name:    InflateSink
+   * Purpose: Constructor, ready for the start of a compressed body
+   * Receive: sink - where the decompressed body goes
+   *          format - how the body is compressed
+   * Return:  None, throws a std::string if zlib cannot be set up
+   *********************************/
+  InflateSink(BodySink& sink, Format format);
+
+  /*********************************
+   * Name:    ~InflateSink
+   * Purpose: Destructor, releases zlib's state
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~InflateSink();
+
+  /*********************************
+   * Name:    write
+   * Purpose: Decompresses the next piece of the body and passes whatever
+   *          comes out of it on. Anything after the end of the compressed
+   *          stream is ignored.
+   * Receive: data - the compressed bytes
+   *          length - the number of bytes
+   * Return:  None, throws a std::string if the data is corrupt
+   *********************************/
+  void write(const char* data, unsigned int length);
+
+  /*********************************
+   * Name:    finish
+   * Purpose: Checks, once the whole body has been written, that the
+   *          compressed stream was complete
+   * Receive: None
+   * Return:  None, throws a std::string if the stream was cut short
+   *********************************/
+  void finish();
+
+  /*********************************
+   * Name:    getLength
+   * Purpose: Counts the decompressed bytes passed on so far
+   * Receive: None
+   * Return:  the number of bytes
+   *********************************/
+  unsigned int getLength() const {
+    return length;
+  }
+
+  /*********************************
+   * Name:    getFormat
+   * Purpose: Works out how a Content-Encoding value says the body is
+   *          compressed
+   * Receive: encoding - the header's value
+   *          format - set to the format, if the body is compressed
+   * Return:  true if the body is compressed, false for "identity" or no
+   *          encoding. Throws a std::string for an encoding that cannot
+   *          be decoded.
+   *********************************/
+  static bool getFormat(const StringSpan& encoding, Format& format);
+
+ private:
+  BodySink& sink;
+  Format format;
+  z_stream stream;
+  bool done;       // the end of the compressed stream was seen
+  bool raw;        // a DEFLATE body turned out to have no zlib header
+  unsigned int length;
+  char output[BUFFER_SIZE];
+
+  // Not copyable, zlib's state belongs to one object.
+  InflateSink(const InflateSink&);
+  InflateSink& operator=(const InflateSink&);
+};
+
+#endif  // _INFLATE_SINK_H_
@@ -0,0 +1,281 @@
+#include "IoRing.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string>
+
+namespace {
+  // Thin wrappers over the system calls, which glibc does not provide.
+  int ringSetup(unsigned int entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+  }
+
+  int ringEnter(int fd, unsigned int toSubmit, unsigned int minComplete,
+                unsigned int flags) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                   NULL, 0);
+  }
+
+  int ringRegister(int fd, unsigned int opcode, void* arg,
+                   unsigned int nrArgs) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+  }
+
+  // The operations TCPSocket relies on; CONNECT is the newest (5.5).
+  const unsigned char REQUIRED_OPS[] = {
+    IORING_OP_CONNECT, IORING_OP_RECV, IORING_OP_READ_FIXED,
+    IORING_OP_WRITE_FIXED, IORING_OP_WRITEV
+  };
+}
+
+IoRing::IoRing(unsigned int entries, unsigned int numBuffers,
+    unsigned int bufferSize)
+    : ringFd(-1), bufferSize(bufferSize), sqRing(MAP_FAILED), sqRingSize(0),
+      sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize(0), queued(0),
+      cqRing(MAP_FAILED), cqRingSize(0), bufferMemory(NULL) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ringFd = ringSetup(entries, &params);
+  if (ringFd < 0) {
+    throw std::string("IoRing Exception: io_uring is not available");
+  }
+
+  // Map the two queues, in one piece when the kernel allows it.
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqRingSize > sqRingSize) {
+      sqRingSize = cqRingSize;
+    }
+    cqRingSize = sqRingSize;
+  }
+
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) {
+    destroy();
+    throw std::string("IoRing Exception: Unable to map submission queue");
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) {
+      destroy();
+      throw std::string("IoRing Exception: Unable to map completion queue");
+    }
+  }
+
+  sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = static_cast<io_uring_sqe*>(mmap(NULL, sqesSize,
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+      IORING_OFF_SQES));
+  if (sqes == MAP_FAILED) {
+    destroy();
+    throw std::string("IoRing Exception: Unable to map submission entries");
+  }
+
+  char* sq = static_cast<char*>(sqRing);
+  sqHead = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+  sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+  sqMask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+  sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+  char* cq = static_cast<char*>(cqRing);
+  cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+  cqMask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // Register the buffers in one go; the kernel pins them once, here,
+  // instead of on every fixed read and write.
+  if (numBuffers > 0) {
+    bufferMemory = static_cast<char*>(malloc(numBuffers * bufferSize));
+    if (bufferMemory == NULL) {
+      destroy();
+      throw std::string("IoRing Exception: Unable to allocate buffers");
+    }
+
+    std::vector<struct iovec> iovecs(numBuffers);
+    for (unsigned int i = 0; i < numBuffers; i++) {
+      iovecs[i].iov_base = bufferMemory + i * bufferSize;
+      iovecs[i].iov_len = bufferSize;
+    }
+    if (ringRegister(ringFd, IORING_REGISTER_BUFFERS, &iovecs[0],
+                     numBuffers) < 0) {
+      destroy();
+      throw std::string("IoRing Exception: Unable to register buffers");
+    }
+
+    // Hand out low indices first.
+    for (unsigned int i = numBuffers; i > 0; i--) {
+      freeBuffers.push_back(i - 1);
+    }
+  }
+}
+
+IoRing::~IoRing() {
+  destroy();
+}
+
+bool IoRing::isSupported() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = ringSetup(1, &params);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Ask which operations this kernel knows about.
+  const unsigned int numProbeOps = 256;
+  size_t probeSize = sizeof(io_uring_probe) +
+                     numProbeOps * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = static_cast<io_uring_probe*>(calloc(1, probeSize));
+  bool supported = (probe != NULL) &&
+      (ringRegister(fd, IORING_REGISTER_PROBE, probe, numProbeOps) == 0);
+
+  for (size_t i = 0; supported && (i < sizeof(REQUIRED_OPS)); i++) {
+    unsigned char op = REQUIRED_OPS[i];
+    supported = (op <= probe->last_op) &&
+                (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  free(probe);
+  close(fd);
+  return supported;
+}
+
+char* IoRing::acquireBuffer(int& index) {
+  if (freeBuffers.empty()) {
+    return NULL;
+  }
+  index = freeBuffers.back();
+  freeBuffers.pop_back();
+  return bufferMemory + index * bufferSize;
+}
+
+void IoRing::releaseBuffer(int index) {
+  freeBuffers.push_back(index);
+}
+
+void IoRing::prepareConnect(int fd, const sockaddr* addr, socklen_t addrLen,
+    unsigned int tag) {
+  io_uring_sqe* sqe = nextSqe(IORING_OP_CONNECT, fd, tag);
+  sqe->addr = reinterpret_cast<unsigned long>(addr);
+  sqe->off = addrLen;  // connect takes the length by value, in off
+}
+
+void IoRing::prepareRecv(int fd, void* buffer, unsigned int length,
+    unsigned int tag) {
+  io_uring_sqe* sqe = nextSqe(IORING_OP_RECV, fd, tag);
+  sqe->addr = reinterpret_cast<unsigned long>(buffer);
+  sqe->len = length;
+}
+
+void IoRing::prepareReadFixed(int fd, void* buffer, unsigned int length,
+    int index, unsigned int tag) {
+  io_uring_sqe* sqe = nextSqe(IORING_OP_READ_FIXED, fd, tag);
+  sqe->addr = reinterpret_cast<unsigned long>(buffer);
+  sqe->len = length;
+  sqe->buf_index = index;
+}
+
+void IoRing::prepareWriteFixed(int fd, const void* buffer,
+    unsigned int length, int index, unsigned int tag, bool link) {
+  io_uring_sqe* sqe = nextSqe(IORING_OP_WRITE_FIXED, fd, tag);
+  sqe->addr = reinterpret_cast<unsigned long>(buffer);
+  sqe->len = length;
+  sqe->buf_index = index;
+  if (link) {
+    sqe->flags |= IOSQE_IO_LINK;
+  }
+}
+
+void IoRing::prepareWritev(int fd, const struct iovec* buffers, int count,
+    unsigned int tag) {
+  io_uring_sqe* sqe = nextSqe(IORING_OP_WRITEV, fd, tag);
+  sqe->addr = reinterpret_cast<unsigned long>(buffers);
+  sqe->len = count;
+}
+
+void IoRing::complete(int* results, unsigned int count) {
+  unsigned int submitted = 0;
+  unsigned int reaped = 0;
+
+  while (reaped < count) {
+    // Submit whatever is still queued, and wait for at least one
+    // completion we have not seen yet.
+    int status = ringEnter(ringFd, queued - submitted, 1,
+                           IORING_ENTER_GETEVENTS);
+    if (status < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      queued = 0;
+      throw std::string("IoRing Exception: io_uring_enter failed");
+    }
+    submitted += status;
+
+    unsigned int head = *cqHead;
+    unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const io_uring_cqe& cqe = cqes[head & *cqMask];
+      if (cqe.user_data < count) {
+        results[cqe.user_data] = cqe.res;
+      }
+      reaped++;
+      head++;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  queued = 0;
+}
+
+io_uring_sqe* IoRing::nextSqe(unsigned char opcode, int fd,
+    unsigned int tag) {
+  unsigned int tail = *sqTail;
+  if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask) {
+    throw std::string("IoRing Exception: submission queue is full");
+  }
+  unsigned int slot = tail & *sqMask;
+
+  io_uring_sqe* sqe = &sqes[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = tag;
+
+  // Publish the entry; the kernel picks it up on the next io_uring_enter.
+  sqArray[slot] = slot;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  queued++;
+
+  return sqe;
+}
+
+void IoRing::destroy() {
+  if (sqes != MAP_FAILED) {
+    munmap(sqes, sqesSize);
+  }
+  if ((cqRing != MAP_FAILED) && (cqRing != sqRing)) {
+    munmap(cqRing, cqRingSize);
+  }
+  if (sqRing != MAP_FAILED) {
+    munmap(sqRing, sqRingSize);
+  }
+  if (ringFd >= 0) {
+    close(ringFd);  // also unregisters the buffers
+  }
+  free(bufferMemory);
+
+  sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  cqRing = MAP_FAILED;
+  sqRing = MAP_FAILED;
+  ringFd = -1;
+  bufferMemory = NULL;
+}
@@ -0,0 +1,215 @@
+/*********************************
+ * IoRing - A minimal io_uring instance, driven with the raw system calls so
+ * no extra library is needed. Operations are queued with the prepare
+ * functions and handed to the kernel together by complete(), so a send
+ * followed by a receive costs one system call instead of two.
+ *
+ * The ring owns a set of fixed-size buffers registered with the kernel;
+ * reads and writes through them (prepareReadFixed/prepareWriteFixed) skip
+ * the per-operation page pinning of ordinary buffers. TCPSocket borrows
+ * them for its receive buffer and for queued sends.
+ *
+ * A ring is not thread safe, so each thread needs its own. See
+ * TCPSocket::setThreadRing for how sockets pick one up.
+ *
+ * Only the client uses a ring, from SegmentFetcher. There a request is
+ * written just before the read of its reply, and the two go out in one
+ * submission. Every other blocking operation still costs one io_uring_enter,
+ * the same as the plain call it replaces.
+ *********************************/
+
+#ifndef _IO_RING_H_
+#define _IO_RING_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <vector>
+
+class IoRing {
+ public:
+  /*********************************
+   * Name:    IoRing
+   * Purpose: Constructor, sets up the ring and registers its buffers
+   * Receive: entries - the most operations queued at once
+   *          numBuffers - how many registered buffers to create
+   *          bufferSize - the size of each registered buffer
+   * Return:  None, throws a std::string if io_uring is unavailable
+   *********************************/
+  IoRing(unsigned int entries, unsigned int numBuffers,
+         unsigned int bufferSize);
+
+  /*********************************
+   * Name:    ~IoRing
+   * Purpose: Destructor, tears the ring down. Every borrowed buffer must
+   *          have been given back.
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~IoRing();
+
+  /*********************************
+   * Name:    isSupported
+   * Purpose: Checks whether the kernel offers io_uring with every
+   *          operation this class uses. Kernels that are too old, or
+   *          that have io_uring disabled, fail the check.
+   * Receive: None
+   * Return:  true if an IoRing can be created
+   *********************************/
+  static bool isSupported();
+
+  /*********************************
+   * Name:    acquireBuffer
+   * Purpose: Borrows one of the registered buffers
+   * Receive: index - will be set to the buffer's index, needed by the
+   *                  fixed read and write operations
+   * Return:  the buffer, getBufferSize() bytes long, or NULL if all of
+   *          them are in use
+   *********************************/
+  char* acquireBuffer(int& index);
+
+  /*********************************
+   * Name:    releaseBuffer
+   * Purpose: Gives a borrowed buffer back
+   * Receive: index - the buffer's index
+   * Return:  None
+   *********************************/
+  void releaseBuffer(int index);
+
+  /*********************************
+   * Name:    getBufferSize
+   * Purpose: Looks up the size of each registered buffer
+   * Receive: None
+   * Return:  the size in bytes
+   *********************************/
+  unsigned int getBufferSize() const {
+    return bufferSize;
+  }
+
+  /*********************************
+   * Name:    prepareConnect
+   * Purpose: Queues a connect()
+   * Receive: fd - the socket
+   *          addr, addrLen - the address to connect to, which must stay
+   *                          valid until complete() returns
+   *          tag - identifies the operation in complete()'s results
+   * Return:  None
+   *********************************/
+  void prepareConnect(int fd, const sockaddr* addr, socklen_t addrLen,
+                      unsigned int tag);
+
+  /*********************************
+   * Name:    prepareRecv
+   * Purpose: Queues a recv() into an ordinary buffer
+   * Receive: fd - the socket
+   *          buffer, length - where to put the data
+   *          tag - identifies the operation in complete()'s results
+   * Return:  None
+   *********************************/
+  void prepareRecv(int fd, void* buffer, unsigned int length,
+                   unsigned int tag);
+
+  /*********************************
+   * Name:    prepareReadFixed
+   * Purpose: Queues a read into (part of) a registered buffer
+   * Receive: fd - the socket
+   *          buffer, length - where to put the data, inside the buffer
+   *          index - the registered buffer's index
+   *          tag - identifies the operation in complete()'s results
+   * Return:  None
+   *********************************/
+  void prepareReadFixed(int fd, void* buffer, unsigned int length, int index,
+                        unsigned int tag);
+
+  /*********************************
+   * Name:    prepareWriteFixed
+   * Purpose: Queues a write from (part of) a registered buffer
+   * Receive: fd - the socket
+   *          buffer, length - the data, inside the buffer
+   *          index - the registered buffer's index
+   *          tag - identifies the operation in complete()'s results
+   *          link - if true, the next queued operation only starts once
+   *                 this one has written everything, and is cancelled
+   *                 (-ECANCELED) otherwise
+   * Return:  None
+   *********************************/
+  void prepareWriteFixed(int fd, const void* buffer, unsigned int length,
+                         int index, unsigned int tag, bool link);
+
+  /*********************************
+   * Name:    prepareWritev
+   * Purpose: Queues a writev() from ordinary buffers
+   * Receive: fd - the socket
+   *          buffers, count - the buffers, which must stay valid until
+   *                           complete() returns
+   *          tag - identifies the operation in complete()'s results
+   * Return:  None
+   *********************************/
+  void prepareWritev(int fd, const struct iovec* buffers, int count,
+                     unsigned int tag);
+
+  /*********************************
+   * Name:    complete
+   * Purpose: Submits everything queued with a single io_uring_enter and
+   *          waits until all of it has finished
+   * Receive: results - will hold each operation's result, indexed by tag:
+   *                    what the system call would have returned, or
+   *                    -errno on failure
+   *          count - the number of operations queued, whose tags must be
+   *                  0 to count - 1
+   * Return:  None, throws a std::string if the ring itself fails
+   *********************************/
+  void complete(int* results, unsigned int count);
+
+ private:
+  int ringFd;
+  unsigned int bufferSize;
+
+  // The shared submission queue ring.
+  void* sqRing;
+  size_t sqRingSize;
+  unsigned int* sqHead;
+  unsigned int* sqTail;
+  unsigned int* sqMask;
+  unsigned int* sqArray;
+  io_uring_sqe* sqes;
+  size_t sqesSize;
+  unsigned int queued;  // prepared but not yet submitted
+
+  // The shared completion queue ring; may be the same mapping as sqRing.
+  void* cqRing;
+  size_t cqRingSize;
+  unsigned int* cqHead;
+  unsigned int* cqTail;
+  unsigned int* cqMask;
+  io_uring_cqe* cqes;
+
+  // The registered buffers, one allocation cut into bufferSize pieces.
+  char* bufferMemory;
+  std::vector<int> freeBuffers;
+
+  // Not copyable, the mappings belong to a single object.
+  IoRing(const IoRing&);
+  IoRing& operator=(const IoRing&);
+
+  /*********************************
+   * Name:    nextSqe
+   * Purpose: Claims and clears the next submission queue entry
+   * Receive: opcode - the operation
+   *          fd - the descriptor it works on
+   *          tag - stored as the entry's user data
+   * Return:  the entry, for the caller to fill in
+   *********************************/
+  io_uring_sqe* nextSqe(unsigned char opcode, int fd, unsigned int tag);
+
+  /*********************************
+   * Name:    destroy
+   * Purpose: Unmaps and closes whatever the constructor set up
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void destroy();
+};
+
+#endif  // _IO_RING_H_
@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+MappedFile* MappedFile::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat status;
+  if ((fstat(fd, &status) < 0) || !S_ISREG(status.st_mode) ||
+      (static_cast<unsigned long long>(status.st_size) > 0xffffffffULL)) {
+    close(fd);
+    return NULL;
+  }
+
+  // mmap refuses empty mappings, and an empty file needs none.
+  void* mapping = NULL;
+  if (status.st_size > 0) {
+    mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);  // the mapping keeps the file open
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Files are read once, front to back: read ahead aggressively and drop
+  // pages behind.
+  if (mapping != NULL) {
+    madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+  }
+  return new MappedFile(static_cast<const char*>(mapping), status.st_size);
+}
+
+MappedFile::MappedFile(const char* data, unsigned int length)
+    : data(data), length(length) {
+}
+
+MappedFile::~MappedFile() {
+  if (data != NULL) {
+    munmap(const_cast<char*>(data), length);
+  }
+}
+
+unsigned int MappedFile::writeTo(int fd) const {
+  return writeTo(fd, 0, length);
+}
+
+unsigned int MappedFile::writeTo(int fd, unsigned int offset,
+                                 unsigned int length) const {
+  if ((offset > this->length) || (length > this->length - offset)) {
+    throw std::string("MappedFile Exception: range past the end of the "
+                      "file");
+  }
+
+  const char* next = data + offset;
+  unsigned int left = length;
+  bool canSplice = true;
+
+  while (left > 0) {
+    ssize_t written;
+    if (canSplice) {
+      // The pipe takes references to the pages, which outlive the
+      // mapping.
+      iovec chunk;
+      chunk.iov_base = const_cast<char*>(next);
+      chunk.iov_len = left;
+      written = vmsplice(fd, &chunk, 1, 0);
+      if ((written < 0) && ((errno == EBADF) || (errno == EINVAL))) {
+        canSplice = false;  // fd is not a pipe
+        continue;
+      }
+    } else {
+      written = write(fd, next, left);
+    }
+
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::string("MappedFile Exception: error writing the file");
+    }
+    next += written;
+    left -= written;
+  }
+  return length;
+}
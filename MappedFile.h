@@ -0,0 +1,91 @@
+/*********************************
+ * MappedFile - A local file mapped into memory, read-only. Its bytes are
+ * read straight from the page cache: a playlist is parsed where it lies, and
+ * a segment is handed to the player's pipe with vmsplice(2), which passes
+ * the pages themselves instead of copying them. The file should not change
+ * while it is mapped.
+ *********************************/
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+
+class MappedFile {
+ public:
+  /*********************************
+   * Name:    open
+   * Purpose: Maps a file into memory
+   * Receive: path - the file's path
+   * Return:  the mapping, NULL if the file cannot be opened or is not a
+   *          regular file
+   *********************************/
+  static MappedFile* open(const std::string& path);
+
+  /*********************************
+   * Name:    ~MappedFile
+   * Purpose: Unmaps the file
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~MappedFile();
+
+  /*********************************
+   * Name:    getData
+   * Purpose: Looks up the file's bytes
+   * Receive: None
+   * Return:  the first byte; NULL for an empty file
+   *********************************/
+  const char* getData() const {
+    return data;
+  }
+
+  /*********************************
+   * Name:    getLength
+   * Purpose: Looks up the file's size
+   * Receive: None
+   * Return:  the number of bytes
+   *********************************/
+  unsigned int getLength() const {
+    return length;
+  }
+
+  /*********************************
+   * Name:    writeTo
+   * Purpose: Writes the whole file to a descriptor. A pipe is given the
+   *          mapped pages with vmsplice; anything else gets write(2).
+   * Receive: fd - the descriptor to write to
+   * Return:  the number of bytes written, the file's length
+   *********************************/
+  unsigned int writeTo(int fd) const;
+
+  /*********************************
+   * Name:    writeTo
+   * Purpose: Writes a run of the file's bytes to a descriptor, the same
+   *          way as the whole file
+   * Receive: fd - the descriptor to write to
+   *          offset - the first byte to write
+   *          length - the number of bytes
+   * Return:  the number of bytes written, length. Throws a std::string if
+   *          the run goes past the end of the file.
+   *********************************/
+  unsigned int writeTo(int fd, unsigned int offset, unsigned int length) const;
+
+ private:
+  const char* data;
+  unsigned int length;
+
+  /*********************************
+   * Name:    MappedFile
+   * Purpose: Constructor of MappedFile objects; use open() instead
+   * Receive: data, length - the mapping
+   * Return:  None
+   *********************************/
+  MappedFile(const char* data, unsigned int length);
+
+  // Not copyable, the mapping is unmapped once.
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif  // _MAPPED_FILE_H_
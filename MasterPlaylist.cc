@@ -0,0 +1,157 @@
+#include "MasterPlaylist.h"
+#include "ByteScanner.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+  const std::string PLAYLIST_HEADER = "#EXTM3U";
+  const std::string VARIANT_TAG = "#EXT-X-STREAM-INF:";
+
+  // Tags only a media playlist has; a master playlist never lists
+  // segments.
+  const char* const MEDIA_TAGS[] = {
+    "#EXTINF:", "#EXT-X-TARGETDURATION:", "#EXT-X-MEDIA-SEQUENCE:"
+  };
+  const unsigned int NUM_MEDIA_TAGS = sizeof(MEDIA_TAGS) /
+                                      sizeof(MEDIA_TAGS[0]);
+
+  // Whether the line is one of MEDIA_TAGS.
+  bool isMediaTag(const std::string& line) {
+    for (unsigned int i = 0; i < NUM_MEDIA_TAGS; i++) {
+      if (line.compare(0, strlen(MEDIA_TAGS[i]), MEDIA_TAGS[i]) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the next line of data into line, without its line ending.
+  void readLine(const char*& data, const char* end, std::string& line) {
+    const char* found = ByteScanner::find(data, end, '\n');
+    const char* stop = (found != NULL) ? found : end;
+    line.assign(data, stop - data);
+    if (!line.empty() && (line[line.size() - 1] == '\r')) {
+      line.erase(line.size() - 1);
+    }
+    data = (found != NULL) ? found + 1 : end;
+  }
+
+  // Reads the next NAME=VALUE pair of an attribute list, starting at pos
+  // and leaving pos after it. Quotes are stripped from quoted values, whose
+  // commas (as in CODECS) do not end them.
+  bool readAttribute(const std::string& list, size_t& pos,
+                     std::string& name, std::string& value) {
+    size_t equals = list.find('=', pos);
+    if (equals == std::string::npos) {
+      return false;
+    }
+    name.assign(list, pos, equals - pos);
+
+    size_t start = equals + 1;
+    size_t stop;
+    if ((start < list.size()) && (list[start] == '"')) {
+      start++;
+      stop = list.find('"', start);
+      if (stop == std::string::npos) {
+        return false;
+      }
+      value.assign(list, start, stop - start);
+      stop++;  // the closing quote
+    } else {
+      stop = list.find(',', start);
+      if (stop == std::string::npos) {
+        stop = list.size();
+      }
+      value.assign(list, start, stop - start);
+    }
+
+    pos = (stop < list.size()) ? stop + 1 : list.size();
+    return true;
+  }
+
+  bool lowerBandwidth(const VariantEntry& a, const VariantEntry& b) {
+    return a.getBandwidth() < b.getBandwidth();
+  }
+}
+
+MasterPlaylist::MasterPlaylist() {
+}
+
+MasterPlaylist::~MasterPlaylist() {
+}
+
+MasterPlaylist* MasterPlaylist::parse(const char* data, unsigned int length) {
+  const char* end = data + length;
+  std::string line;
+  readLine(data, end, line);
+  if (line != PLAYLIST_HEADER) {
+    return NULL;
+  }
+
+  // Every #EXT-X-STREAM-INF tag is followed by the URL of its variant.
+  // A tag without a BANDWIDTH is malformed, and its variant is skipped.
+  MasterPlaylist* playlist = new MasterPlaylist;
+  bool inVariant = false;
+  unsigned int bandwidth = 0;
+  unsigned int width = 0;
+  unsigned int height = 0;
+  std::string codecs;
+  std::string name;
+  std::string value;
+  while (data < end) {
+    readLine(data, end, line);
+    if (isMediaTag(line)) {
+      // A media playlist: leave the rest of it, possibly many thousands
+      // of segments, to Playlist::parse.
+      delete playlist;
+      return NULL;
+    }
+    if (line.compare(0, VARIANT_TAG.length(), VARIANT_TAG) == 0) {
+      inVariant = true;
+      bandwidth = width = height = 0;
+      codecs.clear();
+      size_t pos = VARIANT_TAG.length();
+      while (readAttribute(line, pos, name, value)) {
+        if (name == "BANDWIDTH") {
+          bandwidth = strtoul(value.c_str(), NULL, 10);
+        } else if (name == "RESOLUTION") {
+          if (sscanf(value.c_str(), "%ux%u", &width, &height) != 2) {
+            width = height = 0;
+          }
+        } else if (name == "CODECS") {
+          codecs = value;
+        }
+      }
+    } else if (inVariant && !line.empty() && (line[0] != '#')) {
+      if (bandwidth > 0) {
+        playlist->variants.push_back(
+            VariantEntry(line, bandwidth, width, height, codecs));
+      }
+      inVariant = false;
+    }
+  }
+
+  if (playlist->variants.empty()) {
+    delete playlist;
+    return NULL;
+  }
+
+  // Variants of the same bandwidth keep the order they were listed in.
+  std::stable_sort(playlist->variants.begin(), playlist->variants.end(),
+                   lowerBandwidth);
+  return playlist;
+}
+
+MasterPlaylist* MasterPlaylist::parse(std::string const& data) {
+  return parse(data.c_str(), data.length());
+}
+
+unsigned int MasterPlaylist::getNumVariants() const {
+  return variants.size();
+}
+
+VariantEntry const& MasterPlaylist::getVariant(unsigned int variant) const {
+  return variants[variant];
+}
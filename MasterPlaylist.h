@@ -0,0 +1,75 @@
+/*********************************
+ * MasterPlaylist - Represents an HLS master playlist: a list of variant
+ * streams, each one the same presentation encoded at a different bitrate
+ * and listed with the media playlist that holds its segments.
+ *
+ * Each variant is an #EXT-X-STREAM-INF tag, whose BANDWIDTH, RESOLUTION and
+ * CODECS attributes are kept, followed by the URL of its media playlist.
+ * Other tags are skipped. Variants are ordered by increasing bandwidth, so
+ * variant 0 is the cheapest to play. Variant URLs are kept as written; they
+ * are usually relative to the master playlist's URL (see URL::resolve).
+ *********************************/
+
+#ifndef _MASTER_PLAYLIST_H_
+#define _MASTER_PLAYLIST_H_
+
+#include "VariantEntry.h"
+#include <string>
+#include <vector>
+
+class MasterPlaylist {
+ public:
+  ~MasterPlaylist();
+
+  /*********************************
+   * Name:    parse
+   * Purpose: Parses the master playlist stored in the given data buffer.
+   * Receive: data - The buffer in which the playlist file is stored.
+   *          length - The length of the given buffer.
+   * Return:  A new MasterPlaylist that represents the buffer's contents.
+   *          Returns NULL if the buffer does not hold a playlist, or holds
+   *          a media playlist (one without variants). A media playlist is
+   *          given up on at its first segment tag, without reading on.
+   *********************************/
+  static MasterPlaylist* parse(const char* data, unsigned length);
+
+  /*********************************
+   * Name:    parse
+   * Purpose: Parses the master playlist stored in the given string.
+   * Receive: data - The string in which the playlist file is stored.
+   * Return:  A new MasterPlaylist, NULL if the string does not hold a
+   *          master playlist.
+   *********************************/
+  static MasterPlaylist* parse(std::string const& data);
+
+  /*********************************
+   * Name:    getNumVariants
+   * Purpose: Counts the variant streams in the playlist.
+   * Receive: None
+   * Return:  The number of variants, at least 1.
+   *********************************/
+  unsigned int getNumVariants() const;
+
+  /*********************************
+   * Name:    getVariant
+   * Purpose: Looks up a variant stream.
+   * Receive: variant - which variant, below getNumVariants(); 0 is the
+   *                    lowest bandwidth
+   * Return:  The variant.
+   *********************************/
+  VariantEntry const& getVariant(unsigned int variant) const;
+
+ protected:
+  /*********************************
+   * Name:    MasterPlaylist
+   * Purpose: Constructor of MasterPlaylist objects; use parse() instead.
+   * Receive: None
+   * Return:  None
+   *********************************/
+  MasterPlaylist();
+
+ private:
+  std::vector<VariantEntry> variants;
+};
+
+#endif // _MASTER_PLAYLIST_H_
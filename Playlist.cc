@@ -1,112 +1,260 @@
 #include "Playlist.h"
-#include <cstdlib>
-#include <sstream>
+#include "ByteScanner.h"
+#include <cstring>
 
 namespace {
   const std::string GARBAGE_URL = "";
 
-  const std::string PLAYLIST_HEADER = "#EXTM3U";
-  const std::string SEGMENT_TAG = "#EXTINF:";
-  const std::string END_TAG = "#EXT-X-ENDLIST";
+  // A tag, with its length worked out by the compiler.
+  template <unsigned N>
+  StringSpan tag(const char (&name)[N]) {
+    return StringSpan(name, N - 1);
+  }
+
+  const StringSpan PLAYLIST_HEADER = tag("#EXTM3U");
+  const StringSpan SEGMENT_TAG = tag("#EXTINF:");
+  const StringSpan END_TAG = tag("#EXT-X-ENDLIST");
+  const StringSpan TARGET_DURATION_TAG = tag("#EXT-X-TARGETDURATION:");
+  const StringSpan MEDIA_SEQUENCE_TAG = tag("#EXT-X-MEDIA-SEQUENCE:");
+  const StringSpan BYTERANGE_TAG = tag("#EXT-X-BYTERANGE:");
+
+  // Returns what follows the tag a line starts with.
+  StringSpan afterTag(const StringSpan& line, const StringSpan& tag) {
+    return StringSpan(line.data + tag.length, line.length - tag.length);
+  }
+
+  // Reads the decimal number at the start of text, stopping at the first
+  // non-digit. Returns 0 if there is none.
+  unsigned int parseUnsigned(const StringSpan& text) {
+    unsigned int value = 0;
+    for (unsigned int i = 0;
+         (i < text.length) && (text.data[i] >= '0') && (text.data[i] <= '9');
+         i++) {
+      value = value * 10 + (text.data[i] - '0');
+    }
+    return value;
+  }
+
+  // Reads a duration in seconds, such as "10" or "9.009", at the start of
+  // text, as whole milliseconds. Digits past the third decimal round.
+  unsigned int parseMilliseconds(const StringSpan& text) {
+    unsigned int i = 0;
+    unsigned int seconds = 0;
+    for (; (i < text.length) && (text.data[i] >= '0') &&
+           (text.data[i] <= '9'); i++) {
+      seconds = seconds * 10 + (text.data[i] - '0');
+    }
+
+    unsigned int fraction = 0;
+    if ((i < text.length) && (text.data[i] == '.')) {
+      i++;
+      unsigned int scale = 100;
+      for (; (i < text.length) && (text.data[i] >= '0') &&
+             (text.data[i] <= '9'); i++) {
+        if (scale > 0) {
+          fraction += (text.data[i] - '0') * scale;
+          scale /= 10;
+        } else {
+          // The first digit past milliseconds rounds; the rest are noise.
+          if (text.data[i] >= '5') {
+            fraction++;
+          }
+          break;
+        }
+      }
+    }
+    return seconds * 1000 + fraction;
+  }
 }
 
-Playlist::Playlist() {
+Playlist::Playlist()
+    : hasBaseUrl(false), mediaSequence(0), targetDuration(0), ended(false) {
 }
 
 Playlist::~Playlist() {
 }
 
 Playlist* Playlist::parse(const char* data, unsigned int length) {
+  // Parsing is merging into a playlist that has nothing yet.
+  Playlist* playlist = new Playlist;
+  if (playlist->update(data, length) < 0) {
+    delete playlist;
+    return NULL;
+  }
+
+  return playlist;
+}
+
+Playlist* Playlist::parse(std::string const& data) {
+  return parse(data.c_str(), data.length());
+}
+
+int Playlist::update(const char* data, unsigned int length) {
   // Make sure there's a proper header in the given data.  If not, don't
   // even try.
   if (!verifyHeader(data, length)) {
-    return NULL;
+    return -1;
   }
 
-  // Read in playlist information until we can't get any more.  Pool it
-  // all together.
-  Playlist* playlist = new Playlist;
+  // Read in playlist information until we can't get any more, keeping
+  // only the segments we do not have yet.
+  unsigned int oldEnd = mediaSequence + segments.size();
+  ParseState state;
+  state.sequence = 0;
+  state.firstNew = oldEnd;
+  state.rangeOffset = 0;
+  state.rangeLength = 0;
+  state.rangeEnd = 0;
   bool possiblyMore = true;
   while (possiblyMore) {
-    possiblyMore = readNextSegment(data, length, playlist);
+    possiblyMore = readNextSegment(data, length, state, this);
   }
 
-  return playlist;
+  // After a restart oldEnd is behind mediaSequence, and everything counts
+  // as new.
+  if (oldEnd < mediaSequence) {
+    return segments.size();
+  }
+  return mediaSequence + segments.size() - oldEnd;
 }
 
-Playlist* Playlist::parse(std::string const& data) {
-  return parse(data.c_str(), data.length());
+int Playlist::update(std::string const& data) {
+  return update(data.c_str(), data.length());
+}
+
+void Playlist::discardSegments(unsigned int sequence) {
+  if (sequence <= mediaSequence) {
+    return;
+  }
+
+  unsigned int count = sequence - mediaSequence;
+  if (count > segments.size()) {
+    count = segments.size();
+  }
+  segments.dropFront(count);
+  mediaSequence += count;
 }
 
 unsigned int Playlist::getNumSegments() const {
   return segments.size();
 }
 
-unsigned int Playlist::getSegmentDuration(unsigned int segment) const {
+unsigned int Playlist::getSegmentDurationMs(unsigned int segment) const {
   if (segment < getNumSegments()) {
-    return segments[segment].getDuration();
+    return segments.getDurationMs(segment);
   } else {
     return 0;
   }
 }
 
-std::string const& Playlist::getSegmentUrl(unsigned int segment) const {
-  if (segment < getNumSegments()) {
-    return segments[segment].getUrl();
-  } else {
+std::string Playlist::getSegmentUrl(unsigned int segment) const {
+  if (segment >= getNumSegments()) {
     return GARBAGE_URL;
   }
+
+  std::string url;
+  segments.getUrl(segment, url);
+  if (hasBaseUrl && !URL::isAbsolute(url)) {
+    std::string resolved;
+    baseUrl.resolve(url, resolved);
+    return resolved;
+  }
+  return url;
+}
+
+bool Playlist::getSegmentRange(unsigned int segment, unsigned int& offset,
+    unsigned int& length) const {
+  if (segment >= getNumSegments()) {
+    return false;
+  }
+  return segments.getRange(segment, offset, length);
+}
+
+void Playlist::setBaseUrl(const URL& url) {
+  baseUrl = url;
+  hasBaseUrl = true;
 }
 
 bool Playlist::verifyHeader(const char*& data, unsigned int& length) {
-  std::string headerLine;
-  readUpTo(data, length, '\n', headerLine);
+  StringSpan headerLine;
+  readLine(data, length, headerLine);
 
-  return ((headerLine == PLAYLIST_HEADER) && (length != 0));
+  return (headerLine.equals(PLAYLIST_HEADER) && (length != 0));
 }
 
 
 bool Playlist::readNextSegment(const char*& data, unsigned int& length,
-    Playlist* outPlaylist) {
+    ParseState& state, Playlist* outPlaylist) {
   // Read lines out of the buffer repeatedly.  Keep going until we hit
-  // the end of the playlist or we finally read a segment.
-  std::string line;
+  // the end of the playlist or we finally read a segment.  Lines are
+  // looked at where they are, never copied; only a new segment's URL is.
+  StringSpan line;
   bool endOfList = false;
   bool foundSegment = false;
-  bool expectingUrl = false;
   while (!(endOfList || foundSegment) && (length > 0)) {
     // Pull in the next line.
-    readUpTo(data, length, '\n', line);
+    readLine(data, length, line);
+
+    // Every tag starts with '#'; anything else outside an #EXTINF is
+    // a stray URL or a blank line.
+    if (line.empty() || (line.data[0] != '#')) {
+      continue;
+    }
 
     // If the line has the end-of-playlist tag on it, don't bother
     // reading anything else.
-    if (line.substr(0, END_TAG.length()) == END_TAG) {
+    if (line.startsWith(END_TAG)) {
       endOfList = true;
-    }
-
-    // If the line starts with the segment indicator tag, read it,
-    // the duration that follows it, and the URL on the next line.
-    // If it looks like something fishy's happening, bail.
-    if (line.substr(0, SEGMENT_TAG.length()) == SEGMENT_TAG) {
+      outPlaylist->ended = true;
+    } else if (line.startsWith(TARGET_DURATION_TAG)) {
+      outPlaylist->targetDuration =
+          parseUnsigned(afterTag(line, TARGET_DURATION_TAG));
+    } else if (line.startsWith(MEDIA_SEQUENCE_TAG)) {
+      // The number of the first segment listed. If it is past the end of
+      // what we have, segments went by unseen: start over from it.
+      state.sequence = parseUnsigned(afterTag(line, MEDIA_SEQUENCE_TAG));
+      if (state.sequence > state.firstNew) {
+        outPlaylist->segments.clear();
+        outPlaylist->mediaSequence = state.sequence;
+        state.firstNew = state.sequence;
+      }
+    } else if (line.startsWith(BYTERANGE_TAG)) {
+      readByteRange(afterTag(line, BYTERANGE_TAG), state);
+    } else if (line.startsWith(SEGMENT_TAG)) {
+      // If the line starts with the segment indicator tag, read the
+      // duration that follows it, and the URL on the next line.
       // The duration should be between the tag and a comma.
-      // Make sure the comma's there.
-      line.erase(0, SEGMENT_TAG.length());
-      size_t commaPos = line.find(',');
-      if (commaPos != std::string::npos) {
-        // Grab the duration & URL.  Add them as the
-        // next entry in the playlist.  Make sure the
-        // URL's kosher first, though.
-        unsigned int duration = atoi(line.c_str());
-
-        readUpTo(data, length, '\n', line);
-        if ((line.length() > 0) && (line[0] != '#')) {
-          PlaylistEntry entry(line, duration);
-          outPlaylist->segments.push_back(entry);
-          foundSegment = true;
-        } else if (line.substr(0, END_TAG.length()) == END_TAG) {
-          // Toss in this check why not.
-          endOfList = true;
+      // Make sure the comma's there; if not, something fishy's
+      // happening, so skip the tag.
+      StringSpan attributes = afterTag(line, SEGMENT_TAG);
+      if (memchr(attributes.data, ',', attributes.length) == NULL) {
+        continue;
+      }
+      unsigned int durationMs = parseMilliseconds(attributes);
+
+      // Grab the URL and add it as the next entry in the playlist. An
+      // #EXT-X-BYTERANGE may come between the two.
+      readLine(data, length, line);
+      while (line.startsWith(BYTERANGE_TAG)) {
+        readByteRange(afterTag(line, BYTERANGE_TAG), state);
+        readLine(data, length, line);
+      }
+
+      // Make sure the URL's kosher first, though.
+      if (!line.empty() && (line.data[0] != '#')) {
+        // Segments we already have are only counted. New ones go
+        // straight from the buffer into the index.
+        if (state.sequence >= state.firstNew) {
+          outPlaylist->segments.append(line.data, line.length, durationMs,
+                                       state.rangeOffset, state.rangeLength);
         }
+        state.sequence++;
+        state.rangeLength = 0;  // a range is only for its own segment
+        foundSegment = true;
+      } else if (line.startsWith(END_TAG)) {
+        // Toss in this check why not.
+        endOfList = true;
+        outPlaylist->ended = true;
       }
     }
 
@@ -119,31 +267,42 @@ bool Playlist::readNextSegment(const char*& data, unsigned int& length,
   return !endOfList && (length > 0);
 }
 
-void Playlist::readUpTo(const char*& data, unsigned int& length,
-    char delimiter, std::string& output) {
-  // Clear whatever is in the output string.
-  output.clear();
+void Playlist::readByteRange(const StringSpan& text, ParseState& state) {
+  // <length>[@<offset>]
+  state.rangeLength = parseUnsigned(text);
+  const char* at = static_cast<const char*>(memchr(text.data, '@',
+                                                   text.length));
+  if (at != NULL) {
+    state.rangeOffset = parseUnsigned(StringSpan(at + 1,
+        text.length - (at + 1 - text.data)));
+  } else {
+    state.rangeOffset = state.rangeEnd;
+  }
+  state.rangeEnd = state.rangeOffset + state.rangeLength;
+}
 
+void Playlist::readLine(const char*& data, unsigned int& length,
+    StringSpan& line) {
   // Nothing to read from
   if (length == 0) {
+    line = StringSpan(data, 0);
     return;
   }
 
-  // Read up until we reach the delimiter, or we hit the end of the data,
-  // whichever comes first.
-  // 
-  // Put all characters other than the delimiter to the output std::string.
-  // Be sure to read at least one character every time so that it's possible 
-  // to advance beyond a sequence of several delimiters in a row.
+  // The line runs up to the newline, or to the end of the data, whichever
+  // comes first. A CR before the newline is not part of it.
   const char* dataEnd = data + length;
-  char test;
-  do {
-    test = *data;
-    data++;
-    length--;
-
-    if (test != delimiter) {
-      output += test;
-    }
-  } while ((test != delimiter) && (data < dataEnd));
+  const char* found = ByteScanner::find(data, dataEnd, '\n');
+  const char* stop = (found != NULL) ? found : dataEnd;
+
+  line = StringSpan(data, stop - data);
+  if (!line.empty() && (line.data[line.length - 1] == '\r')) {
+    line.length--;
+  }
+  if (found != NULL) {  // step over the delimiter itself
+    stop++;
+  }
+
+  length -= stop - data;
+  data = stop;
 }
@@ -7,14 +7,29 @@
  * Conceptually, a playlist is formed from a sequence of segments.  To play
  * back the playlist, each segment should be downloaded and streamed in order,
  * starting with segment 0.
+ *
+ * A live playlist has no #EXT-X-ENDLIST tag: the server keeps adding
+ * segments to its end (and usually drops old ones from its start), and the
+ * client reloads it about every target duration. Every segment has a
+ * sequence number, counted from the playlist's #EXT-X-MEDIA-SEQUENCE, which
+ * is how update() tells the new segments of a reload from the ones already
+ * known, so a reload only appends what is new.
+ *
+ * Segment URLs are kept as the playlist writes them, usually relative to
+ * the playlist's own URL. Given that URL with setBaseUrl(), getSegmentUrl()
+ * resolves them as they are asked for.
+ *
+ * A segment may be only part of the file its URL names, a byte range given
+ * by an #EXT-X-BYTERANGE tag; see getSegmentRange().
  *********************************/
 
 #ifndef _PLAYLIST_H_
 #define _PLAYLIST_H_
 
-#include "PlaylistEntry.h"
+#include "SegmentIndex.h"
+#include "StringSpan.h"
+#include "URL.h"
 #include <string>
-#include <vector>
 
 class Playlist {
  public:
@@ -40,6 +55,40 @@ class Playlist {
    *********************************/
   static Playlist* parse(std::string const& data);
 
+  /*********************************
+   * Name:    update
+   * Purpose: Merges a reload of a live playlist into this one. Only the
+   *          segments with sequence numbers past the last known one are
+   *          read and appended; the others are skipped without being
+   *          stored again. If the reload starts past the end of this
+   *          playlist, i.e. some segments were missed, the known segments
+   *          are dropped and the playlist starts over at the reload's.
+   * Receive: data - The buffer in which the reloaded playlist is stored.
+   *          length - The length of the given buffer.
+   * Return:  The number of segments appended, -1 if the buffer does not
+   *          hold a playlist (this one is left as it was).
+   *********************************/
+  int update(const char* data, unsigned length);
+
+  /*********************************
+   * Name:    update
+   * Purpose: Merges a reload of a live playlist stored in a string into
+   *          this one, see above.
+   * Receive: data - The string in which the reloaded playlist is stored.
+   * Return:  The number of segments appended, -1 if the string does not
+   *          hold a playlist.
+   *********************************/
+  int update(std::string const& data);
+
+  /*********************************
+   * Name:    discardSegments
+   * Purpose: Forgets the segments before a sequence number, e.g. once they
+   *          have been played, so a long live stream does not pile them up
+   * Receive: sequence - the sequence number of the first segment to keep
+   * Return:  None
+   *********************************/
+  void discardSegments(unsigned int sequence);
+
   /*********************************
    * Name:    getNumSegments
    * Purpose: Looks up the length of the current playlist.
@@ -49,21 +98,90 @@ class Playlist {
   unsigned int getNumSegments() const;
 
   /*********************************
-   * Name:    getSegmentDuration
+   * Name:    getSegmentDurationMs
    * Purpose: Gets the length of the segment at the given index in the playlist.
    * Receive: None
-   * Return:  The approximate length of the given segment, in seconds.
-   *          The exact length of the segment may differ slightly.
+   * Return:  The length of the given segment from its #EXTINF tag, in
+   *          milliseconds.
    *********************************/
-  unsigned int getSegmentDuration(unsigned int segment) const;
+  unsigned int getSegmentDurationMs(unsigned int segment) const;
 
   /*********************************
    * Name:    getSegmentUrl
    * Purpose: Gets the URL of the segment at the given index in the playlist.
    * Receive: None
-   * Return:  The URL of the media file for the requested segment.
+   * Return:  The URL of the media file for the requested segment,
+   *          resolved against the base URL if one is set.
+   *********************************/
+  std::string getSegmentUrl(unsigned int segment) const;
+
+  /*********************************
+   * Name:    getSegmentRange
+   * Purpose: Gets the byte range of the segment at the given index, from
+   *          its #EXT-X-BYTERANGE tag.
+   * Receive: segment - the index of the segment
+   *          offset - set to the first byte of the segment in its file
+   *          length - set to the size of the segment in bytes
+   * Return:  true if the segment is a byte range, false if it is the whole
+   *          file (offset and length are then left alone).
+   *********************************/
+  bool getSegmentRange(unsigned int segment, unsigned int& offset,
+                       unsigned int& length) const;
+
+  /*********************************
+   * Name:    hasByteRanges
+   * Purpose: Checks whether any segment is a byte range of its file.
+   * Receive: None
+   * Return:  true if some segment is
    *********************************/
-  std::string const& getSegmentUrl(unsigned int segment) const;
+  bool hasByteRanges() const {
+    return segments.hasRanges();
+  }
+
+  /*********************************
+   * Name:    setBaseUrl
+   * Purpose: Sets the URL relative segment URLs are resolved against,
+   *          normally the one the playlist was downloaded from.
+   * Receive: url - the base URL
+   * Return:  None
+   *********************************/
+  void setBaseUrl(const URL& url);
+
+  /*********************************
+   * Name:    getMediaSequence
+   * Purpose: Looks up the sequence number of segment 0, from the
+   *          #EXT-X-MEDIA-SEQUENCE tag. Segment i has number
+   *          getMediaSequence() + i.
+   * Receive: None
+   * Return:  The sequence number, 0 if the playlist does not say.
+   *********************************/
+  unsigned int getMediaSequence() const {
+    return mediaSequence;
+  }
+
+  /*********************************
+   * Name:    getTargetDuration
+   * Purpose: Looks up the #EXT-X-TARGETDURATION, the longest a segment
+   *          may last, which is also how often a live playlist should be
+   *          reloaded.
+   * Receive: None
+   * Return:  The target duration in seconds, 0 if the playlist does not
+   *          say.
+   *********************************/
+  unsigned int getTargetDuration() const {
+    return targetDuration;
+  }
+
+  /*********************************
+   * Name:    isEnded
+   * Purpose: Checks whether the playlist is complete (#EXT-X-ENDLIST). A
+   *          playlist that is not is live, and gains segments over time.
+   * Receive: None
+   * Return:  true if no segments will be added
+   *********************************/
+  bool isEnded() const {
+    return ended;
+  }
 
  protected:
   /*********************************
@@ -75,7 +193,24 @@ class Playlist {
   Playlist();
 
  private:
-  std::vector<PlaylistEntry> segments;
+  SegmentIndex segments;
+  URL baseUrl;
+  bool hasBaseUrl;
+  unsigned int mediaSequence;   // sequence number of segments[0]
+  unsigned int targetDuration;  // seconds
+  bool ended;                   // #EXT-X-ENDLIST was seen
+
+  // Where a parse is: the number of the next segment in the data, and the
+  // first one not already in the playlist. Segments before firstNew are
+  // skipped. An #EXT-X-BYTERANGE applies to the next segment; one without
+  // an offset starts where the previous segment's range ended.
+  struct ParseState {
+    unsigned int sequence;
+    unsigned int firstNew;
+    unsigned int rangeOffset;  // of the next segment
+    unsigned int rangeLength;  // of the next segment, 0 for a whole file
+    unsigned int rangeEnd;     // just past the previous segment's range
+  };
 
   /*********************************
    * Name:    verifyHeader
@@ -90,25 +225,39 @@ class Playlist {
   
   /*********************************
    * Name:    readNextSegment
-   * Purpose: reads the next segment from the give data
+   * Purpose: reads the next segment from the give data, and the tags
+   *          before it
    * Receive: data - a char* to be read
    *          length - length of the char*
-   *          outPlaylist - the playlist to store the next segment
+   *          state - where the parse is; advanced past the segment
+   *          outPlaylist - the playlist to store the next segment, if it
+   *                        is new, and the tags in
    * Return:  true if a next segment is found, false otherwise
    *********************************/
   static bool readNextSegment(const char*& data, unsigned int& length,
-      Playlist* outPlaylist);
+      ParseState& state, Playlist* outPlaylist);
+
+  /*********************************
+   * Name:    readByteRange
+   * Purpose: reads the value of an #EXT-X-BYTERANGE tag, the range of the
+   *          next segment
+   * Receive: text - what follows the tag, "<length>[@<offset>]"
+   *          state - where the parse is; given the range
+   * Return:  None
+   *********************************/
+  static void readByteRange(const StringSpan& text, ParseState& state);
 
   /*********************************
-   * Name:    readUpTo
-   * Purpose: read the data until we find the delimiter
-   * Receive: data  - a char* to be read
+   * Name:    readLine
+   * Purpose: finds the next line in the data, without copying it
+   * Receive: data  - a char* to be read; moved past the line
    *          length - length of the char*
-   *          output - to store the chars before the delimiter
+   *          line - set to the line, without its CR LF or LF. It points
+   *                 into data.
    * Return:  None
    *********************************/
-  static void readUpTo(const char*& data, unsigned int& length,
-      char delimiter, std::string& output);
+  static void readLine(const char*& data, unsigned int& length,
+      StringSpan& line);
 };
 
 #endif  // _PLAYLIST_H_
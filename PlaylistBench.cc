@@ -0,0 +1,89 @@
+// Microbenchmark for the playlist parser: times Playlist::parse on a large
+// VOD playlist, the way streamClient loads one, and Playlist::update with
+// a reload of the same text, where every segment is already known. The
+// playlist is generated with a typical CDN layout: an #EXTINF line and a
+// relative URL per segment.
+//
+// Every parse is repeated for at least SECONDS_PER_RUN and the best time
+// is printed along with the throughput. Build with "make bench"; the
+// segment count can be given as the only argument.
+
+#include "Playlist.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <time.h>
+
+namespace {
+  // How many segments the playlist lists unless told otherwise.
+  const unsigned int DEFAULT_SEGMENTS = 100000;
+
+  // How long each measurement runs for.
+  const double SECONDS_PER_RUN = 2.0;
+
+  // Builds a VOD playlist of count segments.
+  std::string makePlaylist(unsigned int count) {
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n"
+                           "#EXT-X-TARGETDURATION:10\n"
+                           "#EXT-X-MEDIA-SEQUENCE:0\n";
+    char line[96];
+    for (unsigned int i = 0; i < count; i++) {
+      snprintf(line, sizeof(line),
+               "#EXTINF:9.984000,\nvideo_1080p_4500k_%06u.ts\n", i);
+      playlist += line;
+    }
+    playlist += "#EXT-X-ENDLIST\n";
+    return playlist;
+  }
+
+  double nowSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+  }
+
+  // Parses the playlist, and reloads it if reload is set, until
+  // SECONDS_PER_RUN has passed; prints the best time of the step being
+  // measured.
+  void measure(const char* name, const std::string& text, bool reload) {
+    double best = 0;
+    unsigned int rounds = 0;
+    unsigned long segments = 0;
+    double stop = nowSeconds() + SECONDS_PER_RUN;
+    do {
+      double start = nowSeconds();
+      Playlist* playlist = Playlist::parse(text);
+      int added = 0;
+      if (reload) {
+        start = nowSeconds();
+        added = playlist->update(text);
+      }
+      double seconds = nowSeconds() - start;
+
+      segments += playlist->getNumSegments() + added;
+      delete playlist;
+      if ((rounds == 0) || (seconds < best)) {
+        best = seconds;
+      }
+      rounds++;
+    } while (nowSeconds() < stop);
+
+    printf("%-12s %8.2f ms  %7.0f MB/s  (%u rounds, %lu)\n", name,
+           best * 1e3, text.size() / best / 1e6, rounds, segments / rounds);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned int count = DEFAULT_SEGMENTS;
+  if (argc > 1) {
+    count = strtoul(argv[1], NULL, 10);
+  }
+
+  std::string text = makePlaylist(count);
+  printf("playlist %u segments, %u bytes\n\n", count,
+         static_cast<unsigned int>(text.size()));
+
+  measure("first parse", text, false);
+  measure("reload", text, true);
+  return 0;
+}
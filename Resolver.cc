@@ -0,0 +1,272 @@
+#include "Resolver.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctime>
+#include <map>
+
+namespace {
+  // A cached lookup result. Addresses are stored with port 0.
+  struct CacheEntry {
+    std::vector<Resolver::Address> addresses;
+    time_t expires;
+  };
+
+  // The most names kept in the cache; a playlist rarely needs more than a
+  // handful.
+  const size_t MAX_CACHE_ENTRIES = 256;
+
+  std::map<std::string, CacheEntry> cache;
+  pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+  unsigned int cacheTtl = 60;  // seconds
+
+  /*********************************
+   * Name:    findCached
+   * Purpose: Looks a name up in the cache
+   * Receive: host - the host name
+   *          addresses - will be set to the cached addresses, if found
+   * Return:  true if an unexpired entry was found
+   *********************************/
+  bool findCached(const std::string& host,
+                  std::vector<Resolver::Address>& addresses) {
+    bool found = false;
+
+    pthread_mutex_lock(&cacheLock);
+    std::map<std::string, CacheEntry>::iterator it = cache.find(host);
+    if (it != cache.end()) {
+      if (it->second.expires > time(NULL)) {
+        addresses = it->second.addresses;
+        found = true;
+      } else {
+        cache.erase(it);
+      }
+    }
+    pthread_mutex_unlock(&cacheLock);
+
+    return found;
+  }
+
+  /*********************************
+   * Name:    storeCached
+   * Purpose: Remembers a lookup result until the cache TTL runs out
+   * Receive: host - the host name
+   *          addresses - the addresses it resolved to, port 0
+   * Return:  None
+   *********************************/
+  void storeCached(const std::string& host,
+                   const std::vector<Resolver::Address>& addresses) {
+    pthread_mutex_lock(&cacheLock);
+    if (cacheTtl > 0) {
+      time_t now = time(NULL);
+
+      // Make room by dropping whatever has expired, or everything if
+      // nothing has.
+      if (cache.size() >= MAX_CACHE_ENTRIES) {
+        std::map<std::string, CacheEntry>::iterator it = cache.begin();
+        while (it != cache.end()) {
+          if (it->second.expires <= now) {
+            cache.erase(it++);
+          } else {
+            it++;
+          }
+        }
+        if (cache.size() >= MAX_CACHE_ENTRIES) {
+          cache.clear();
+        }
+      }
+
+      CacheEntry& entry = cache[host];
+      entry.addresses = addresses;
+      entry.expires = now + cacheTtl;
+    }
+    pthread_mutex_unlock(&cacheLock);
+  }
+}
+
+Resolver::Resolver() : stopping(false) {
+  if (pipe2(notifyPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    throw std::string("Resolver Exception: Unable to create notification pipe");
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&wakeup, NULL);
+
+  if (pthread_create(&worker, NULL, runWorker, this) != 0) {
+    pthread_cond_destroy(&wakeup);
+    pthread_mutex_destroy(&lock);
+    close(notifyPipe[0]);
+    close(notifyPipe[1]);
+    throw std::string("Resolver Exception: Unable to start worker thread");
+  }
+}
+
+Resolver::~Resolver() {
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_signal(&wakeup);
+  pthread_mutex_unlock(&lock);
+  pthread_join(worker, NULL);
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    delete pending[i];
+  }
+  for (size_t i = 0; i < completed.size(); i++) {
+    delete completed[i];
+  }
+
+  pthread_cond_destroy(&wakeup);
+  pthread_mutex_destroy(&lock);
+  close(notifyPipe[0]);
+  close(notifyPipe[1]);
+}
+
+void Resolver::resolve(const std::string& host, unsigned short port,
+    std::vector<Address>& addresses) {
+  if (!findCached(host, addresses)) {
+    lookup(host, addresses);
+    storeCached(host, addresses);
+  }
+  setPort(addresses, port);
+}
+
+void Resolver::resolveAsync(const std::string& host, unsigned short port,
+    Handler* handler, void* context) {
+  Request* request = new Request;
+  request->host = host;
+  request->port = port;
+  request->handler = handler;
+  request->context = context;
+
+  // No need to involve the worker if the answer is already known.
+  if (findCached(host, request->addresses)) {
+    setPort(request->addresses, port);
+    complete(request);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  pending.push_back(request);
+  pthread_cond_signal(&wakeup);
+  pthread_mutex_unlock(&lock);
+}
+
+int Resolver::dispatch() {
+  // Drain the wakeup bytes first, so a completion queued while we deliver
+  // makes the descriptor readable again.
+  char drain[64];
+  while (read(notifyPipe[0], drain, sizeof(drain)) > 0) {
+  }
+
+  std::deque<Request*> finished;
+  pthread_mutex_lock(&lock);
+  finished.swap(completed);
+  pthread_mutex_unlock(&lock);
+
+  for (size_t i = 0; i < finished.size(); i++) {
+    Request* request = finished[i];
+    request->handler->onResolved(request->context, request->addresses,
+                                 request->error);
+    delete request;
+  }
+
+  return finished.size();
+}
+
+void Resolver::setCacheTtl(unsigned int seconds) {
+  pthread_mutex_lock(&cacheLock);
+  cacheTtl = seconds;
+  if (seconds == 0) {
+    cache.clear();
+  }
+  pthread_mutex_unlock(&cacheLock);
+}
+
+void Resolver::clearCache() {
+  pthread_mutex_lock(&cacheLock);
+  cache.clear();
+  pthread_mutex_unlock(&cacheLock);
+}
+
+void Resolver::lookup(const std::string& host,
+    std::vector<Address>& addresses) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;  // IPv4 or IPv6, whatever the host has
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG;
+
+  addrinfo* results = NULL;
+  int status = getaddrinfo(host.c_str(), NULL, &hints, &results);
+  if (status != 0) {
+    throw std::string("Resolver Exception: could not resolve ") + host +
+        ": " + gai_strerror(status);
+  }
+
+  // Keep getaddrinfo's order, it already sorts by preference.
+  addresses.clear();
+  for (addrinfo* it = results; it != NULL; it = it->ai_next) {
+    if ((it->ai_family != AF_INET) && (it->ai_family != AF_INET6)) {
+      continue;
+    }
+    Address address;
+    memset(&address, 0, sizeof(address));
+    memcpy(&address.addr, it->ai_addr, it->ai_addrlen);
+    address.length = it->ai_addrlen;
+    addresses.push_back(address);
+  }
+  freeaddrinfo(results);
+
+  if (addresses.empty()) {
+    throw std::string("Resolver Exception: no usable address for ") + host;
+  }
+}
+
+void Resolver::setPort(std::vector<Address>& addresses, unsigned short port) {
+  for (size_t i = 0; i < addresses.size(); i++) {
+    if (addresses[i].addr.ss_family == AF_INET6) {
+      ((sockaddr_in6 *) &addresses[i].addr)->sin6_port = htons(port);
+    } else {
+      ((sockaddr_in *) &addresses[i].addr)->sin_port = htons(port);
+    }
+  }
+}
+
+void Resolver::complete(Request* request) {
+  pthread_mutex_lock(&lock);
+  completed.push_back(request);
+  pthread_mutex_unlock(&lock);
+
+  // If the pipe is full a wakeup is already pending, which is enough.
+  char signal = 1;
+  while ((write(notifyPipe[1], &signal, 1) < 0) && (errno == EINTR)) {
+  }
+}
+
+void* Resolver::runWorker(void* self) {
+  Resolver* resolver = static_cast<Resolver*>(self);
+
+  while (true) {
+    pthread_mutex_lock(&resolver->lock);
+    while (resolver->pending.empty() && !resolver->stopping) {
+      pthread_cond_wait(&resolver->wakeup, &resolver->lock);
+    }
+    if (resolver->stopping) {
+      pthread_mutex_unlock(&resolver->lock);
+      break;
+    }
+    Request* request = resolver->pending.front();
+    resolver->pending.pop_front();
+    pthread_mutex_unlock(&resolver->lock);
+
+    try {
+      resolve(request->host, request->port, request->addresses);
+    } catch (std::string msg) {
+      request->error = msg;
+    }
+    resolver->complete(request);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,193 @@
+/*********************************
+ * Resolver - Turns host names into socket addresses with getaddrinfo, so
+ * both IPv4 and IPv6 servers can be reached. Results are kept in a
+ * process-wide cache for a limited time, which saves a lookup per segment
+ * when every segment of a playlist lives on the same host. The cache is
+ * shared by all threads and guarded by a mutex; unlike gethostbyname, every
+ * function here is safe to call from several threads at once.
+ *
+ * getaddrinfo does not report the DNS record's TTL, so cached entries
+ * expire after a configurable lifetime instead (see setCacheTtl). Failed
+ * lookups are not cached.
+ *
+ * Besides the blocking resolve(), a Resolver object offers resolveAsync(),
+ * which performs the lookup on a worker thread. Completions are queued and
+ * announced on a descriptor (getDescriptor) so an event loop can wait for
+ * them together with its sockets, then deliver them with dispatch().
+ *********************************/
+
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+class Resolver {
+ public:
+  // One address a host name resolved to, ready to be passed to connect().
+  struct Address {
+    sockaddr_storage addr;
+    socklen_t length;
+  };
+
+  /*********************************
+   * Handler - Receives the results of resolveAsync, on the thread that
+   * calls dispatch().
+   *********************************/
+  class Handler {
+   public:
+    virtual ~Handler() {}
+
+    /*********************************
+     * Name:    onResolved
+     * Purpose: called when an asynchronous lookup has finished
+     * Receive: context - the value passed to resolveAsync
+     *          addresses - the addresses found, empty if the lookup failed
+     *          error - a description of the failure, empty on success
+     * Return:  None
+     *********************************/
+    virtual void onResolved(void* context,
+                            const std::vector<Address>& addresses,
+                            const std::string& error) = 0;
+  };
+
+  /*********************************
+   * Name:    Resolver
+   * Purpose: Constructor, sets up the completion queue and starts the
+   *          worker thread used by resolveAsync
+   * Receive: None
+   * Return:  None
+   *********************************/
+  Resolver();
+
+  /*********************************
+   * Name:    ~Resolver
+   * Purpose: Destructor, stops the worker thread once its current lookup
+   *          (if any) is done. Undelivered completions are dropped.
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~Resolver();
+
+  /*********************************
+   * Name:    resolve
+   * Purpose: Looks up a host name, consulting the cache first
+   * Receive: host - the host name or numeric address
+   *          port - the port to put into the addresses
+   *          addresses - will be set to the addresses found, in the order
+   *                      they should be tried
+   * Return:  None, throws a std::string if the name cannot be resolved
+   *********************************/
+  static void resolve(const std::string& host, unsigned short port,
+                      std::vector<Address>& addresses);
+
+  /*********************************
+   * Name:    resolveAsync
+   * Purpose: Starts looking up a host name without blocking. Cached names
+   *          complete on the next dispatch() without a worker round trip.
+   * Receive: host - the host name or numeric address
+   *          port - the port to put into the addresses
+   *          handler - notified from dispatch()
+   *          context - handed back to the handler untouched
+   * Return:  None
+   *********************************/
+  void resolveAsync(const std::string& host, unsigned short port,
+                    Handler* handler, void* context);
+
+  /*********************************
+   * Name:    getDescriptor
+   * Purpose: Looks up the descriptor that becomes readable whenever
+   *          completions are waiting to be dispatched
+   * Receive: None
+   * Return:  the descriptor
+   *********************************/
+  int getDescriptor() const {
+    return notifyPipe[0];
+  }
+
+  /*********************************
+   * Name:    dispatch
+   * Purpose: Delivers every finished lookup to its handler
+   * Receive: None
+   * Return:  the number of completions delivered
+   *********************************/
+  int dispatch();
+
+  /*********************************
+   * Name:    setCacheTtl
+   * Purpose: Sets how long resolved names stay in the cache
+   * Receive: seconds - the lifetime of a cache entry, 0 to disable caching
+   * Return:  None
+   *********************************/
+  static void setCacheTtl(unsigned int seconds);
+
+  /*********************************
+   * Name:    clearCache
+   * Purpose: Forgets every cached name
+   * Receive: None
+   * Return:  None
+   *********************************/
+  static void clearCache();
+
+ private:
+  // A lookup waiting for (or finished by) the worker thread.
+  struct Request {
+    std::string host;
+    unsigned short port;
+    Handler* handler;
+    void* context;
+    std::vector<Address> addresses;
+    std::string error;
+  };
+
+  int notifyPipe[2];
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  bool stopping;
+  std::deque<Request*> pending;
+  std::deque<Request*> completed;
+
+  /*********************************
+   * Name:    lookup
+   * Purpose: Resolves a name with getaddrinfo, bypassing the cache
+   * Receive: host - the host name or numeric address
+   *          addresses - will be set to the addresses found, port 0
+   * Return:  None, throws a std::string if the name cannot be resolved
+   *********************************/
+  static void lookup(const std::string& host, std::vector<Address>& addresses);
+
+  /*********************************
+   * Name:    setPort
+   * Purpose: Writes a port number into every address of a list
+   * Receive: addresses - the addresses to update
+   *          port - the port, in host byte order
+   * Return:  None
+   *********************************/
+  static void setPort(std::vector<Address>& addresses, unsigned short port);
+
+  /*********************************
+   * Name:    complete
+   * Purpose: Queues a finished request for dispatch() and wakes up
+   *          whoever is waiting on the descriptor
+   * Receive: request - the finished request
+   * Return:  None
+   *********************************/
+  void complete(Request* request);
+
+  /*********************************
+   * Name:    runWorker
+   * Purpose: Body of the worker thread: performs queued lookups until the
+   *          resolver is destroyed
+   * Receive: self - the Resolver that owns the thread
+   * Return:  NULL
+   *********************************/
+  static void* runWorker(void* self);
+};
+
+#endif  // _RESOLVER_H_
@@ -0,0 +1,58 @@
+#include "SegmentCache.h"
+
+SegmentCache::SegmentCache(size_t budget)
+    : budget(budget), size(0), hits(0), misses(0) {
+}
+
+const std::string* SegmentCache::find(const std::string& url) {
+  std::map<std::string, EntryList::iterator>::iterator it = index.find(url);
+  if (it == index.end()) {
+    misses++;
+    return NULL;
+  }
+
+  // splice() relinks the node, so the body is not moved and the index
+  // stays valid.
+  entries.splice(entries.begin(), entries, it->second);
+  hits++;
+  return &it->second->body;
+}
+
+bool SegmentCache::insert(const std::string& url, std::string& body) {
+  if (body.size() > budget) {
+    return false;
+  }
+
+  // A segment that is already cached is replaced.
+  std::map<std::string, EntryList::iterator>::iterator it = index.find(url);
+  if (it != index.end()) {
+    size -= it->second->body.size();
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  while (size + body.size() > budget) {
+    evictOne();
+  }
+
+  entries.push_front(Entry());
+  Entry& entry = entries.front();
+  entry.url = url;
+  entry.body.swap(body);
+  index[url] = entries.begin();
+  size += entry.body.size();
+  return true;
+}
+
+void SegmentCache::clear() {
+  index.clear();
+  entries.clear();
+  size = 0;
+}
+
+void SegmentCache::evictOne() {
+  Entry& victim = entries.back();
+  size -= victim.body.size();
+  index.erase(victim.url);
+  entries.pop_back();
+}
@@ -0,0 +1,120 @@
+/*********************************
+ * SegmentCache - Keeps the bodies of recently played segments in memory, so
+ * a playlist that is played again (or a segment that is sought back to) is
+ * served without downloading it again. Bodies are keyed by the segment's
+ * resolved URL, as returned by Playlist::getSegmentUrl.
+ *
+ * The cache holds at most a fixed number of bytes of bodies. When a new body
+ * does not fit, the least recently used ones are dropped until it does.
+ * Bodies are moved in and handed out by reference, never copied.
+ *
+ * Not thread safe; the client uses it from one thread.
+ *********************************/
+
+#ifndef _SEGMENT_CACHE_H_
+#define _SEGMENT_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+
+class SegmentCache {
+ public:
+  /*********************************
+   * Name:    SegmentCache
+   * Purpose: Constructor of SegmentCache class objects
+   * Receive: budget - the most bytes of segment bodies kept
+   * Return:  None
+   *********************************/
+  explicit SegmentCache(size_t budget);
+
+  /*********************************
+   * Name:    find
+   * Purpose: Looks a segment up, and marks it as the most recently used
+   * Receive: url - the segment's URL
+   * Return:  the body, NULL if the segment is not cached. The body stays
+   *          valid until the next call to insert or clear.
+   *********************************/
+  const std::string* find(const std::string& url);
+
+  /*********************************
+   * Name:    insert
+   * Purpose: Keeps a segment's body, dropping the least recently used
+   *          bodies to make room for it. A body larger than the whole
+   *          budget is not kept.
+   * Receive: url - the segment's URL
+   *          body - the body. It is swapped into the cache, so if it is
+   *                 kept the string is left empty.
+   * Return:  true if the body was kept
+   *********************************/
+  bool insert(const std::string& url, std::string& body);
+
+  /*********************************
+   * Name:    clear
+   * Purpose: Drops every cached body
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void clear();
+
+  /*********************************
+   * Name:    getSize
+   * Purpose: Counts the bytes of bodies held
+   * Receive: None
+   * Return:  the number of bytes
+   *********************************/
+  size_t getSize() const {
+    return size;
+  }
+
+  /*********************************
+   * Name:    getNumHits
+   * Purpose: Counts the lookups that found their segment
+   * Receive: None
+   * Return:  the number of hits
+   *********************************/
+  unsigned int getNumHits() const {
+    return hits;
+  }
+
+  /*********************************
+   * Name:    getNumMisses
+   * Purpose: Counts the lookups that did not find their segment
+   * Receive: None
+   * Return:  the number of misses
+   *********************************/
+  unsigned int getNumMisses() const {
+    return misses;
+  }
+
+ private:
+  // A cached body. The list of them runs from the most to the least
+  // recently used.
+  struct Entry {
+    std::string url;
+    std::string body;
+  };
+  typedef std::list<Entry> EntryList;
+
+  EntryList entries;
+  std::map<std::string, EntryList::iterator> index;  // by URL
+  size_t budget;
+  size_t size;
+  unsigned int hits;
+  unsigned int misses;
+
+  /*********************************
+   * Name:    evictOne
+   * Purpose: Drops the least recently used body
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void evictOne();
+
+  // Not copyable, the index points into the list.
+  SegmentCache(const SegmentCache&);
+  SegmentCache& operator=(const SegmentCache&);
+};
+
+#endif  // _SEGMENT_CACHE_H_
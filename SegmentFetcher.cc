@@ -0,0 +1,645 @@
+#include "SegmentFetcher.h"
+#include "ChunkedDecoder.h"
+#include "EventLoop.h"
+#include "InflateSink.h"
+#include <map>
+#include <sstream>
+#include <unistd.h>
+
+// One download per connection: connect, send the request, read the header,
+// then read Content-Length bytes of body. Whatever goes wrong, the object
+// is only marked as not downloaded.
+class SegmentFetcher::ConcurrentFetch : public EventLoop::Handler {
+ public:
+  ConcurrentFetch(EventLoop& loop, const std::vector<URL*>& urls,
+                  std::vector<std::string>& bodies, long long deadline)
+      : loop(loop), urls(urls), bodies(bodies), deadline(deadline),
+        completed(0) {
+  }
+
+  // Connects to the server of every object.
+  void start(const SocketOptions& options) {
+    for (unsigned int i = 0; i < urls.size(); i++) {
+      TCPSocket* sock = new TCPSocket();
+      sock->setOptions(options);  // applied once the socket is created
+      Transfer& transfer = transfers[sock];
+      transfer.index = i;
+      transfer.keepAlive = false;
+      transfer.compressed = false;
+      transfer.done = false;
+      loop.connect(sock, *urls[i], this, timeLeft());
+    }
+  }
+
+  // Hands the connections whose responses were read completely to the
+  // pool; the loop deletes the rest.
+  void keepConnections(ConnectionPool& pool) {
+    for (std::map<TCPSocket*, Transfer>::iterator it = transfers.begin();
+         it != transfers.end(); it++) {
+      if (it->second.done && it->second.keepAlive) {
+        pool.release(*urls[it->second.index], loop.detach(it->first), true);
+      }
+    }
+  }
+
+  unsigned int getNumCompleted() const {
+    return completed;
+  }
+
+  void onConnect(TCPSocket& sock) {
+    HTTPRequest* request = createRequest(*urls[transfers[&sock].index]);
+    try {
+      // A request is far smaller than a new socket's send buffer.
+      request->send(sock);
+    } catch (std::string msg) {
+      delete request;
+      loop.remove(&sock);
+      return;
+    }
+    delete request;
+    loop.readHeader(&sock, this, timeLeft());
+  }
+
+  void onHeader(TCPSocket& sock, std::string& header) {
+    Transfer& transfer = transfers[&sock];
+    HTTPResponse* response = HTTPResponse::parse(header.data(),
+                                                 header.size());
+    int contentLen = -1;
+    try {
+      if (response != NULL) {
+        contentLen = response->getContentLen();
+      }
+    } catch (std::string msg) {
+      // A malformed length fails the transfer like any other bad header.
+    }
+    if ((response == NULL) || (response->getStatusCode() != 200) ||
+        response->isChunked() || (contentLen < 0)) {
+      delete response;
+      loop.remove(&sock);
+      return;
+    }
+
+    transfer.keepAlive = response->isKeepAlive();
+    transfer.compressed = InflateSink::getFormat(
+        response->findHeaderValue(HTTPMessage::CONTENT_ENCODING),
+        transfer.format);
+    delete response;
+    loop.readData(&sock, contentLen, this, timeLeft());
+  }
+
+  void onData(TCPSocket& sock, std::string& data, bool complete) {
+    Transfer& transfer = transfers[&sock];
+    std::string& body = bodies[transfer.index];
+    if (!complete) {
+      loop.remove(&sock);
+      return;
+    }
+
+    if (!transfer.compressed) {
+      body.swap(data);
+    } else {
+      try {
+        StringSink sink(body);
+        InflateSink inflater(sink, transfer.format);
+        inflater.write(data.data(), data.size());
+        inflater.finish();
+      } catch (std::string msg) {
+        body.clear();
+        loop.remove(&sock);
+        return;
+      }
+    }
+    transfer.done = true;
+    completed++;
+  }
+
+  void onError(TCPSocket& sock, const std::string& message) {
+    loop.remove(&sock);
+  }
+
+ private:
+  // Where the download of one object is.
+  struct Transfer {
+    unsigned int index;  // in urls
+    bool keepAlive;
+    bool compressed;
+    InflateSink::Format format;
+    bool done;
+  };
+
+  EventLoop& loop;
+  const std::vector<URL*>& urls;
+  std::vector<std::string>& bodies;
+  long long deadline;  // monotonic ms
+  unsigned int completed;
+  std::map<TCPSocket*, Transfer> transfers;
+
+  // Every step may take what is left of the overall time.
+  int timeLeft() const {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long left = deadline - (static_cast<long long>(now.tv_sec) * 1000 +
+                                 now.tv_nsec / 1000000);
+    return (left > 0) ? static_cast<int>(left) : 0;
+  }
+};
+
+SegmentFetcher::SegmentFetcher() : ring(NULL), autoTune(false), tuned(false) {
+  if (IoRing::isSupported()) {
+    try {
+      ring = new IoRing(RING_ENTRIES, RING_BUFFERS, BUFFER_SIZE);
+      TCPSocket::setThreadRing(ring);
+    } catch (std::string msg) {
+      ring = NULL;  // stick to the blocking calls
+    }
+  }
+}
+
+SegmentFetcher::~SegmentFetcher() {
+  if (ring != NULL) {
+    pool.closeIdle();  // the pooled sockets borrow the ring's buffers
+    TCPSocket::setThreadRing(NULL);
+    delete ring;
+  }
+}
+
+void SegmentFetcher::fetch(const URL& url, std::string& body) {
+  body.clear();
+  StringSink sink(body);
+  fetchResumable(url, sink, 0, 0);
+}
+
+bool SegmentFetcher::fetchIfChanged(const URL& url, std::string& body,
+    Validators& validators) {
+  TCPSocket* sock = NULL;
+  HTTPResponse* response = sendRequest(url, sock, 0, 0, &validators);
+  bool reusable = false;
+  unsigned int total = 0;
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // A 304 never has a body, whatever its header says.
+  if (response->getStatusCode() == 304) {
+    reusable = response->isKeepAlive();
+    delete response;
+    pool.release(url, sock, reusable);
+    return false;
+  }
+
+  body.clear();
+  try {
+    StringSink sink(body);
+    total = receiveBody(*response, *sock, sink, reusable);
+  } catch (std::string msg) {
+    delete response;
+    pool.release(url, sock, false);
+    throw msg;
+  }
+
+  // Only now does body hold the copy these validators identify.
+  validators.etag = response->findHeaderValue("ETag").str();
+  validators.lastModified = response->findHeaderValue("Last-Modified").str();
+
+  delete response;
+  tuneReceiveBuffer(*sock, total, start);
+  pool.release(url, sock, reusable);
+  return true;
+}
+
+unsigned int SegmentFetcher::fetchAll(const std::vector<URL*>& urls,
+    std::vector<std::string>& bodies, int timeoutMs) {
+  bodies.assign(urls.size(), std::string());
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long deadline = static_cast<long long>(now.tv_sec) * 1000 +
+                       now.tv_nsec / 1000000 + timeoutMs;
+
+  EventLoop loop;
+  ConcurrentFetch transfers(loop, urls, bodies, deadline);
+  transfers.start(pool.getSocketOptions());
+  loop.run();
+  transfers.keepConnections(pool);
+  return transfers.getNumCompleted();
+}
+
+unsigned int SegmentFetcher::fetchToDescriptor(const URL& url, int fd) {
+  return fetchRangeToDescriptor(url, 0, 0, fd);
+}
+
+unsigned int SegmentFetcher::fetchRangeToDescriptor(const URL& url,
+    unsigned int offset, unsigned int length, int fd) {
+  FdSink sink(fd);
+  return fetchResumable(url, sink, offset, length);
+}
+
+unsigned int SegmentFetcher::fetchPipelined(const std::vector<URL*>& urls,
+    int fd, unsigned int depth) {
+  unsigned int total = 0;
+  unsigned int next = 0;  // the first object whose response is still due
+
+  while (next < urls.size()) {
+    const URL& server = *urls[next];
+    bool reused;
+    TCPSocket* sock = pool.acquire(server, reused);
+    unsigned int sent = next;  // requests [next, sent) are in flight
+    unsigned int window = 1;  // until the server shows it keeps connections
+    unsigned int answered = 0;
+    bool reusable = true;
+    bool closed = false;
+    unsigned int resumeFrom = 0;  // where the body that broke off stopped
+
+    try {
+      while ((next < urls.size()) && reusable) {
+        while ((sent < urls.size()) && (sent - next < window) &&
+               ConnectionPool::isSameServer(*urls[sent], server)) {
+          HTTPRequest* request = createRequest(*urls[sent]);
+          try {
+            request->send(*sock);
+          } catch (std::string msg) {
+            delete request;
+            throw msg;
+          }
+          delete request;
+          sent++;
+        }
+        if (sent == next) {  // the next object is on another server
+          break;
+        }
+
+        if (!isAnswered(*sock)) {
+          closed = true;
+          break;
+        }
+
+        HTTPParser header;
+        timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sock->readHeader(header);
+        HTTPResponse* response = checkResponse(*urls[next], header, 0, 0);
+        FdSink fdSink(fd);
+        CountingSink sink(fdSink);
+        unsigned int moved;
+        try {
+          moved = receiveBody(*response, *sock, sink, reusable);
+        } catch (std::string msg) {
+          bool canResume = !isCompressed(*response);
+          delete response;
+          if (!canResume || (sink.getLength() == 0)) {
+            throw msg;
+          }
+          resumeFrom = sink.getLength();
+          break;
+        }
+        delete response;
+        tuneReceiveBuffer(*sock, moved, start);
+
+        total += sink.getLength();
+        next++;
+        answered++;
+        window = depth;
+      }
+    } catch (std::string msg) {
+      pool.release(server, sock, false);
+      throw msg;
+    }
+
+    if (resumeFrom > 0) {
+      pool.release(server, sock, false);
+      // Finish the body on its own; the requests that were queued behind
+      // it go out again on a new connection.
+      FdSink sink(fd);
+      total += resumeFrom + resumeBody(*urls[next], sink, resumeFrom);
+      next++;
+      continue;
+    }
+
+    if (closed) {
+      pool.release(server, sock, false);
+      // An idle connection may have timed out in the pool, but a new one
+      // that answers nothing will not do better the next time.
+      if ((answered == 0) && !reused) {
+        throw std::string("SegmentFetcher Exception: connection closed "
+                          "before any response arrived");
+      }
+      continue;  // send the unanswered requests again
+    }
+
+    // Requests still in flight on a connection the server is closing are
+    // sent again on the next one.
+    pool.release(server, sock, reusable);
+  }
+
+  return total;
+}
+
+unsigned int SegmentFetcher::fetchBody(const URL& url, BodySink& sink,
+    unsigned int offset, unsigned int length, bool& canResume) {
+  TCPSocket* sock = NULL;
+  HTTPResponse* response = sendRequest(url, sock, offset, length);
+  bool reusable = false;
+  unsigned int total = 0;
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  try {
+    // Ranges count the bytes as sent, so a compressed body cannot be
+    // picked up in the middle: the decompressor's state would be lost.
+    canResume = !isCompressed(*response);
+    if ((length > 0) && (response->getStatusCode() == 200)) {
+      // The server ignored the Range and sends the whole object. The
+      // bytes around the ones asked for are read and dropped, so the
+      // connection can still be reused.
+      SliceSink slice(sink, offset, length);
+      total = receiveBody(*response, *sock, slice, reusable);
+    } else {
+      total = receiveBody(*response, *sock, sink, reusable);
+    }
+  } catch (std::string msg) {
+    delete response;
+    pool.release(url, sock, false);
+    throw msg;
+  }
+
+  delete response;
+  tuneReceiveBuffer(*sock, total, start);
+  pool.release(url, sock, reusable);
+  return total;
+}
+
+unsigned int SegmentFetcher::fetchResumable(const URL& url, BodySink& sink,
+    unsigned int offset, unsigned int length) {
+  CountingSink counter(sink);
+  bool canResume = false;
+
+  try {
+    fetchBody(url, counter, offset, length, canResume);
+  } catch (std::string msg) {
+    // A body that broke off is picked up where it stopped; anything else
+    // (unreachable server, 404, ...) is reported as it is.
+    if (!canResume || (counter.getLength() == 0)) {
+      throw msg;
+    }
+    unsigned int received = counter.getLength();
+    return received + resumeBody(url, sink, offset + received,
+                                 (length > 0) ? length - received : 0);
+  }
+
+  return counter.getLength();
+}
+
+unsigned int SegmentFetcher::resumeBody(const URL& url, BodySink& sink,
+    unsigned int offset, unsigned int length) {
+  CountingSink counter(sink);
+  unsigned int delay = FIRST_RESUME_DELAY;
+
+  for (unsigned int attempt = 1; ; attempt++) {
+    // Back off, so a server that is restarting or overloaded gets a
+    // moment to recover.
+    usleep(delay * 1000);
+    delay *= 2;
+
+    bool canResume = true;
+    try {
+      unsigned int received = counter.getLength();
+      fetchBody(url, counter, offset + received,
+                (length > 0) ? length - received : 0, canResume);
+      return counter.getLength();
+    } catch (std::string msg) {
+      if (!canResume || (attempt == MAX_RESUMES)) {
+        throw msg;
+      }
+    }
+  }
+}
+
+bool SegmentFetcher::isCompressed(const HTTPResponse& response) {
+  InflateSink::Format format;
+  return InflateSink::getFormat(
+      response.findHeaderValue(HTTPMessage::CONTENT_ENCODING), format);
+}
+
+HTTPRequest* SegmentFetcher::createRequest(const URL& url,
+    unsigned int offset, unsigned int length, const Validators* validators) {
+  // Ask for the path, plus the query if there is one.
+  std::string path = url.getPath();
+  if (!url.getQuery().empty()) {
+    path += '?';
+    path += url.getQuery();
+  }
+
+  std::ostringstream host;
+  host << url.getHost();
+  if (url.isPortDefined()) {
+    host << ':' << url.getPort();
+  }
+
+  HTTPRequest* request = HTTPRequest::createGetRequest(path);
+  request->setHost(host.str());
+  request->setKeepAlive(true);
+  // Playlists shrink a lot compressed; media segments are normally sent
+  // as they are whatever we say. A range (a resume, or a byte-range
+  // segment) is asked for uncompressed: its offsets count the bytes of the
+  // object as it is stored, and a compressed reply would be taken for them.
+  if (length > 0) {
+    request->setRange(offset, offset + length - 1);
+  } else if (offset > 0) {
+    request->setRange(offset);
+  } else {
+    request->setHeaderField("Accept-Encoding", "gzip, deflate");
+  }
+  if (validators != NULL) {
+    if (!validators->etag.empty()) {
+      request->setHeaderField("If-None-Match", validators->etag);
+    }
+    if (!validators->lastModified.empty()) {
+      request->setHeaderField("If-Modified-Since", validators->lastModified);
+    }
+  }
+  return request;
+}
+
+HTTPResponse* SegmentFetcher::checkResponse(const URL& url,
+    const HTTPParser& header, unsigned int offset, unsigned int length,
+    bool conditional) {
+  HTTPResponse* response = HTTPResponse::parse(header);
+  if (response == NULL) {
+    throw std::string("SegmentFetcher Exception: malformed response header");
+  }
+
+  // A resumed download needs the rest of the object, from the byte asked
+  // for; a server that ignores the Range and sends all of it again (200)
+  // cannot be used to resume. A bounded range is different: it can be
+  // cut out of the whole object, so the caller slices a 200.
+  if ((offset > 0) || (length > 0)) {
+    unsigned int first, last;
+    int objectLength;
+    if ((length > 0) && (response->getStatusCode() == 200)) {
+      return response;
+    }
+    if ((response->getStatusCode() != 206) ||
+        !response->getContentRange(first, last, objectLength) ||
+        (first != offset) ||
+        ((length > 0) && (last != offset + length - 1))) {
+      delete response;
+      throw std::string("SegmentFetcher Exception: server cannot resume "
+                        "the download");
+    }
+    return response;
+  }
+
+  // Our copy is still good; the caller keeps using it.
+  if (conditional && (response->getStatusCode() == 304)) {
+    return response;
+  }
+
+  // Handle 404 Not Found, 403 Forbidden and anything else that isn't a
+  // plain success the same way: report what the server said. The body is
+  // not read, so the connection cannot be reused.
+  if (response->getStatusCode() != 200) {
+    std::ostringstream msg;
+    msg << "SegmentFetcher Exception: " << url.getHost() << url.getPath()
+        << " returned " << response->getStatusCode() << " "
+        << response->getStatusDesc();
+    delete response;
+    throw msg.str();
+  }
+
+  return response;
+}
+
+unsigned int SegmentFetcher::receiveBody(const HTTPResponse& response,
+    TCPSocket& sock, BodySink& sink, bool& reusable) {
+  InflateSink::Format format;
+  if (!InflateSink::getFormat(response.findHeaderValue(
+          HTTPMessage::CONTENT_ENCODING), format)) {
+    return receiveEncodedBody(response, sock, sink, reusable);
+  }
+
+  // Decompress on the way to the sink, after any chunk framing is gone.
+  InflateSink inflater(sink, format);
+  unsigned int total = receiveEncodedBody(response, sock, inflater, reusable);
+  inflater.finish();
+  return total;
+}
+
+unsigned int SegmentFetcher::receiveEncodedBody(const HTTPResponse& response,
+    TCPSocket& sock, BodySink& sink, bool& reusable) {
+  unsigned int total = 0;
+  reusable = false;
+
+  if (response.isChunked()) {
+    // The framing is decoded in the socket's buffer; only the chunk data
+    // reaches the sink.
+    ChunkedDecoder decoder(sink);
+    decoder.receive(sock);
+    total = decoder.getBodyLength();
+    reusable = response.isKeepAlive();
+  } else {
+    int contentLen = response.getContentLen();
+    if (contentLen >= 0) {
+      while (total < static_cast<unsigned int>(contentLen)) {
+        int moved = sink.receive(sock, contentLen - total);
+        if (moved <= 0) {
+          throw std::string("SegmentFetcher Exception: connection closed "
+                            "before the whole body arrived");
+        }
+        total += moved;
+      }
+      reusable = response.isKeepAlive();
+    } else {  // no length given, the body ends when the server closes
+      int moved;
+      while ((moved = sink.receive(sock, BUFFER_SIZE)) > 0) {
+        total += moved;
+      }
+    }
+  }
+
+  return total;
+}
+
+bool SegmentFetcher::isAnswered(TCPSocket& sock) {
+  const char* data;
+  try {
+    return sock.peekData(data) > 0;
+  } catch (std::string msg) {
+    // A server closing with requests unread resets the connection.
+    return false;
+  }
+}
+
+HTTPResponse* SegmentFetcher::sendRequest(const URL& url, TCPSocket*& sock,
+    unsigned int offset, unsigned int length, const Validators* validators) {
+  HTTPRequest* request = createRequest(url, offset, length, validators);
+
+  // The header is parsed where it lands in the socket's buffer.
+  HTTPParser header;
+  while (true) {
+    bool reused;
+    sock = pool.acquire(url, reused);
+    try {
+      request->send(*sock);
+      sock->readHeader(header);
+      break;
+    } catch (std::string msg) {
+      pool.release(url, sock, false);
+      sock = NULL;
+      // A pooled connection can be closed by the server just as we reuse
+      // it. That is not a real failure, so try again; the pool hands out
+      // a fresh connection once the stale ones are used up.
+      if (!reused) {
+        delete request;
+        throw msg;
+      }
+    }
+  }
+  delete request;
+
+  try {
+    return checkResponse(url, header, offset, length,
+                         isConditional(validators));
+  } catch (std::string msg) {
+    pool.release(url, sock, false);
+    throw msg;
+  }
+}
+
+void SegmentFetcher::tuneReceiveBuffer(TCPSocket& sock, unsigned int bytes,
+    const timespec& start) {
+  if (!autoTune || tuned || (bytes < MIN_TUNE_BYTES)) {
+    return;
+  }
+
+  timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+  unsigned int rtt = sock.getRoundTripTime();  // microseconds
+  if ((seconds <= 0) || (rtt == 0)) {
+    return;
+  }
+  tuned = true;
+
+  // Bandwidth-delay product: what must be in flight to fill the pipe.
+  double bdp = (bytes / seconds) * (rtt / 1e6);
+  int size = (bdp > MAX_RECEIVE_BUFFER) ? MAX_RECEIVE_BUFFER :
+             static_cast<int>(bdp);
+  if (size < MIN_RECEIVE_BUFFER) {
+    size = MIN_RECEIVE_BUFFER;
+  }
+
+  // The kernel reports twice the usable size; if it already allows a full
+  // BDP in flight, its automatic sizing is doing fine, leave it alone.
+  if (sock.getReceiveBufferSize() >= 2 * size) {
+    return;
+  }
+
+  SocketOptions options = pool.getSocketOptions();
+  options.receiveBuffer = size;
+  pool.setSocketOptions(options);
+  try {
+    sock.setOptions(options);
+  } catch (std::string msg) {
+    // The next connections get it anyway; this one keeps its buffer.
+  }
+}
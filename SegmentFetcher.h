@@ -0,0 +1,387 @@
+/*********************************
+ * SegmentFetcher - Downloads playlists and media segments over HTTP for the
+ * streaming client. A playlist is small and has to be parsed, so it is
+ * downloaded into a string. A segment is only handed to the video player,
+ * so its body is moved from the socket straight into the player's pipe.
+ *
+ * Connections are kept alive and reused through a ConnectionPool, so fetching
+ * every segment of a playlist from one server costs a single handshake.
+ * Where the kernel supports io_uring, the fetcher's sockets do their I/O
+ * through a ring it owns (see TCPSocket::setThreadRing); otherwise they use
+ * the ordinary blocking calls.
+ *
+ * Several small objects, such as the variant playlists of a master
+ * playlist, can be downloaded at once with fetchAll, each over its own
+ * connection, all driven from this thread by an EventLoop.
+ *
+ * A segment download that breaks off in the middle is resumed with a Range
+ * request for the rest, a few times, backing off exponentially in between.
+ * A segment that is a byte range of a larger object (#EXT-X-BYTERANGE) is
+ * asked for with a bounded Range request; if the server ignores it and
+ * sends the whole object, only the bytes asked for are kept.
+ *
+ * Errors (unreachable server, bad response, non-200 status) are reported by
+ * throwing a std::string, like TCPSocket does.
+ *********************************/
+
+#ifndef _SEGMENT_FETCHER_H_
+#define _SEGMENT_FETCHER_H_
+
+#include "BodySink.h"
+#include "ConnectionPool.h"
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include "TCPSocket.h"
+#include "URL.h"
+#include <ctime>
+#include <string>
+#include <vector>
+
+class SegmentFetcher {
+ public:
+  /*********************************
+   * Name:    SegmentFetcher
+   * Purpose: Constructor of SegmentFetcher class objects. Sets up an
+   *          io_uring for the calling thread's sockets if the kernel has
+   *          one to offer.
+   * Receive: None
+   * Return:  None
+   *********************************/
+  SegmentFetcher();
+
+  /*********************************
+   * Name:    ~SegmentFetcher
+   * Purpose: Destructor of SegmentFetcher class objects, closes the pooled
+   *          connections before tearing down the ring they use
+   * Receive: None
+   * Return:  None
+   *********************************/
+  ~SegmentFetcher();
+
+  // What identifies the copy of an object we already have, from the
+  // response it came in, so a later request can ask for it only if it
+  // has changed.
+  struct Validators {
+    std::string etag;          // the ETag header, empty if none was sent
+    std::string lastModified;  // the Last-Modified header, or empty
+  };
+
+  /*********************************
+   * Name:    fetch
+   * Purpose: Downloads the object at url into a string. If the connection
+   *          fails partway through an uncompressed body, the rest is asked
+   *          for with a Range request, as in fetchToDescriptor.
+   * Receive: url - the object to download
+   *          body - will be set to the response body
+   * Return:  None
+   *********************************/
+  void fetch(const URL& url, std::string& body);
+
+  /*********************************
+   * Name:    fetchIfChanged
+   * Purpose: Downloads the object at url into a string, unless it is the
+   *          same as the copy the validators came from. They are sent as
+   *          If-None-Match and If-Modified-Since, and a server with
+   *          nothing new answers 304 Not Modified without a body.
+   * Receive: url - the object to download
+   *          body - set to the new response body; left as it was if the
+   *                 object has not changed
+   *          validators - those of the copy in body, empty for none.
+   *                       Replaced by the new response's.
+   * Return:  true if a new copy is in body, false if the object has not
+   *          changed
+   *********************************/
+  bool fetchIfChanged(const URL& url, std::string& body,
+                      Validators& validators);
+
+  /*********************************
+   * Name:    fetchAll
+   * Purpose: Downloads several objects into strings at the same time,
+   *          each over a new connection, instead of one after the other.
+   *          The connections are kept in the pool afterwards. Only bodies
+   *          sent with a Content-Length can be read this way; an object
+   *          sent chunked, or one that fails or runs out of time, is left
+   *          for the caller to download with fetch().
+   * Receive: urls - the objects to download
+   *          bodies - set to the bodies, in the order of urls; empty for
+   *                   the objects that could not be downloaded
+   *          timeoutMs - how long the downloads may take altogether
+   * Return:  the number of objects downloaded
+   *********************************/
+  unsigned int fetchAll(const std::vector<URL*>& urls,
+                        std::vector<std::string>& bodies, int timeoutMs);
+
+  /*********************************
+   * Name:    fetchToDescriptor
+   * Purpose: Downloads the object at url and writes its body to fd. When
+   *          fd is a pipe and the body is not compressed, it never passes
+   *          through user space. If the connection fails partway through
+   *          the body, the rest is asked for with a Range request.
+   * Receive: url - the object to download
+   *          fd - the descriptor to write the body to
+   * Return:  the number of body bytes written
+   *********************************/
+  unsigned int fetchToDescriptor(const URL& url, int fd);
+
+  /*********************************
+   * Name:    fetchRangeToDescriptor
+   * Purpose: Downloads a run of bytes of the object at url and writes them
+   *          to fd, as fetchToDescriptor does for a whole object
+   * Receive: url - the object to download from
+   *          offset - the first byte wanted
+   *          length - how many bytes are wanted; 0 for the rest of the
+   *                   object
+   *          fd - the descriptor to write the bytes to
+   * Return:  the number of bytes written
+   *********************************/
+  unsigned int fetchRangeToDescriptor(const URL& url, unsigned int offset,
+                                      unsigned int length, int fd);
+
+  /*********************************
+   * Name:    fetchPipelined
+   * Purpose: Downloads several objects and writes their bodies to fd, in
+   *          order, pipelining the requests: up to depth GETs are written
+   *          back to back on one connection and the responses are read as
+   *          they arrive, so a run of objects on one server does not wait
+   *          a round trip for each. A new connection gets one request at a
+   *          time until a response shows the server keeps it open.
+   *
+   *          If the server closes the connection before answering all of
+   *          the requests on it, the unanswered ones are sent again on
+   *          another connection. A body cut off in the middle is resumed
+   *          on its own, as in fetchToDescriptor, before the rest go on.
+   * Receive: urls - the objects to download
+   *          fd - the descriptor to write the bodies to
+   *          depth - the most requests in flight on a connection
+   * Return:  the number of body bytes written
+   *********************************/
+  unsigned int fetchPipelined(const std::vector<URL*>& urls, int fd,
+                              unsigned int depth);
+
+  /*********************************
+   * Name:    setSocketOptions
+   * Purpose: Sets the tuning options for the connections made from now on
+   * Receive: options - the options
+   * Return:  None
+   *********************************/
+  void setSocketOptions(const SocketOptions& options) {
+    pool.setSocketOptions(options);
+  }
+
+  /*********************************
+   * Name:    setAutoTuneBuffers
+   * Purpose: Turns on receive buffer sizing by bandwidth-delay product. The
+   *          first body of at least MIN_TUNE_BYTES is timed, and its
+   *          throughput times the connection's round trip time gives the
+   *          amount of data in flight a buffer has to hold to keep the
+   *          link busy. If that is more than the kernel gave the socket,
+   *          the buffer of that connection and of every later one is
+   *          enlarged to match.
+   * Receive: autoTune - true to size the buffers
+   * Return:  None
+   *********************************/
+  void setAutoTuneBuffers(bool autoTune) {
+    this->autoTune = autoTune;
+    tuned = false;
+  }
+
+ private:
+  // Bodies smaller than this finish too quickly to measure throughput.
+  static const unsigned int MIN_TUNE_BYTES = 256 * 1024;
+  // Bounds of the receive buffer chosen by auto-tuning.
+  static const int MIN_RECEIVE_BUFFER = 64 * 1024;
+  static const int MAX_RECEIVE_BUFFER = 16 * 1024 * 1024;
+
+  // How often a broken-off body is resumed, and the wait (ms) before the
+  // first attempt; each later attempt waits twice as long.
+  static const unsigned int MAX_RESUMES = 4;
+  static const unsigned int FIRST_RESUME_DELAY = 100;
+
+  // Size of the ring: a few sockets are open at a time, each needing two
+  // buffers and issuing at most two operations per submission.
+  static const unsigned int RING_ENTRIES = 32;
+  static const unsigned int RING_BUFFERS = 16;
+
+  // Drives the downloads of fetchAll on an EventLoop.
+  class ConcurrentFetch;
+
+  IoRing* ring;  // NULL if io_uring is unavailable
+  ConnectionPool pool;
+  bool autoTune;
+  bool tuned;  // the buffer size has been settled
+
+  /*********************************
+   * Name:    tuneReceiveBuffer
+   * Purpose: Sizes the receive buffers from a timed body, if auto-tuning
+   *          is on and has not been done yet
+   * Receive: sock - the connection the body came over
+   *          bytes - the size of the body
+   *          start - when the first byte of the body was asked for
+   * Return:  None
+   *********************************/
+  void tuneReceiveBuffer(TCPSocket& sock, unsigned int bytes,
+                         const timespec& start);
+
+  /*********************************
+   * Name:    fetchBody
+   * Purpose: Downloads the object at url, or a run of its bytes, into a
+   *          sink
+   * Receive: url - the object to download
+   *          sink - where the body goes
+   *          offset - the first byte wanted; 0 for the whole object
+   *          length - how many bytes are wanted; 0 for the rest of the
+   *                   object
+   *          canResume - set once the response header is in: true if a
+   *                      failure in the body could be resumed with a
+   *                      Range request. Untouched if no header arrived.
+   * Return:  the number of body bytes received
+   *********************************/
+  unsigned int fetchBody(const URL& url, BodySink& sink, unsigned int offset,
+                         unsigned int length, bool& canResume);
+
+  /*********************************
+   * Name:    fetchResumable
+   * Purpose: Downloads the object at url, or a run of its bytes, into a
+   *          sink with fetchBody, and has resumeBody pick the body up if
+   *          it breaks off partway through
+   * Receive: url - the object to download
+   *          sink - where the body goes
+   *          offset - the first byte wanted; 0 for the whole object
+   *          length - how many bytes are wanted; 0 for the rest of the
+   *                   object
+   * Return:  the number of body bytes written to the sink
+   *********************************/
+  unsigned int fetchResumable(const URL& url, BodySink& sink,
+                              unsigned int offset, unsigned int length);
+
+  /*********************************
+   * Name:    resumeBody
+   * Purpose: Downloads the rest of an object whose body broke off, with
+   *          up to MAX_RESUMES Range requests, waiting FIRST_RESUME_DELAY
+   *          ms before the first and twice as long before each next one.
+   *          Every attempt carries on from where the previous one stopped.
+   * Receive: url - the object to download
+   *          sink - where the rest of the body goes
+   *          offset - the first byte not received yet
+   *          length - how many bytes are still wanted; 0 for the rest of
+   *                   the object
+   * Return:  the number of body bytes written to the sink. Throws the
+   *          last failure as a std::string if every attempt fails.
+   *********************************/
+  unsigned int resumeBody(const URL& url, BodySink& sink,
+                          unsigned int offset, unsigned int length = 0);
+
+  /*********************************
+   * Name:    isCompressed
+   * Purpose: Checks whether a response has a Content-Encoding to undo
+   * Receive: response - the response's header
+   * Return:  true if the body is compressed
+   *********************************/
+  static bool isCompressed(const HTTPResponse& response);
+
+  /*********************************
+   * Name:    createRequest
+   * Purpose: Builds a keep-alive GET request for url, offering gzip and
+   *          deflate only when the whole object is asked for
+   * Receive: url - the object to request
+   *          offset - the first byte wanted; above 0 adds a Range header
+   *          length - how many bytes are wanted; above 0 adds a Range
+   *                   header with a last byte. 0 for the rest.
+   *          validators - if not NULL, the copy we have, to make the
+   *                       request conditional on the object having changed
+   * Return:  the request; the caller deletes it
+   *********************************/
+  static HTTPRequest* createRequest(const URL& url, unsigned int offset = 0,
+                                    unsigned int length = 0,
+                                    const Validators* validators = NULL);
+
+  /*********************************
+   * Name:    isConditional
+   * Purpose: Checks whether a request with these validators would be
+   *          conditional, i.e. whether there are any
+   * Receive: validators - the validators, may be NULL
+   * Return:  true if the request can be answered with 304 Not Modified
+   *********************************/
+  static bool isConditional(const Validators* validators) {
+    return (validators != NULL) &&
+           (!validators->etag.empty() || !validators->lastModified.empty());
+  }
+
+  /*********************************
+   * Name:    checkResponse
+   * Purpose: Builds the response from a received header and makes sure it
+   *          is a 200, for a Range request a 206 covering the bytes asked
+   *          for, or for a conditional request a 304. A bounded Range may
+   *          also be answered with a 200, the whole object.
+   * Receive: url - the object that was requested, for the error message
+   *          header - the parsed header
+   *          offset - the first byte asked for
+   *          length - how many bytes were asked for; 0 for the rest
+   *          conditional - true if the request had validators
+   * Return:  the response; the caller deletes it. Throws a std::string if
+   *          the header is malformed or the status is not as expected.
+   *********************************/
+  static HTTPResponse* checkResponse(const URL& url, const HTTPParser& header,
+                                     unsigned int offset,
+                                     unsigned int length = 0,
+                                     bool conditional = false);
+
+  /*********************************
+   * Name:    receiveBody
+   * Purpose: Moves the body of a response from the socket to a sink,
+   *          decompressing it if the server used a Content-Encoding
+   * Receive: response - the response's header
+   *          sock - the connection
+   *          sink - where the body goes
+   *          reusable - set to true if the connection can carry another
+   *                     response afterwards
+   * Return:  the number of body bytes received, as sent by the server
+   *********************************/
+  unsigned int receiveBody(const HTTPResponse& response, TCPSocket& sock,
+                           BodySink& sink, bool& reusable);
+
+  /*********************************
+   * Name:    receiveEncodedBody
+   * Purpose: Moves the body of a response from the socket to a sink as
+   *          it was sent, however the server delimited it
+   * Receive: response - the response's header
+   *          sock - the connection
+   *          sink - where the body goes
+   *          reusable - set to true if the connection can carry another
+   *                     response afterwards
+   * Return:  the number of body bytes received
+   *********************************/
+  unsigned int receiveEncodedBody(const HTTPResponse& response,
+                                  TCPSocket& sock, BodySink& sink,
+                                  bool& reusable);
+
+  /*********************************
+   * Name:    isAnswered
+   * Purpose: Waits for a response to start arriving on a connection with
+   *          requests in flight
+   * Receive: sock - the connection
+   * Return:  true if there is data to read, false if the server closed
+   *          (or reset) the connection instead
+   *********************************/
+  static bool isAnswered(TCPSocket& sock);
+
+  /*********************************
+   * Name:    sendRequest
+   * Purpose: Takes a connection to the server from the pool, sends a GET
+   *          for url and receives the response header. Fails unless the
+   *          status is 200 (206 for a Range request, or 304 for a
+   *          conditional one).
+   * Receive: url - the object to request
+   *          sock - set to the connection used; the caller gives it back
+   *                 to the pool once the body has been read
+   *          offset - the first byte wanted; 0 for the whole object
+   *          length - how many bytes are wanted; 0 for the rest
+   *          validators - if not NULL, the copy we have, see createRequest
+   * Return:  the parsed response header; the caller deletes it
+   *********************************/
+  HTTPResponse* sendRequest(const URL& url, TCPSocket*& sock,
+                            unsigned int offset = 0, unsigned int length = 0,
+                            const Validators* validators = NULL);
+};
+
+#endif  // _SEGMENT_FETCHER_H_
@@ -0,0 +1,128 @@
+#include "SegmentIndex.h"
+
+namespace {
+  // Every this many entries, a URL is stored whole.
+  const unsigned int RESTART_INTERVAL = 16;
+
+  // The longest shared prefix a stored entry can record.
+  const unsigned int MAX_PREFIX = 0xffff;
+}
+
+SegmentIndex::SegmentIndex() : first(0) {
+}
+
+void SegmentIndex::reserve(unsigned int count) {
+  count += durations.size();
+  durations.reserve(count);
+  suffixOffsets.reserve(count);
+  prefixLengths.reserve(count);
+}
+
+void SegmentIndex::append(const char* url, unsigned int length,
+                          unsigned int durationMs, unsigned int rangeOffset,
+                          unsigned int rangeLength) {
+  // The entries before the first byte range are whole objects.
+  if ((rangeLength > 0) || hasRanges()) {
+    rangeOffsets.resize(durations.size(), 0);
+    rangeLengths.resize(durations.size(), 0);
+    rangeOffsets.push_back(rangeOffset);
+    rangeLengths.push_back(rangeLength);
+  }
+
+  unsigned int prefix = 0;
+  if (durations.size() % RESTART_INTERVAL != 0) {
+    unsigned int limit = (length < lastUrl.size()) ? length : lastUrl.size();
+    if (limit > MAX_PREFIX) {
+      limit = MAX_PREFIX;
+    }
+    while ((prefix < limit) && (url[prefix] == lastUrl[prefix])) {
+      prefix++;
+    }
+  }
+
+  durations.push_back(durationMs);
+  suffixOffsets.push_back(arena.size());
+  prefixLengths.push_back(prefix);
+  arena.append(url + prefix, length - prefix);
+  lastUrl.assign(url, length);
+}
+
+void SegmentIndex::dropFront(unsigned int count) {
+  if (count >= size()) {
+    clear();
+    return;
+  }
+
+  // Dropped entries are only skipped until they outnumber the kept ones,
+  // so storing the rest again costs a constant per dropped entry.
+  first += count;
+  if (first >= size()) {
+    compact();
+  }
+}
+
+void SegmentIndex::clear() {
+  durations.clear();
+  suffixOffsets.clear();
+  prefixLengths.clear();
+  arena.clear();
+  lastUrl.clear();
+  rangeOffsets.clear();
+  rangeLengths.clear();
+  first = 0;
+}
+
+bool SegmentIndex::getRange(unsigned int segment, unsigned int& offset,
+                            unsigned int& length) const {
+  unsigned int entry = first + segment;
+  if ((entry >= rangeLengths.size()) || (rangeLengths[entry] == 0)) {
+    return false;
+  }
+  offset = rangeOffsets[entry];
+  length = rangeLengths[entry];
+  return true;
+}
+
+void SegmentIndex::getUrl(unsigned int segment, std::string& url) const {
+  // Start from the last URL stored whole, and replay the entries after it.
+  unsigned int entry = first + segment;
+  unsigned int restart = entry - entry % RESTART_INTERVAL;
+  unsigned int length;
+  const char* suffix = getSuffix(restart, length);
+  url.assign(suffix, length);
+  for (unsigned int i = restart + 1; i <= entry; i++) {
+    suffix = getSuffix(i, length);
+    url.resize(prefixLengths[i]);
+    url.append(suffix, length);
+  }
+}
+
+const char* SegmentIndex::getSuffix(unsigned int entry,
+                                    unsigned int& length) const {
+  unsigned int end = (entry + 1 < suffixOffsets.size()) ?
+      suffixOffsets[entry + 1] : arena.size();
+  length = end - suffixOffsets[entry];
+  return arena.data() + suffixOffsets[entry];
+}
+
+void SegmentIndex::compact() {
+  SegmentIndex kept;
+  kept.reserve(size());
+  std::string url;
+  for (unsigned int i = 0; i < size(); i++) {
+    unsigned int offset = 0;
+    unsigned int length = 0;
+    getRange(i, offset, length);
+    getUrl(i, url);
+    kept.append(url.data(), url.size(), getDurationMs(i), offset, length);
+  }
+
+  durations.swap(kept.durations);
+  suffixOffsets.swap(kept.suffixOffsets);
+  prefixLengths.swap(kept.prefixLengths);
+  arena.swap(kept.arena);
+  lastUrl.swap(kept.lastUrl);
+  rangeOffsets.swap(kept.rangeOffsets);
+  rangeLengths.swap(kept.rangeLengths);
+  first = 0;
+}
@@ -0,0 +1,155 @@
+/*********************************
+ * SegmentIndex - The segments of a playlist, stored compactly: durations in
+ * one array, and URLs in a single string arena instead of a std::string (and
+ * a heap block) per segment. It should be considered internal to the
+ * Playlist class's implementation.
+ *
+ * Consecutive segment URLs usually differ only near the end
+ * (".../segment000123.ts", ".../segment000124.ts"), so each URL is stored as
+ * the length of the prefix it shares with the URL before it, plus the rest.
+ * Every RESTART_INTERVAL-th URL is stored whole, so rebuilding any URL takes
+ * at most that many steps.
+ *
+ * A segment may be a byte range of its URL (#EXT-X-BYTERANGE). The range
+ * arrays are only filled once the first such segment is appended, so a
+ * playlist without any costs nothing for them.
+ *********************************/
+
+#ifndef _SEGMENT_INDEX_H_
+#define _SEGMENT_INDEX_H_
+
+#include <string>
+#include <vector>
+
+class SegmentIndex {
+ public:
+  /*********************************
+   * Name:    SegmentIndex
+   * Purpose: Constructor of SegmentIndex objects; the index starts empty
+   * Receive: None
+   * Return:  None
+   *********************************/
+  SegmentIndex();
+
+  /*********************************
+   * Name:    reserve
+   * Purpose: Makes room for a number of segments, so appending them does
+   *          not grow the arrays along the way
+   * Receive: count - the number of segments to make room for
+   * Return:  None
+   *********************************/
+  void reserve(unsigned int count);
+
+  /*********************************
+   * Name:    append
+   * Purpose: Adds a segment at the end
+   * Receive: url, length - the characters of the segment's URL, as written
+   *                        in the playlist
+   *          durationMs - how long the segment plays for
+   *          rangeOffset - where the segment starts in the URL's object
+   *          rangeLength - the segment's size in bytes; 0 if it is the
+   *                        whole object
+   * Return:  None
+   *********************************/
+  void append(const char* url, unsigned int length, unsigned int durationMs,
+              unsigned int rangeOffset = 0, unsigned int rangeLength = 0);
+
+  /*********************************
+   * Name:    dropFront
+   * Purpose: Forgets the first segments; the rest move up
+   * Receive: count - how many to forget
+   * Return:  None
+   *********************************/
+  void dropFront(unsigned int count);
+
+  /*********************************
+   * Name:    clear
+   * Purpose: Forgets every segment
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void clear();
+
+  /*********************************
+   * Name:    size
+   * Purpose: Counts the segments
+   * Receive: None
+   * Return:  the number of segments
+   *********************************/
+  unsigned int size() const {
+    return durations.size() - first;
+  }
+
+  /*********************************
+   * Name:    getDurationMs
+   * Purpose: Looks up how long a segment plays for
+   * Receive: segment - which segment, below size()
+   * Return:  the duration in milliseconds
+   *********************************/
+  unsigned int getDurationMs(unsigned int segment) const {
+    return durations[first + segment];
+  }
+
+  /*********************************
+   * Name:    getRange
+   * Purpose: Looks up the byte range of a segment
+   * Receive: segment - which segment, below size()
+   *          offset - set to where the segment starts in its object
+   *          length - set to the segment's size in bytes
+   * Return:  true if the segment is a byte range, false if it is the whole
+   *          object (offset and length are then left alone)
+   *********************************/
+  bool getRange(unsigned int segment, unsigned int& offset,
+                unsigned int& length) const;
+
+  /*********************************
+   * Name:    hasRanges
+   * Purpose: Checks whether any segment appended is a byte range
+   * Receive: None
+   * Return:  true if some segment is
+   *********************************/
+  bool hasRanges() const {
+    return !rangeLengths.empty();
+  }
+
+  /*********************************
+   * Name:    getUrl
+   * Purpose: Rebuilds the URL of a segment, as written in the playlist
+   * Receive: segment - which segment, below size()
+   *          url - set to the URL
+   * Return:  None
+   *********************************/
+  void getUrl(unsigned int segment, std::string& url) const;
+
+ private:
+  // Stored entries; the first `first` of them have been dropped, and are
+  // only reclaimed when enough pile up.
+  std::vector<unsigned int> durations;
+  std::vector<unsigned int> suffixOffsets;     // into arena
+  std::vector<unsigned short> prefixLengths;   // shared with the entry before
+  std::string arena;                           // the unshared URL suffixes
+  std::string lastUrl;                         // the URL appended last
+  std::vector<unsigned int> rangeOffsets;      // empty until a range comes
+  std::vector<unsigned int> rangeLengths;      // 0 for a whole object
+  unsigned int first;
+
+  /*********************************
+   * Name:    getSuffix
+   * Purpose: Finds the stored part of an entry's URL in the arena
+   * Receive: entry - the entry, counting dropped ones
+   *          length - set to the length of the stored part
+   * Return:  where the stored part starts
+   *********************************/
+  const char* getSuffix(unsigned int entry, unsigned int& length) const;
+
+  /*********************************
+   * Name:    compact
+   * Purpose: Reclaims the room taken by dropped entries, by storing the
+   *          others again
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void compact();
+};
+
+#endif  // _SEGMENT_INDEX_H_
@@ -0,0 +1,60 @@
+#include "SocketOptions.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
+
+SocketOptions::SocketOptions()
+    : noDelay(false), quickAck(false), reuseAddress(true), receiveBuffer(0),
+      sendBuffer(0), receiveTimeout(0) {
+}
+
+void SocketOptions::apply(int fd) const {
+  int on = 1;
+
+  if (noDelay &&
+      (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)) {
+    throw std::string("SocketOptions Exception: Unable to set TCP_NODELAY");
+  }
+  if ((receiveBuffer > 0) && (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+      &receiveBuffer, sizeof(receiveBuffer)) < 0)) {
+    throw std::string("SocketOptions Exception: Unable to set SO_RCVBUF");
+  }
+  if ((sendBuffer > 0) && (setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+      &sendBuffer, sizeof(sendBuffer)) < 0)) {
+    throw std::string("SocketOptions Exception: Unable to set SO_SNDBUF");
+  }
+  if (!congestion.empty() && (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION,
+      congestion.data(), congestion.size()) < 0)) {
+    throw std::string("SocketOptions Exception: congestion control ") +
+        congestion + " is not available";
+  }
+  if (receiveTimeout > 0) {
+    struct timeval timeout;
+    timeout.tv_sec = receiveTimeout / 1000;
+    timeout.tv_usec = (receiveTimeout % 1000) * 1000;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout)) < 0) {
+      throw std::string("SocketOptions Exception: Unable to set SO_RCVTIMEO");
+    }
+  }
+  applyQuickAck(fd);
+}
+
+void SocketOptions::applyQuickAck(int fd) const {
+  if (quickAck) {
+    int on = 1;
+    // Only a hint; a failure just means delayed acks as usual.
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+  }
+}
+
+void SocketOptions::applyReuseAddress(int fd) const {
+  int on = 1;
+
+  if (reuseAddress &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)) {
+    throw std::string("SocketOptions Exception: Unable to set SO_REUSEADDR");
+  }
+}
@@ -0,0 +1,82 @@
+/*********************************
+ * SocketOptions - The tuning knobs of a TCP socket, collected so they can
+ * be handed to a TCPSocket (or a ConnectionPool) once and applied to every
+ * socket it creates. Everything defaults to what the kernel would pick, so
+ * a default-constructed SocketOptions changes nothing except allowing a
+ * listening socket to rebind its port while old connections linger.
+ *********************************/
+
+#ifndef _SOCKET_OPTIONS_H_
+#define _SOCKET_OPTIONS_H_
+
+#include <string>
+
+class SocketOptions {
+ public:
+  // Send small writes right away instead of waiting to coalesce them
+  // (TCP_NODELAY). Helps request/response traffic such as HTTP headers.
+  bool noDelay;
+
+  // Acknowledge every received segment immediately instead of delaying
+  // acks (TCP_QUICKACK). The kernel clears this after a while, so it is
+  // set again after every read.
+  bool quickAck;
+
+  // Let Bind take a port that still has connections in TIME_WAIT
+  // (SO_REUSEADDR). Only used by Bind.
+  bool reuseAddress;
+
+  // Socket buffer sizes in bytes (SO_RCVBUF/SO_SNDBUF), 0 to leave the
+  // kernel's automatic sizing alone. The kernel doubles the value and
+  // caps it at net.core.rmem_max/wmem_max.
+  int receiveBuffer;
+  int sendBuffer;
+
+  // The congestion control algorithm (TCP_CONGESTION), e.g. "cubic" or
+  // "bbr", empty for the system default.
+  std::string congestion;
+
+  // How long a read may wait for data, in milliseconds (SO_RCVTIMEO), 0
+  // to wait forever. A read that times out fails like any other, e.g. so
+  // a server can drop an idle keep-alive connection.
+  int receiveTimeout;
+
+  /*********************************
+   * Name:    SocketOptions
+   * Purpose: Constructor, leaves every option at the kernel default except
+   *          reuseAddress, which is on
+   * Receive: None
+   * Return:  None
+   *********************************/
+  SocketOptions();
+
+  /*********************************
+   * Name:    apply
+   * Purpose: Sets every non-default option on a socket. Buffer sizes
+   *          should be set before connecting, since the window scale is
+   *          agreed on during the handshake.
+   * Receive: fd - the socket
+   * Return:  None, throws a std::string if an option is refused, e.g. an
+   *          unknown congestion control algorithm
+   *********************************/
+  void apply(int fd) const;
+
+  /*********************************
+   * Name:    applyQuickAck
+   * Purpose: Turns TCP_QUICKACK back on if it is wanted; cheap to call
+   *          after every read
+   * Receive: fd - the socket
+   * Return:  None
+   *********************************/
+  void applyQuickAck(int fd) const;
+
+  /*********************************
+   * Name:    applyReuseAddress
+   * Purpose: Sets SO_REUSEADDR if it is wanted, before binding
+   * Receive: fd - the socket
+   * Return:  None, throws a std::string if the option is refused
+   *********************************/
+  void applyReuseAddress(int fd) const;
+};
+
+#endif  // _SOCKET_OPTIONS_H_
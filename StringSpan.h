@@ -0,0 +1,99 @@
+/*********************************
+ * StringSpan - A read-only view of characters that live somewhere else, such
+ * as a header value inside an HTTPMessage or a line of a received buffer.
+ * Nothing is copied or allocated; the span is only valid as long as the
+ * memory it points to is left alone.
+ *********************************/
+
+#ifndef _STRING_SPAN_H_
+#define _STRING_SPAN_H_
+
+#include <strings.h>
+#include <string.h>
+#include <string>
+
+struct StringSpan {
+  const char* data;
+  unsigned length;
+
+  StringSpan() : data(NULL), length(0) {
+  }
+
+  StringSpan(const char* data, unsigned length) : data(data), length(length) {
+  }
+
+  /*********************************
+   * Name:    empty
+   * Purpose: Checks if the span has no characters
+   * Receive: None
+   * Return:  true if the length is 0
+   *********************************/
+  bool empty() const {
+    return length == 0;
+  }
+
+  /*********************************
+   * Name:    str
+   * Purpose: Copies the characters into a std::string, for callers that
+   *          need to keep them
+   * Receive: None
+   * Return:  the copy
+   *********************************/
+  std::string str() const {
+    return (data == NULL) ? std::string() : std::string(data, length);
+  }
+
+  /*********************************
+   * Name:    equals
+   * Purpose: Compares the span with another, case and all
+   * Receive: other - the span to compare with
+   * Return:  true if they are equal
+   *********************************/
+  bool equals(const StringSpan& other) const {
+    return (length == other.length) &&
+           (memcmp(data, other.data, length) == 0);
+  }
+
+  /*********************************
+   * Name:    startsWith
+   * Purpose: Checks if the span begins with a prefix, case and all, e.g. a
+   *          playlist line with a tag
+   * Receive: prefix - the span to look for
+   * Return:  true if the span starts with the prefix
+   *********************************/
+  bool startsWith(const StringSpan& prefix) const {
+    return (length >= prefix.length) &&
+           (memcmp(data, prefix.data, prefix.length) == 0);
+  }
+
+  /*********************************
+   * Name:    equalsIgnoreCase
+   * Purpose: Compares the span with a string, ignoring case, as HTTP
+   *          does for header names and most tokens
+   * Receive: other, otherLength - the string to compare with
+   * Return:  true if they are equal
+   *********************************/
+  bool equalsIgnoreCase(const char* other, unsigned otherLength) const {
+    return (length == otherLength) &&
+           (strncasecmp(data, other, length) == 0);
+  }
+
+  /*********************************
+   * Name:    containsIgnoreCase
+   * Purpose: Searches the span for a token, ignoring case, e.g. "close"
+   *          in a Connection header or "chunked" in Transfer-Encoding
+   * Receive: token - the NUL-terminated token
+   * Return:  true if the token occurs in the span
+   *********************************/
+  bool containsIgnoreCase(const char* token) const {
+    unsigned tokenLength = strlen(token);
+    for (unsigned i = 0; i + tokenLength <= length; i++) {
+      if (strncasecmp(data + i, token, tokenLength) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif  // _STRING_SPAN_H_
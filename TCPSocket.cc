@@ -1,62 +1,111 @@
 #include "TCPSocket.h"
+#include "ByteScanner.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/sendfile.h>
 #include <sstream>
+#include <vector>
 
-void TCPSocket::createSocket() {
+namespace {
+  // The ring new sockets on this thread attach to, see setThreadRing.
+  __thread IoRing* threadRing = NULL;
+}
+
+void TCPSocket::createSocket(int family) {
   // close the socket if it's already open
   Close();
 
   // first try to make the TCP socket
-  sock = socket(AF_INET, SOCK_STREAM, 0);
+  sock = socket(family, SOCK_STREAM, 0);
   if (sock < 0) {
     throw std::string("TCPSocket Exception: Unable to create socket");
   }
+  try {
+    options.apply(sock);
+  } catch (std::string msg) {
+    Close();
+    throw msg;
+  }
+  nonBlocking = false;
+  attachRing();
 }
 
 void TCPSocket::Connect(const std::string& serverName,
     unsigned short serverPort) {
-  hostent *hostEnt;
+  std::vector<Resolver::Address> addresses;
+
+  // convert the server name to valid inet addresses (IPv4 and/or IPv6)
+  Resolver::resolve(serverName, serverPort, addresses);
+
+  // Try them in the order the resolver prefers; only give up once every
+  // one of them has failed.
+  for (size_t i = 0; i < addresses.size(); i++) {
+    try {
+      Connect(addresses[i]);
+      return;
+    } catch (std::string msg) {
+      if (i + 1 == addresses.size()) {
+        throw msg;
+      }
+    }
+  }
+}
 
-  createSocket();  // create a socket
+void TCPSocket::Connect(hostent *host, unsigned short serverPort) {
+  Resolver::Address address;
 
-  // convert the server name to a valid inet address
-  if ((hostEnt = gethostbyname(serverName.c_str())) == NULL) {
-    throw std::string("TCPSocket Exception: could not resolve hostname");
+  // make sure it's zero to start
+  memset(&address, 0, sizeof(address));
+  if (host->h_addrtype == AF_INET6) {
+    sockaddr_in6 *addr6 = (sockaddr_in6 *) &address.addr;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(serverPort);
+    memcpy(&addr6->sin6_addr, host->h_addr, host->h_length);
+    address.length = sizeof(sockaddr_in6);
+  } else {
+    sockaddr_in *addr4 = (sockaddr_in *) &address.addr;
+    // designate it as part of the Internet address family
+    addr4->sin_family = AF_INET;
+    // specify the port, host to network short
+    addr4->sin_port = htons(serverPort);
+    // specify the server IP address in network byte order
+    memcpy(&addr4->sin_addr, host->h_addr, host->h_length);
+    address.length = sizeof(sockaddr_in);
   }
 
-  Connect(hostEnt, serverPort);
+  Connect(address);
 }
 
-void TCPSocket::Connect(hostent *host, unsigned short serverPort) {
+void TCPSocket::Connect(const Resolver::Address& address) {
   // create the socket
-  createSocket();
+  createSocket(address.addr.ss_family);
 
-  // make sure it's zero to start
-  memset(&serverAddr, 0, sizeof(serverAddr));
-  // designate it as part of the Internet address family
-  serverAddr.sin_family = AF_INET;
-  // specify the port, host to network short
-  serverAddr.sin_port = htons(serverPort);
-  // specify the server IP address in network byte order
-  memcpy(&serverAddr.sin_addr, host->h_addr, host->h_length);
+  memcpy(&serverAddr, &address.addr, address.length);
 
   // now actually try to connect
-  if (connect(sock, (struct sockaddr *) &serverAddr, sizeof(serverAddr)) < 0) {
+  int status;
+  if (ring != NULL) {
+    ring->prepareConnect(sock, (struct sockaddr *) &serverAddr,
+                         address.length, 0);
+    ring->complete(&status, 1);
+  } else {
+    status = connect(sock, (struct sockaddr *) &serverAddr, address.length);
+  }
+  if (status < 0) {
+    Close();
     throw std::string("TCPSocket Exception: connect failed");
   }
 }
 
 void TCPSocket::Connect(const URL& url) {
-  hostent *hp = gethostbyname(url.getHost().c_str());
-
-  if (hp == NULL) {
-    throw std::string("TCPSocket Exception: Unable to resolve URL");
-  } else {  // URL resolved successfully
-    // If the port is not defined, connect to 80
-    if (url.isPortDefined()) {
-      Connect(hp, url.getPort());
-    } else {
-      Connect(hp, 80);
-    }
+  // If the port is not defined, connect to 80
+  if (url.isPortDefined()) {
+    Connect(url.getHost(), url.getPort());
+  } else {
+    Connect(url.getHost(), 80);
   }
 }
 
@@ -64,23 +113,25 @@ void TCPSocket::Bind(unsigned short serverPort) {
   // create the socket
   createSocket();
 
+  sockaddr_in *bindAddr = (sockaddr_in *) &serverAddr;
   // make sure it's zero to start
   memset(&serverAddr, 0, sizeof(serverAddr));
   // designate it as part of the Internet address family
-  serverAddr.sin_family = AF_INET;
+  bindAddr->sin_family = AF_INET;
   // specify the port, host to network short
-  serverAddr.sin_port = htons(serverPort);
+  bindAddr->sin_port = htons(serverPort);
   // specify the server IP address in network byte order
-  serverAddr.sin_addr.s_addr = INADDR_ANY;
+  bindAddr->sin_addr.s_addr = INADDR_ANY;
 
-  if (bind(sock, (sockaddr *) &serverAddr, sizeof(serverAddr)) < 0) {
+  options.applyReuseAddress(sock);
+  if (bind(sock, (sockaddr *) bindAddr, sizeof(sockaddr_in)) < 0) {
     throw std::string("TCPSocket Exception: could not bind to interface");
   }
 }
 
-void TCPSocket::Listen() {
+void TCPSocket::Listen(int backlog) {
   // listen on socket sock, report error when fail
-  if (listen(sock, 1) < 0) {
+  if (listen(sock, backlog) < 0) {
      throw std::string("TCPSocket Exception: listen call failed");
   }
 
@@ -94,7 +145,7 @@ bool TCPSocket::Accept(TCPSocket& dataSock) {
   int newSock;
   socklen_t sinSize;
 
-  sinSize = sizeof(struct sockaddr_in);
+  sinSize = sizeof(dataSock.serverAddr);
   // waiting for new incoming connection
   if ((newSock = accept(sock, (struct sockaddr *) &(dataSock.serverAddr),
       &sinSize)) < 0) {
@@ -102,7 +153,12 @@ bool TCPSocket::Accept(TCPSocket& dataSock) {
     return false;
   }
 
+  dataSock.Close();
   dataSock.sock = newSock;
+  // The kernel copies the listening socket's options to the new one.
+  dataSock.options = options;
+  dataSock.nonBlocking = false;
+  dataSock.attachRing();
   return true;
 }
 
@@ -115,19 +171,108 @@ TCPSocket *TCPSocket::Accept() {
 
 int TCPSocket::Close() {
   if (sock != -1) {  // If this socket is in use
+    // Queued writes were reported as sent, so try to deliver them.
+    try {
+      flushSend();
+    } catch (std::string msg) {
+      sendPending = 0;
+    }
     if (close(sock) < 0) {
       return -1;
     }
   }
   sock = -1;
+  resetBuffer();
   return 0;
 }
 
 int TCPSocket::writeString(const std::string& data) {
-  int bytesSent = 0;
+  struct iovec buffer;
+  buffer.iov_base = (void *)data.data();
+  buffer.iov_len = data.size();
+
+  return writeBuffers(&buffer, 1);
+}
+
+unsigned TCPSocket::writeBuffers(struct iovec* buffers, int count) {
+  unsigned bytesSent = 0;
 
-  if ((bytesSent = send(sock, (void *)data.data(), data.size(), 0)) < 0) {
-    throw std::string("TCPSocket Exception: error sending data");
+  if ((ring != NULL) && !nonBlocking) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+      total += buffers[i].iov_len;
+    }
+
+    // Small enough to wait for the next read: queue it, so the request
+    // and the read of its reply are submitted together.
+    if (total <= BUFFER_SIZE - sendPending) {
+      for (int i = 0; i < count; i++) {
+        memcpy(sendBuffer + sendPending, buffers[i].iov_base,
+               buffers[i].iov_len);
+        sendPending += buffers[i].iov_len;
+        buffers[i].iov_base = static_cast<char*>(buffers[i].iov_base) +
+                              buffers[i].iov_len;
+        buffers[i].iov_len = 0;
+      }
+      return total;
+    }
+
+    // Too big; whatever is queued has to go first to keep the order.
+    flushSend();
+  }
+
+  while (count > 0) {
+    // Skip what is empty or already sent, writev would just return 0.
+    if (buffers->iov_len == 0) {
+      buffers++;
+      count--;
+      continue;
+    }
+
+    // Through the ring if the socket has one, like every other blocking
+    // operation, so a large header and body go out in one submission.
+    int batch = (count > IOV_MAX) ? IOV_MAX : count;
+    ssize_t sent;
+    if ((ring != NULL) && !nonBlocking) {
+      int result;
+      ring->prepareWritev(sock, buffers, batch, 0);
+      ring->complete(&result, 1);
+      sent = result;
+      if (result < 0) {
+        errno = -result;
+        sent = -1;
+      }
+    } else {
+      sent = writev(sock, buffers, batch);
+    }
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        // A non-blocking socket with a full send buffer: wait for room.
+        pollfd pfd;
+        pfd.fd = sock;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, -1);
+        continue;
+      }
+      throw std::string("TCPSocket Exception: error sending data");
+    }
+    bytesSent += sent;
+
+    // Advance past what went out; a short write can stop anywhere, even
+    // in the middle of a buffer.
+    size_t left = sent;
+    while ((count > 0) && (left >= buffers->iov_len)) {
+      left -= buffers->iov_len;
+      buffers++;
+      count--;
+    }
+    if (count > 0) {
+      buffers->iov_base = static_cast<char*>(buffers->iov_base) + left;
+      buffers->iov_len -= left;
+    }
   }
 
   return bytesSent;
@@ -136,7 +281,15 @@ int TCPSocket::writeString(const std::string& data) {
 int TCPSocket::readString(std::string& data) {
   int bytesReceived;
 
-  if ((bytesReceived = recv(sock, (void *)data.data(), data.size(), 0)) < 0) {
+  if (recvStart < recvEnd) {  // hand out what is already buffered first
+    bytesReceived = recvEnd - recvStart;
+    if (bytesReceived > static_cast<int>(data.size())) {
+      bytesReceived = data.size();
+    }
+    memcpy(&data[0], recvBuffer + recvStart, bytesReceived);
+    recvStart += bytesReceived;
+  } else if ((bytesReceived = receive((void *)data.data(), data.size()))
+      < 0) {
     throw std::string("TCPSocket Exception: error reading data from socket");
   }
   data = data.substr(0, bytesReceived);
@@ -145,156 +298,559 @@ int TCPSocket::readString(std::string& data) {
   return bytesReceived;
 }
 
+int TCPSocket::fillBuffer() {
+  // Nothing left unconsumed, start over at the front of the buffer.
+  if (recvStart == recvEnd) {
+    resetBuffer();
+  } else if ((recvEnd == BUFFER_SIZE) && (recvStart > 0)) {
+    // Out of room at the end, slide the unconsumed bytes to the front.
+    memmove(recvBuffer, recvBuffer + recvStart, recvEnd - recvStart);
+    recvEnd -= recvStart;
+    recvStart = 0;
+  }
+
+  if (recvEnd == BUFFER_SIZE) {  // full of unconsumed data
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  ssize_t nRead;
+  if ((ring != NULL) && !nonBlocking) {
+    // Submit any queued request together with the read of its reply. The
+    // read is linked behind the write, so it only starts once the whole
+    // request has gone out.
+    int results[2];
+    unsigned int ops = 0;
+    if (sendPending > 0) {
+      ring->prepareWriteFixed(sock, sendBuffer, sendPending, sendIndex, ops++,
+                              true);
+    }
+    ring->prepareReadFixed(sock, recvBuffer + recvEnd, BUFFER_SIZE - recvEnd,
+                           recvIndex, ops++);
+    ring->complete(results, ops);
+
+    if (ops == 2) {
+      if (results[0] < 0) {
+        errno = -results[0];
+        return -1;
+      }
+      // A short write cancels the read; send the rest, then read again.
+      sendPending -= results[0];
+      memmove(sendBuffer, sendBuffer + results[0], sendPending);
+      if (sendPending > 0) {
+        flushSend();
+        return fillBuffer();
+      }
+    }
+
+    nRead = results[ops - 1];
+    if (nRead < 0) {
+      if (nRead == -EINTR) {
+        return fillBuffer();
+      }
+      errno = -nRead;
+      nRead = -1;
+    }
+  } else {
+    do {
+      nRead = read(sock, recvBuffer + recvEnd, BUFFER_SIZE - recvEnd);
+    } while ((nRead < 0) && (errno == EINTR));
+  }
+
+  if (nRead > 0) {
+    recvEnd += nRead;
+    options.applyQuickAck(sock);
+  }
+  return nRead;
+}
+
+ssize_t TCPSocket::receive(void* buffer, size_t length) {
+  flushSend();
+
+  if ((ring == NULL) || nonBlocking) {
+    return read(sock, buffer, length);
+  }
+
+  int result;
+  ring->prepareRecv(sock, buffer, length, 0);
+  ring->complete(&result, 1);
+  if (result < 0) {
+    errno = -result;
+    return -1;
+  }
+  return result;
+}
+
+void TCPSocket::attachRing() {
+  if ((ring != NULL) || (threadRing == NULL) ||
+      (threadRing->getBufferSize() < BUFFER_SIZE)) {
+    return;
+  }
+
+  char* recvData = threadRing->acquireBuffer(recvIndex);
+  if (recvData == NULL) {
+    return;
+  }
+  sendBuffer = threadRing->acquireBuffer(sendIndex);
+  if (sendBuffer == NULL) {
+    threadRing->releaseBuffer(recvIndex);
+    return;
+  }
+
+  // Nothing can be buffered yet: the socket was just created.
+  ring = threadRing;
+  recvBuffer = recvData;
+  sendPending = 0;
+}
+
+void TCPSocket::detachRing() {
+  if (ring == NULL) {
+    return;
+  }
+
+  // Keep any unread bytes, they belong to the connection, not the ring.
+  memcpy(ownBuffer, recvBuffer, recvEnd);
+  recvBuffer = ownBuffer;
+  ring->releaseBuffer(recvIndex);
+  ring->releaseBuffer(sendIndex);
+  ring = NULL;
+  sendPending = 0;
+}
+
+void TCPSocket::flushSend() {
+  unsigned int sent = 0;
+
+  while (sent < sendPending) {
+    int result;
+    ring->prepareWriteFixed(sock, sendBuffer + sent, sendPending - sent,
+                            sendIndex, 0, false);
+    ring->complete(&result, 1);
+    if (result < 0) {
+      if (result == -EINTR) {
+        continue;
+      }
+      sendPending = 0;
+      throw std::string("TCPSocket Exception: error sending data");
+    }
+    sent += result;
+  }
+  sendPending = 0;
+}
+
+void TCPSocket::setThreadRing(IoRing* ring) {
+  threadRing = ring;
+}
+
+void TCPSocket::setOptions(const SocketOptions& options) {
+  this->options = options;
+  if (sock != -1) {
+    this->options.apply(sock);
+  }
+}
+
+unsigned int TCPSocket::getRoundTripTime() const {
+  struct tcp_info info;
+  socklen_t infoLen = sizeof(info);
+
+  memset(&info, 0, sizeof(info));
+  if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &infoLen) < 0) {
+    return 0;
+  }
+  return info.tcpi_rtt;
+}
+
+int TCPSocket::getReceiveBufferSize() const {
+  int size = 0;
+  socklen_t sizeLen = sizeof(size);
+
+  if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, &sizeLen) < 0) {
+    return 0;
+  }
+  return size;
+}
+
 int TCPSocket::readNBytes(void* vptr, unsigned int n) {
   size_t  nLeft;
-  ssize_t nRead;
+  ssize_t nRead = 0;
   char    *ptr;
 
   ptr = (char *) vptr;
   nLeft = n;
 
   while (nLeft > 0) {  // keeps reading until n is satisfied
-    if ((nRead = read(sock, ptr, nLeft)) < 0) {  // something is wrong
-      return -1;
-    } else if (nRead == 0) {  // nothing's in the socket, stop
+    if (recvStart < recvEnd) {  // drain the receive buffer first
+      size_t buffered = recvEnd - recvStart;
+      size_t take = (buffered < nLeft) ? buffered : nLeft;
+      memcpy(ptr, recvBuffer + recvStart, take);
+      recvStart += take;
+      nLeft -= take;
+      ptr += take;
+    } else if (nLeft >= BUFFER_SIZE) {
+      // Large reads go straight into the caller's memory, there is no
+      // point in staging them in the receive buffer.
+      if ((nRead = receive(ptr, nLeft)) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;  // something is wrong
+      } else if (nRead == 0) {  // nothing's in the socket, stop
+        break;
+      }
+      nLeft -= nRead;
+      ptr += nRead;
+    } else if ((nRead = fillBuffer()) <= 0) {  // closed, or something is wrong
       break;
     }
-    nLeft -= nRead;
-    ptr += nRead;
   }
 
+  // Report what got through, so a caller keeps the bytes that arrived
+  // before a failure; the next call sees the error.
+  if ((nRead < 0) && (nLeft == n)) {
+    return -1;
+  }
   return (n - nLeft);
 }
 
 int TCPSocket::readLine(void *vptr, unsigned int maxLen) {
-  int n, readCount;
-  char c, *ptr;
+  char *ptr = (char *) vptr;
+  unsigned int n = 0;
 
-  ptr = (char *) vptr;
-  for (n = 1; n < maxLen; n++) {
-    readCount = read(sock, &c, 1);  // Keeps receiving, one byte by one byte
-    if (readCount == 1) {
-      *ptr++ = c;
-      if (c == '\n') {  // check if the byte is newline
-        break;  // break and end this function is yes
-      }
-    } else if (readCount == 0) {
-      if (n == 1) {
-        return 0;
-      } else {
-        return n;
+  if (maxLen == 0) {
+    return 0;
+  }
+
+  // Copy whole runs out of the receive buffer, stopping right after the
+  // newline. Whatever follows it stays buffered for the next read.
+  while (n < maxLen - 1) {
+    if (recvStart == recvEnd) {
+      int filled = fillBuffer();
+      if (filled < 0) {
+        return -1;
+      } else if (filled == 0) {  // connection closed
+        break;
       }
-    } else {  // readCount < 0
-      return -1;
+    }
+
+    unsigned int available = recvEnd - recvStart;
+    if (available > maxLen - 1 - n) {
+      available = maxLen - 1 - n;
+    }
+    const char *start = recvBuffer + recvStart;
+    const char *newline = ByteScanner::find(start, start + available, '\n');
+    unsigned int take = newline ? (newline - start + 1) : available;
+
+    memcpy(ptr + n, start, take);
+    recvStart += take;
+    n += take;
+    if (newline) {
+      break;
     }
   }
-  *ptr = 0;
+  ptr[n] = 0;
   return n;
 }
 
-int TCPSocket::receiveHeaders(char *buffer, unsigned int bufferLen,
-    unsigned int& totalReceivedLen) {
-  static const char headerEnd[] = {'\r', '\n', '\r', '\n'};
-  static const unsigned headerEndLen = sizeof(headerEnd);
+bool TCPSocket::receiveHeader(HTTPParser& parser, bool wait) {
+  // fillBuffer may compact the buffer, but the parser works relative to
+  // recvStart so the progress it recorded stays valid.
+  while (parser.parse(recvBuffer + recvStart, recvEnd - recvStart) ==
+         HTTPParser::INCOMPLETE) {
+    int filled = fillBuffer();
+    if (!wait && (filled < 0) &&
+        ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+      return false;  // wait for the socket to become readable again
+    } else if (filled <= 0) {
+      // Connection closed, failed, or the header is larger than we
+      // can hold.
+      parser.reset();
+      throw std::string("TCPSocket Exception: Error receiving response header.");
+    }
+  }
 
-  // Piece-by-piece, buffer the server's response and look for the end
-  // of the headers. Make a note of where in the buffer the end occurs.
-  int bytesReceived = 0;
-  int headerEndPos = -1;
-  int headerEndRead = 0;
+  if (parser.getStatus() == HTTPParser::INVALID) {
+    parser.reset();
+    throw std::string("TCPSocket Exception: malformed message header");
+  }
 
-  while ((bytesReceived < bufferLen) && (headerEndPos < 0)) {
-    // Grab however many bytes are waiting for us right now.
-    int receivedPiece = read(sock, buffer + bytesReceived,
-                             bufferLen - bytesReceived);
-    if (receivedPiece == -1) {
-      // Something's wrong. If we cannot receive, reutrn -1
-      return -1;
-    }
+  // Consume the header; its bytes stay where they are until the next read.
+  recvStart += parser.getHeaderLength();
+  return true;
+}
+
+// Receive from the socket until a complete header is buffered and extract
+// it into the std::string header. Any body bytes that came in with it are
+// left in the receive buffer for readData.
+void TCPSocket::readHeader(std::string& header, std::string& /* body */) {
+  receiveHeader(headerParser, true);
+
+  // Store the received header
+  unsigned int headerLen = headerParser.getHeaderLength();
+  header.append(recvBuffer + recvStart - headerLen, headerLen);
+  headerParser.reset();
+}
+
+void TCPSocket::readHeader(HTTPParser& parser) {
+  parser.reset();
+  receiveHeader(parser, true);
+}
+
+int TCPSocket::readData(std::string& data, unsigned int bytesLeft) {
+  // Read straight into the tail of the string so the bytes are only
+  // copied once on their way out of the kernel (or out of the buffer).
+  size_t oldSize = data.size();
+  data.resize(oldSize + bytesLeft);
+
+  int bytesRead = readNBytes(&data[oldSize], bytesLeft);
+  if (bytesRead < 0) {
+    data.resize(oldSize);
+    throw std::string("TCPSocket Exception: error reading data from socket");
+  }
+
+  data.resize(oldSize + bytesRead);
+  return bytesRead;
+}
 
-    // Go over what we got in the buffer and look for the end of headers
-    int i;
-    for (i = bytesReceived;
-         i < (bytesReceived + receivedPiece) && (headerEndRead < headerEndLen);
-         i++) {
-      if (buffer[i] == headerEnd[headerEndRead]) {
-        headerEndRead++;
-      } else {
-        headerEndRead = 0;
+int TCPSocket::spliceData(int fd, unsigned int bytesLeft) {
+  unsigned int total = 0;
+  bool canSplice = true;
+
+  flushSend();  // splice reads the socket directly
+
+  while (total < bytesLeft) {
+    ssize_t moved;
+
+    if (recvStart < recvEnd) {  // buffered bytes have to be written out
+      unsigned int take = recvEnd - recvStart;
+      if (take > bytesLeft - total) {
+        take = bytesLeft - total;
+      }
+      moved = write(fd, recvBuffer + recvStart, take);
+      if (moved > 0) {
+        recvStart += moved;
+      }
+    } else if (canSplice) {
+      moved = splice(sock, NULL, fd, NULL, bytesLeft - total,
+                     SPLICE_F_MOVE | SPLICE_F_MORE);
+      if ((moved < 0) && (errno == EINVAL)) {  // fd is not a pipe
+        canSplice = false;
+        continue;
+      } else if (moved == 0) {  // connection closed
+        break;
       }
+    } else {
+      int filled = fillBuffer();
+      if (filled == 0) {  // connection closed
+        break;
+      }
+      moved = (filled < 0) ? -1 : 0;
     }
 
-    // If we found the end, mark it.  Also keep track of how much
-    // we've read total, for several reasons (not filling the
-    // buffer; knowing how much we've read past the header, etc.).
-    if (headerEndRead >= headerEndLen) {
-      headerEndPos = i;
+    if (moved < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (total > 0) {
+        break;  // report what got through; the next call sees the error
+      }
+      throw std::string("TCPSocket Exception: error splicing data from socket");
     }
-    bytesReceived += receivedPiece;
+    total += moved;
   }
-  totalReceivedLen = bytesReceived;
 
-  return headerEndPos;
-  // Note that this headerEndPos here includes \r\n\r\n
+  return total;
 }
 
-// Receive a piece of response and extract the header portion from it.
-// Stores the header in the std::string header and store the rest in the
-// std::string data.
-// One can check if the header is good by checking the length of header.
-void TCPSocket::readHeader(std::string& header, std::string& data) {
-  char buffer[BUFFER_SIZE];
-  unsigned int total = 0;
+unsigned long long TCPSocket::sendFile(int fd, off_t offset,
+                                      unsigned long long length) {
+  unsigned long long total = 0;
 
-  int headerEndPos = receiveHeaders(buffer, BUFFER_SIZE - 1, total);
+  flushSend();  // whatever was written before has to go out first
 
-  if (headerEndPos < 0) {
-    throw std::string("TCPSocket Exception: Error receiving response header.");
-  } else {
-    // Store the received header and data into
-    header.append(buffer, headerEndPos);
-    data.append(buffer + headerEndPos, total - headerEndPos);
+  while (total < length) {
+    ssize_t sent = sendfile(sock, fd, &offset, length - total);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::string("TCPSocket Exception: error sending file");
+    } else if (sent == 0) {  // the file is shorter than it was said to be
+      break;
+    }
+    total += sent;
   }
+
+  return total;
 }
 
-int TCPSocket::readData(std::string& data, unsigned int bytesLeft) {
-  int total = 0, bytesRead;
-  char buffer[BUFFER_SIZE];
+int TCPSocket::peekData(const char*& data) {
+  if (recvStart == recvEnd) {
+    int filled = fillBuffer();
+    if (filled < 0) {
+      throw std::string("TCPSocket Exception: error reading data from socket");
+    }
+  }
 
-  while (total < bytesLeft) {
-    memset(buffer, 0, sizeof(buffer));
+  data = recvBuffer + recvStart;
+  return recvEnd - recvStart;
+}
+
+int TCPSocket::readLine(std::string& data) {
+  int bytesRead = 0;
+
+  // Append directly from the receive buffer until the newline shows up.
+  while (true) {
+    if (recvStart == recvEnd) {
+      int filled = fillBuffer();
+      if (filled < 0) {
+        throw std::string("TCPSocket Exception: error reading line from socket");
+      } else if (filled == 0) {  // connection closed
+        break;
+      }
+    }
 
-    bytesRead = readNBytes(buffer, bytesLeft);
+    const char *start = recvBuffer + recvStart;
+    const char *newline = ByteScanner::find(start,
+        recvBuffer + recvEnd, '\n');
+    unsigned int take = newline ? (newline - start + 1) : recvEnd - recvStart;
 
-    if (bytesRead < 0) {
-      throw std::string("TCPSocket Exception: error reading data from socket");
-      return -1;
-    } else if (bytesRead == 0) {
+    data.append(start, take);
+    recvStart += take;
+    bytesRead += take;
+    if (newline) {
       break;
     }
+  }
 
-    data.append(buffer, bytesRead);
-    total += bytesRead;
+  return bytesRead;
+}
+
+void TCPSocket::setNonBlocking(bool nonBlocking) {
+  // Non-blocking sockets never queue writes; send what is queued now.
+  if (nonBlocking) {
+    flushSend();
   }
 
-  return total;
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0) {
+    throw std::string("TCPSocket Exception: Unable to read socket flags");
+  }
+
+  flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  if (fcntl(sock, F_SETFL, flags) < 0) {
+    throw std::string("TCPSocket Exception: Unable to set socket flags");
+  }
+  this->nonBlocking = nonBlocking;
 }
 
-int TCPSocket::readLine(std::string& data) {
-  char buffer[BUFFER_SIZE];
-  int bytesRead;
+bool TCPSocket::startConnect(const URL& url) {
+  std::vector<Resolver::Address> addresses;
+
+  // If the port is not defined, connect to 80
+  Resolver::resolve(url.getHost(), url.isPortDefined() ? url.getPort() : 80,
+                    addresses);
+  return startConnect(addresses[0]);
+}
+
+bool TCPSocket::startConnect(const Resolver::Address& address) {
+  createSocket(address.addr.ss_family);
+  setNonBlocking(true);
 
-  memset(buffer, 0, BUFFER_SIZE);
-  if ((bytesRead = readLine(buffer, BUFFER_SIZE)) < 0) {
-    throw std::string("TCPSocket Exception: error reading line from socket");
+  memcpy(&serverAddr, &address.addr, address.length);
+
+  if (connect(sock, (struct sockaddr *) &serverAddr, address.length) == 0) {
+    return true;
+  } else if (errno == EINPROGRESS) {
+    return false;
   }
+  Close();
+  throw std::string("TCPSocket Exception: connect failed");
+}
 
-  buffer[bytesRead] = 0;
-  data += buffer;
+void TCPSocket::finishConnect() {
+  int error = 0;
+  socklen_t errorLen = sizeof(error);
 
-  return bytesRead;
+  if ((getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0) ||
+      (error != 0)) {
+    throw std::string("TCPSocket Exception: connect failed");
+  }
+}
+
+void TCPSocket::Connect(const URL& url, int timeoutMs) {
+  if (!startConnect(url)) {
+    pollfd waitFor;
+    waitFor.fd = sock;
+    waitFor.events = POLLOUT;
+    waitFor.revents = 0;
+
+    int ready;
+    do {
+      ready = poll(&waitFor, 1, timeoutMs);
+    } while ((ready < 0) && (errno == EINTR));
+
+    if (ready == 0) {
+      Close();
+      throw std::string("TCPSocket Exception: connect timed out");
+    } else if (ready < 0) {
+      Close();
+      throw std::string("TCPSocket Exception: connect failed");
+    }
+    finishConnect();
+  }
+
+  setNonBlocking(false);
+}
+
+bool TCPSocket::tryReadHeader(std::string& header) {
+  if (!receiveHeader(headerParser, false)) {
+    return false;
+  }
+
+  unsigned int headerLen = headerParser.getHeaderLength();
+  header.append(recvBuffer + recvStart - headerLen, headerLen);
+  headerParser.reset();
+  return true;
+}
+
+int TCPSocket::tryReadData(std::string& data, unsigned int maxBytes) {
+  if (recvStart < recvEnd) {  // buffered bytes never show up as readable
+    unsigned int take = recvEnd - recvStart;
+    if (take > maxBytes) {
+      take = maxBytes;
+    }
+    data.append(recvBuffer + recvStart, take);
+    recvStart += take;
+    return take;
+  }
+
+  // Cap each read so growing the string stays proportional to what
+  // actually arrived.
+  if (maxBytes > BUFFER_SIZE) {
+    maxBytes = BUFFER_SIZE;
+  }
+  size_t oldSize = data.size();
+  data.resize(oldSize + maxBytes);
+
+  ssize_t nRead;
+  do {
+    nRead = read(sock, &data[oldSize], maxBytes);
+  } while ((nRead < 0) && (errno == EINTR));
+
+  if (nRead < 0) {
+    data.resize(oldSize);
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      return -1;
+    }
+    throw std::string("TCPSocket Exception: error reading data from socket");
+  }
+
+  data.resize(oldSize + nRead);
+  return nRead;
 }
 
 void TCPSocket::getPort(unsigned short& gettingPort) {
-  gettingPort = ntohs(serverAddr.sin_port);
+  if (serverAddr.ss_family == AF_INET6) {
+    gettingPort = ntohs(((sockaddr_in6 *) &serverAddr)->sin6_port);
+  } else {
+    gettingPort = ntohs(((sockaddr_in *) &serverAddr)->sin_port);
+  }
 }
@@ -7,6 +7,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -14,13 +15,110 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "HTTPParser.h"
+#include "IoRing.h"
+#include "Resolver.h"
+#include "SocketOptions.h"
 #include "URL.h"
 #include <string>
 
 class TCPSocket {
  private:
   int sock;
-  struct sockaddr_in serverAddr;
+  // Large enough for IPv4 and IPv6 addresses alike.
+  struct sockaddr_storage serverAddr;
+
+  // Receive buffer shared by every read function. Bytes in
+  // [recvStart, recvEnd) have been read from the socket but not yet handed
+  // to a caller, so a read that stops at a line or header boundary leaves
+  // the rest for the next call. recvBuffer points to ownBuffer, or to a
+  // buffer registered with the io_uring the socket uses.
+  char ownBuffer[BUFFER_SIZE];
+  char* recvBuffer;
+  unsigned int recvStart;
+  unsigned int recvEnd;
+
+  // Progress on the header being received by readHeader(std::string&) or
+  // tryReadHeader, so a non-blocking read can pick up where the previous
+  // attempt left off.
+  HTTPParser headerParser;
+
+  // The io_uring this socket's blocking I/O goes through, NULL to use
+  // plain system calls. Small writes are collected in sendBuffer and only
+  // submitted, together with the next read, once a reply is needed.
+  IoRing* ring;
+  int recvIndex;
+  char* sendBuffer;
+  int sendIndex;
+  unsigned int sendPending;
+  bool nonBlocking;
+
+  // Applied whenever the socket is (re)created, see setOptions.
+  SocketOptions options;
+
+  // Not copyable, recvBuffer may point into the object itself.
+  TCPSocket(const TCPSocket&);
+  TCPSocket& operator=(const TCPSocket&);
+
+  /*********************************
+   * Name:    fillBuffer
+   * Purpose: Issues a single read() to append whatever the socket has
+   *          ready to the receive buffer, compacting the buffer first if
+   *          the free space is at the end.
+   * Receive: None
+   * Return:  The number of bytes added, 0 on end of stream, -1 on error
+   *          or if the buffer is already full
+   *********************************/
+  int fillBuffer();
+
+  /*********************************
+   * Name:    receive
+   * Purpose: Reads whatever the socket has ready straight into the
+   *          caller's memory, bypassing the receive buffer
+   * Receive: buffer - where to put the data
+   *          length - the most bytes to read
+   * Return:  The number of bytes read, 0 on end of stream, -1 on error
+   *********************************/
+  ssize_t receive(void* buffer, size_t length);
+
+  /*********************************
+   * Name:    attachRing
+   * Purpose: Makes the socket use this thread's io_uring, if there is one
+   *          and it has two registered buffers to spare
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void attachRing();
+
+  /*********************************
+   * Name:    detachRing
+   * Purpose: Gives the registered buffers back and returns to plain
+   *          system calls
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void detachRing();
+
+  /*********************************
+   * Name:    flushSend
+   * Purpose: Writes out whatever writeBuffers left in sendBuffer
+   * Receive: None
+   * Return:  None, throws a std::string if the connection fails
+   *********************************/
+  void flushSend();
+
+  /*********************************
+   * Name:    resetBuffer
+   * Purpose: Throws away any buffered bytes, used when the socket is
+   *          (re)created or closed
+   * Receive: None
+   * Return:  None
+   *********************************/
+  void resetBuffer() {
+    recvStart = 0;
+    recvEnd = 0;
+    headerParser.reset();
+  }
 
   /*********************************
    * Name:    readNBytes
@@ -28,7 +126,9 @@ class TCPSocket {
    * Receive: vptr - the pointer to the buffer that will be used to hold the 
    *                 data
    *          n - the number of bytes to be read
-   * Return:  The number of bytes read
+   * Return:  The number of bytes read, fewer than n if the connection
+   *          closed or failed after some arrived (the next read reports
+   *          the failure); -1 if it failed before any did
    *********************************/
   int readNBytes(void* vptr, unsigned int n);
 
@@ -43,26 +143,29 @@ class TCPSocket {
   int readLine(void* vptr, unsigned int maxLen);
 
   /*********************************
-   * Name:    readHeader
-   * Purpose: Reads from a TCPSocket until \r\n\r\n is found, in order to
-   *          receive a complete HTTP message header. The received data is
-   *          then passed to be parsed by HTTPRequest or HTTPResponse
-   * Receive: buffer - buffer to hold the received data
-   *          bufferLen - the maximum length of the bufer
-   *          totalReceivedLen - the total number of bytes received.
-   * Return:  The end position of the HTTP message header
+   * Name:    receiveHeader
+   * Purpose: Fills the receive buffer and feeds it to a parser until a
+   *          complete HTTP message header has been parsed, then consumes
+   *          the header. Each pass only parses the newly received bytes.
+   *          The header's bytes stay in the buffer, where the parser's
+   *          views point, until the next read from the socket.
+   * Receive: parser - the parser, possibly holding earlier progress
+   *          wait - false to return instead of blocking when a
+   *                 non-blocking socket has no data
+   * Return:  true once the header is complete, false if it would block.
+   *          Throws a std::string if the connection fails or closes, or
+   *          the header is malformed or larger than the buffer.
    *********************************/
-  int receiveHeaders(char* buffer, unsigned int bufferLen,
-      unsigned int& totalReceivedLen);
+  bool receiveHeader(HTTPParser& parser, bool wait);
 
   /*********************************
    * Name:    createSocket
    * Purpose: Private function that handles socket creation, despite what 
    *          connect function is used.
-   * Receive: None
+   * Receive: family - the address family, AF_INET or AF_INET6
    * Return:  None
    *********************************/
-  void createSocket();
+  void createSocket(int family = AF_INET);
 
  public:
   /*********************************
@@ -73,6 +176,11 @@ class TCPSocket {
    *********************************/
   TCPSocket() {
     sock = -1;
+    recvBuffer = ownBuffer;
+    ring = NULL;
+    sendPending = 0;
+    nonBlocking = false;
+    resetBuffer();
   }
 
   /*********************************
@@ -83,13 +191,16 @@ class TCPSocket {
    *********************************/
   ~TCPSocket() {
     Close();
+    detachRing();
     sock = -1;
   }
 
   /*********************************
    * Name:    Connect, capitalized to avoid confusion with the connect in 
    *          socket.h
-   * Purpose: Initiate a connection to a server with serverName and port number
+   * Purpose: Initiate a connection to a server with serverName and port number.
+   *          The name goes through the Resolver (and its cache); each 
+   *          address it resolves to is tried in turn.
    * Receive: serverName - the hostname to connect to
    *          serverPort - the port number to connect to
    * Return:  None
@@ -114,6 +225,15 @@ class TCPSocket {
    *********************************/
   void Connect(const URL& url);
 
+  /*********************************
+   * Name:    Connect
+   * Purpose: Initiate a connection to an address found by the Resolver
+   * Receive: address - the IPv4 or IPv6 address (including port) of the 
+   *                    server
+   * Return:  None
+   *********************************/
+  void Connect(const Resolver::Address& address);
+
   /*********************************
    * Name:    Close
    * Purpose: Closes an open socket
@@ -133,10 +253,12 @@ class TCPSocket {
   /*********************************
    * Name:    Listen
    * Purpose: Start to listen to a bound socket
-   * Receive: None
+   * Receive: backlog - how many connections the kernel may queue while
+   *                    none is being accepted. A busy server wants far
+   *                    more than the default of 1.
    * Return:  None
    *********************************/
-  void Listen();
+  void Listen(int backlog = 1);
 
   /*********************************
    * Name:    Accept
@@ -159,10 +281,43 @@ class TCPSocket {
    * Name:    writeString
    * Purpose: Writes a string on this TCPSocket
    * Receive: data - the string to be written to the TCPSocket
-   * Return:  The number of bytes written, should always equal to data.size()
+   * Return:  The number of bytes written, always equal to data.size()
    *********************************/
   int writeString(const std::string& data);
 
+  /*********************************
+   * Name:    writeBuffers
+   * Purpose: Writes several buffers on this TCPSocket with writev, in
+   *          order, as if they were one. Short writes are resumed until
+   *          everything is sent, so a header and a large body can go out
+   *          without being copied into one string first. On a socket that
+   *          uses an io_uring, writes that fit in a registered buffer are
+   *          copied there and go out together with the next read; larger
+   *          ones go out with the ring's writev.
+   * Receive: buffers - the buffers to write. Their entries are advanced
+   *                    past whatever has been sent, so the array is left
+   *                    modified.
+   *          count - the number of entries in buffers
+   * Return:  The number of bytes written, the sum of all the buffer
+   *          lengths. Throws a std::string if the connection fails.
+   *********************************/
+  unsigned writeBuffers(struct iovec* buffers, int count);
+
+  /*********************************
+   * Name:    sendFile
+   * Purpose: Sends part of a file on this TCPSocket with sendfile(2), so
+   *          the kernel moves it from the page cache to the socket without
+   *          copying it through user space. Anything queued by earlier
+   *          writes goes out first.
+   * Receive: fd - the file to send from
+   *          offset - where in the file to start
+   *          length - the number of bytes to send
+   * Return:  The number of bytes sent, less than length only if the file
+   *          ended early. Throws a std::string if the connection fails.
+   *********************************/
+  unsigned long long sendFile(int fd, off_t offset,
+                              unsigned long long length);
+
   /*********************************
    * Name:    readString
    * Purpose: Reads a string from this TCPSocket
@@ -174,13 +329,28 @@ class TCPSocket {
   /*********************************
    * Name:    readHeader
    * Purpose: Reads from a TCPSocket until \r\n\r\n is found, in order to
-   *          receive a complete HTTP message header.
+   *          receive a complete HTTP message header. Any body bytes that
+   *          arrived with the header stay in the receive buffer and are
+   *          returned by the next readData call, so nothing belonging to a
+   *          following message is consumed.
    * Receive: header - the variable to hold the header
-   *          body - the variable to hold the (possibly partial) body
+   *          body - kept for compatibility; left unchanged
    * Return:  None
    *********************************/
   void readHeader(std::string& header, std::string& body);
 
+  /*********************************
+   * Name:    readHeader
+   * Purpose: Receives and parses an HTTP message header without copying
+   *          it. Any body bytes that arrived with it stay in the receive
+   *          buffer for the following reads.
+   * Receive: parser - reset, then left holding the parsed header. Its
+   *                   views point into the receive buffer and stay valid
+   *                   until the next read from this socket.
+   * Return:  None, throws a std::string if no valid header arrives
+   *********************************/
+  void readHeader(HTTPParser& parser);
+
   /*********************************
    * Name:    readData
    * Purpose: Read bytesLeft bytes from the TCPSocket
@@ -190,6 +360,43 @@ class TCPSocket {
    *********************************/
   int readData(std::string& data, unsigned int bytesLeft);
 
+  /*********************************
+   * Name:    spliceData
+   * Purpose: Moves bytesLeft bytes from the TCPSocket to a file descriptor
+   *          without copying them through user space. Anything already in
+   *          the receive buffer is written out first, then the rest is 
+   *          moved with splice(2), which requires fd to be a pipe. Other
+   *          kinds of descriptors fall back to read/write.
+   * Receive: fd - the descriptor to write to, e.g. the player's pipe
+   *          bytesLeft - the number of bytes to move
+   * Return:  the number of bytes moved, less than bytesLeft only if the
+   *          connection closed early or failed after some bytes were
+   *          moved. Throws a std::string if it fails before any.
+   *********************************/
+  int spliceData(int fd, unsigned int bytesLeft);
+
+  /*********************************
+   * Name:    peekData
+   * Purpose: Gives a view of the received bytes without copying them,
+   *          receiving more first if none are buffered. The bytes stay
+   *          buffered until consumeData says how many were used.
+   * Receive: data - set to the first buffered byte
+   * Return:  the number of bytes available, 0 if the connection closed.
+   *          Throws a std::string on a receive error.
+   *********************************/
+  int peekData(const char*& data);
+
+  /*********************************
+   * Name:    consumeData
+   * Purpose: Drops bytes seen through peekData from the receive buffer
+   * Receive: length - how many bytes were used, at most what peekData
+   *                   returned
+   * Return:  None
+   *********************************/
+  void consumeData(unsigned int length) {
+    recvStart += length;
+  }
+
   /*********************************
    * Name:    readLine
    * Purpose: Reads a line from the TCPSocket, terminated by a CRLF (\r\n)
@@ -198,6 +405,101 @@ class TCPSocket {
    *********************************/
   int readLine(std::string& data);
 
+  /*********************************
+   * Name:    getDescriptor
+   * Purpose: Looks up the underlying file descriptor, for registering the
+   *          socket with poll/epoll
+   * Receive: None
+   * Return:  The socket descriptor, -1 if the socket is not open
+   *********************************/
+  int getDescriptor() const {
+    return sock;
+  }
+
+  /*********************************
+   * Name:    hasBufferedData
+   * Purpose: Checks if bytes are waiting in the receive buffer. Such bytes
+   *          will not make the descriptor readable again, so readiness
+   *          based callers must consume them before waiting.
+   * Receive: None
+   * Return:  true if the receive buffer is not empty
+   *********************************/
+  bool hasBufferedData() const {
+    return recvStart < recvEnd;
+  }
+
+  /*********************************
+   * Name:    setNonBlocking
+   * Purpose: Switches the socket in or out of non-blocking mode
+   * Receive: nonBlocking - true to make reads/writes/connects return
+   *                        immediately instead of waiting
+   * Return:  None
+   *********************************/
+  void setNonBlocking(bool nonBlocking);
+
+  /*********************************
+   * Name:    startConnect
+   * Purpose: Begins a non-blocking connection to a URL. The socket is left
+   *          in non-blocking mode.
+   * Receive: url - the URL object holding server name and port number
+   * Return:  true if the connection completed immediately, false if it is
+   *          in progress and finishConnect must be called once the socket
+   *          becomes writable
+   *********************************/
+  bool startConnect(const URL& url);
+
+  /*********************************
+   * Name:    startConnect
+   * Purpose: Begins a non-blocking connection to an address found by the
+   *          Resolver. The socket is left in non-blocking mode.
+   * Receive: address - the IPv4 or IPv6 address (including port)
+   * Return:  true if the connection completed immediately, false if it is
+   *          in progress and finishConnect must be called once the socket
+   *          becomes writable
+   *********************************/
+  bool startConnect(const Resolver::Address& address);
+
+  /*********************************
+   * Name:    finishConnect
+   * Purpose: Completes a connection begun with startConnect, once the 
+   *          socket is reported writable
+   * Receive: None
+   * Return:  None, throws if the connection attempt failed
+   *********************************/
+  void finishConnect();
+
+  /*********************************
+   * Name:    Connect
+   * Purpose: Initiate a connection to a URL, giving up after a timeout
+   * Receive: url - the URL object holding server name and port number
+   *          timeoutMs - how long to wait for the connection, in 
+   *                      milliseconds
+   * Return:  None, throws if the connection fails or times out
+   *********************************/
+  void Connect(const URL& url, int timeoutMs);
+
+  /*********************************
+   * Name:    tryReadHeader
+   * Purpose: Non-blocking form of readHeader. Reads whatever the socket
+   *          has ready and parses it, resuming where the previous attempt
+   *          stopped.
+   * Receive: header - the variable to hold the header once it is complete
+   * Return:  true if the complete header was stored in header, false if
+   *          more data has to arrive first
+   *********************************/
+  bool tryReadHeader(std::string& header);
+
+  /*********************************
+   * Name:    tryReadData
+   * Purpose: Non-blocking form of readData. Appends whatever is buffered 
+   *          or ready on the socket, up to maxBytes.
+   * Receive: data - the string that will be used to hold the data
+   *          maxBytes - the most bytes to append
+   * Return:  the number of bytes appended, 0 if the connection was closed,
+   *          -1 if nothing is available yet
+   *********************************/
+  int tryReadData(std::string& data, unsigned int maxBytes);
+
   /*********************************
    * Name:    getPort
    * Purpose: Get the port number of the TCPSocket
@@ -205,6 +507,61 @@ class TCPSocket {
    * Return:  None
    *********************************/
   void getPort(unsigned short& gettingPort);
+
+  /*********************************
+   * Name:    setThreadRing
+   * Purpose: Makes blocking sockets created (or accepted) by the calling
+   *          thread from now on do their I/O through an io_uring: connect,
+   *          reads and small writes are submitted to the ring, and a
+   *          request is sent in the same io_uring_enter call that starts
+   *          reading its reply. Sockets that find the ring's buffers all
+   *          taken, and non-blocking sockets, keep using plain system
+   *          calls, as does every socket when no ring is set.
+   * Receive: ring - the ring, whose buffers must be at least BUFFER_SIZE
+   *                 bytes and which must outlive the sockets; NULL to go
+   *                 back to plain system calls
+   * Return:  None
+   *********************************/
+  static void setThreadRing(IoRing* ring);
+
+  /*********************************
+   * Name:    setOptions
+   * Purpose: Sets the tuning options of this socket. They are applied right
+   *          away if the socket is open, and again every time Connect or
+   *          Bind creates a new one; accepted sockets take the options of
+   *          the listening socket.
+   * Receive: options - the options
+   * Return:  None, throws a std::string if an option is refused
+   *********************************/
+  void setOptions(const SocketOptions& options);
+
+  /*********************************
+   * Name:    getOptions
+   * Purpose: Looks up the tuning options of this socket
+   * Receive: None
+   * Return:  the options
+   *********************************/
+  const SocketOptions& getOptions() const {
+    return options;
+  }
+
+  /*********************************
+   * Name:    getRoundTripTime
+   * Purpose: Asks the kernel for its smoothed round trip time estimate of
+   *          the connection (TCP_INFO)
+   * Receive: None
+   * Return:  the round trip time in microseconds, 0 if unknown
+   *********************************/
+  unsigned int getRoundTripTime() const;
+
+  /*********************************
+   * Name:    getReceiveBufferSize
+   * Purpose: Looks up the receive buffer size the kernel is using
+   *          (SO_RCVBUF), which is twice what was asked for
+   * Receive: None
+   * Return:  the size in bytes, 0 if unknown
+   *********************************/
+  int getReceiveBufferSize() const;
 };
 
 #endif  // _TCPSOCKET_H_
@@ -5,6 +5,35 @@ namespace {
   // Used to signal when the port number is not known.  There is an
   // excellent chance that this will never be a valid port for anything.
   const unsigned short UNDEFINED_PORT = 0xffff;
+
+  // Takes the "." and ".." segments out of a path, as RFC 3986 section
+  // 5.2.4 does: "/a/b/../c/./d" becomes "/a/c/d".
+  std::string removeDotSegments(const std::string& path) {
+    std::string output;
+    size_t pos = 0;
+    while (pos < path.size()) {
+      size_t end = path.find('/', pos + 1);
+      if (end == std::string::npos) {
+        end = path.size();
+      }
+      // The segment with its leading slash, e.g. "/..".
+      std::string segment = path.substr(pos, end - pos);
+      if ((segment == "/.") || (segment == "/..")) {
+        if (segment == "/..") {
+          size_t lastSlash = output.rfind('/');
+          output.erase((lastSlash == std::string::npos) ? 0 : lastSlash);
+        }
+        // The directory itself is still meant when the path ends here.
+        if (end == path.size()) {
+          output += '/';
+        }
+      } else {
+        output += segment;
+      }
+      pos = end;
+    }
+    return output;
+  }
 }
 
 // NOTE:
@@ -121,6 +150,72 @@ void URL::print(std::string& target) {
   target = targetOut.str();
 }
 
+void URL::resolve(const std::string& reference, std::string& target) const {
+  if (isAbsolute(reference)) {
+    target = reference;
+    return;
+  }
+
+  // //host/path keeps only the protocol.
+  target = protocol + ":";
+  if (reference.compare(0, 2, "//") == 0) {
+    target += reference;
+    return;
+  }
+
+  std::ostringstream authority;
+  authority << "//" << host;
+  if (isPortDefined()) {
+    authority << ":" << port;
+  }
+  target += authority.str();
+
+  if (reference.empty()) {
+    target += path;
+    if (query.length() > 0) {
+      target += "?" + query;
+    }
+  } else if (reference[0] == '/') {
+    size_t pathEnd = reference.find_first_of("?#");
+    target += removeDotSegments(reference.substr(0, pathEnd));
+    if (pathEnd != std::string::npos) {
+      target += reference.substr(pathEnd);
+    }
+  } else if ((reference[0] == '?') || (reference[0] == '#')) {
+    target += path;
+    if ((reference[0] == '#') && (query.length() > 0)) {
+      target += "?" + query;
+    }
+    target += reference;
+  } else {
+    // Relative to the directory of this URL's path.
+    size_t pathEnd = reference.find_first_of("?#");
+    std::string merged = path.substr(0, path.rfind('/') + 1) +
+                         reference.substr(0, pathEnd);
+    target += removeDotSegments(merged);
+    if (pathEnd != std::string::npos) {
+      target += reference.substr(pathEnd);
+    }
+  }
+}
+
+bool URL::isAbsolute(const std::string& reference) {
+  // A protocol is letters, digits, '+', '-' and '.', before "://".
+  size_t protocolEnd = reference.find("://");
+  if ((protocolEnd == std::string::npos) || (protocolEnd == 0)) {
+    return false;
+  }
+  for (size_t i = 0; i < protocolEnd; i++) {
+    char c = reference[i];
+    if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+          ((c >= '0') && (c <= '9')) || (c == '+') || (c == '-') ||
+          (c == '.'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
 size_t URL::readProtocol(const std::string& urlString, size_t offset) {
   size_t protocolEnd = urlString.find("://", offset);
 
@@ -128,6 +128,28 @@ class URL {
    *********************************/
   void print(std::string& target);
 
+  /*********************************
+   * Name:    resolve
+   * Purpose: Resolves a URL reference found in the document at this URL,
+   *          such as a segment URL in a playlist, the way a browser would:
+   *          "seg1.ts" and "../hi/seg1.ts" are relative to this URL's
+   *          directory, "/seg1.ts" to its host, and "//host/seg1.ts" to
+   *          its protocol. An absolute reference is returned unchanged.
+   * Receive: reference - the reference to resolve
+   *          target - Will be set to the resolved URL
+   * Return:  None
+   *********************************/
+  void resolve(const std::string& reference, std::string& target) const;
+
+  /*********************************
+   * Name:    isAbsolute
+   * Purpose: Checks whether a URL reference names its protocol, i.e.
+   *          needs no resolving
+   * Receive: reference - the reference to check
+   * Return:  true if the reference starts with "protocol://"
+   *********************************/
+  static bool isAbsolute(const std::string& reference);
+
   /*********************************
    * Name:    setProtocol
    * Purpose: Sets the URL protocol to the given string.
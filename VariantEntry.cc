@@ -0,0 +1,8 @@
+#include "VariantEntry.h"
+
+VariantEntry::VariantEntry(std::string const& url, unsigned int bandwidth,
+                           unsigned int width, unsigned int height,
+                           std::string const& codecs)
+    : url(url), bandwidth(bandwidth), width(width), height(height),
+      codecs(codecs) {
+}
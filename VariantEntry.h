@@ -0,0 +1,87 @@
+/*********************************
+ * VariantEntry - Class representing one variant stream of a master
+ * playlist: the URL of the media playlist for one rendition, and the
+ * attributes of its #EXT-X-STREAM-INF tag. It should be considered internal
+ * to the MasterPlaylist class's implementation.
+ *********************************/
+
+#ifndef _VARIANT_ENTRY_H_
+#define _VARIANT_ENTRY_H_
+
+#include <string>
+
+class VariantEntry {
+ public:
+  /*********************************
+   * Name:    VariantEntry, a master playlist entry for one variant stream
+   * Purpose: Constructor, constructs a new VariantEntry
+   * Receive: url - the URL to the variant's media playlist
+   *          bandwidth - the peak bits per second of the variant
+   *          width - the width of the video in pixels, 0 if not given
+   *          height - the height of the video in pixels, 0 if not given
+   *          codecs - the CODECS attribute, empty if not given
+   * Return:  None
+   *********************************/
+  VariantEntry(std::string const& url = "", unsigned int bandwidth = 0,
+               unsigned int width = 0, unsigned int height = 0,
+               std::string const& codecs = "");
+
+  /*********************************
+   * Name:    getUrl
+   * Purpose: Looks up the URL of the variant's media playlist
+   * Receive: None
+   * Return:  The URL of the media playlist
+   *********************************/
+  std::string const& getUrl() const {
+    return url;
+  }
+
+  /*********************************
+   * Name:    getBandwidth
+   * Purpose: Looks up the BANDWIDTH attribute of the variant
+   * Receive: None
+   * Return:  The peak bits per second of the variant
+   *********************************/
+  unsigned int getBandwidth() const {
+    return bandwidth;
+  }
+
+  /*********************************
+   * Name:    getWidth
+   * Purpose: Looks up the width from the RESOLUTION attribute
+   * Receive: None
+   * Return:  The width in pixels, 0 if the variant does not say
+   *********************************/
+  unsigned int getWidth() const {
+    return width;
+  }
+
+  /*********************************
+   * Name:    getHeight
+   * Purpose: Looks up the height from the RESOLUTION attribute
+   * Receive: None
+   * Return:  The height in pixels, 0 if the variant does not say
+   *********************************/
+  unsigned int getHeight() const {
+    return height;
+  }
+
+  /*********************************
+   * Name:    getCodecs
+   * Purpose: Looks up the CODECS attribute of the variant
+   * Receive: None
+   * Return:  The comma-separated list of codecs, empty if not given
+   *********************************/
+  std::string const& getCodecs() const {
+    return codecs;
+  }
+
+private:
+  std::string url;
+  unsigned int bandwidth;
+  unsigned int width;
+  unsigned int height;
+  std::string codecs;
+};
+
+#endif // _VARIANT_ENTRY_H_
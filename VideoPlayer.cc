@@ -2,6 +2,7 @@
 #include <cstring>
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 bool VideoPlayer::initialized = false;
@@ -10,6 +11,9 @@ namespace {
 
 enum PIPE_HALF {PIPE_OUT = 0, PIPE_IN = 1};
 
+// Requested size of the pipe feeding the player, in bytes.
+const int PIPE_CAPACITY = 1024 * 1024;
+
 void handleNewDecoderPad(GstElement* decoder, GstPad* new_pad,
     gboolean ignored, gpointer videoHookPtr) {
   GstElement* videoHook = (GstElement*)videoHookPtr;
@@ -137,6 +141,13 @@ bool VideoPlayer::stream(const char* data, size_t length) {
   return false;
 }
 
+int VideoPlayer::getInputDescriptor() {
+  if (checkStatus()) {
+    return pipeHalves[PIPE_IN];
+  }
+  return -1;
+}
+
 bool VideoPlayer::checkStatus() {
   bool stillLooking = true;
   bool okay = true;
@@ -265,5 +276,12 @@ bool VideoPlayer::createPipeline() {
 }
 
 bool VideoPlayer::createPipe() {
-  return (pipe(pipeHalves) == 0);
+  if (pipe(pipeHalves) != 0) {
+    return false;
+  }
+
+  // Segments get spliced into the pipe, so a bigger pipe means fewer
+  // wakeups per segment. Not fatal if the system says no.
+  fcntl(pipeHalves[PIPE_IN], F_SETPIPE_SZ, PIPE_CAPACITY);
+  return true;
 }
@@ -43,6 +43,14 @@ class VideoPlayer {
     return stream(data.c_str(), data.size());
   }
 
+  // Looks up the write end of the pipe the player reads its stream from.
+  // Data written (or spliced) into this descriptor is played just like
+  // data passed to stream(), without going through a user-space buffer.
+  //
+  // Returns - The descriptor to feed, or -1 if a playback error has
+  //   occurred.
+  int getInputDescriptor();
+
   // Waits until the user has closed the video window, or a playback
   // error occurs.  Call this if you don't have any more data to stream,
   // and you want to let the user watch whatever video is still playing.
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+/*********************************
+ * Name:    helpMessage
+ * Purpose: prints a brief usage string describing how to use the application,
+ *          in case the user passes in something that just doesn't work.
+ * Receive: exeName - the name of the executable
+ *          out - the ostream
+ * Return:  None
+ *********************************/
+void helpMessage(const char* exeName, std::ostream& out) {
+  out << "Usage: " << exeName << " [-r directory] [-p port]" << std::endl;
+  out << "Serves the playlists (.m3u8) and segments (.ts) in a directory."
+      << std::endl;
+  out << "The following options are optional:" << std::endl;
+  out << "    -r the directory to serve, default the current one"
+      << std::endl;
+  out << "    -p the port to listen on, default 8080" << std::endl;
+  out << "    -t the number of worker threads, default 4" << std::endl;
+  out << "    -b the listen backlog, default 128" << std::endl;
+  out << "    -k seconds an idle keep-alive connection is kept, default 5; "
+      << "0 keeps it forever" << std::endl;
+  out << std::endl;
+  out << "Example: " << exeName << " -r /var/www/hls -p 8080 -t 8"
+      << std::endl;
+}
+
+/*********************************
+ * Name:    parseArgs
+ * Purpose: parse the parameters
+ * Receive: argv and argc
+ *          rootDir - set to the -r argument, if given
+ *          port - set to the -p argument, if given
+ *          numThreads - set to the -t argument, if given
+ *          backlog - set to the -b argument, if given
+ *          idleTimeout - set to the -k argument, if given
+ * Return:  True if the arguments are good, false otherwise
+ *********************************/
+bool parseArgs(int argc, char *argv[], char **rootDir, unsigned short* port,
+               unsigned int* numThreads, int* backlog,
+               unsigned int* idleTimeout) {
+  for (int i = 1; i < argc; i++) {
+    if (((!strncmp(argv[i], "-r", 2)) ||
+        (!strncmp(argv[i], "-R", 2))) && (i + 1 < argc)) {
+      *rootDir = argv[++i];
+    } else if (((!strncmp(argv[i], "-p", 2)) ||
+               (!strncmp(argv[i], "-P", 2))) && (i + 1 < argc)) {
+      int value = atoi(argv[++i]);
+      if ((value < 1) || (value > 65535)) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *port = value;
+    } else if (((!strncmp(argv[i], "-t", 2)) ||
+               (!strncmp(argv[i], "-T", 2))) && (i + 1 < argc)) {
+      int value = atoi(argv[++i]);
+      if (value < 1) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *numThreads = value;
+    } else if (((!strncmp(argv[i], "-b", 2)) ||
+               (!strncmp(argv[i], "-B", 2))) && (i + 1 < argc)) {
+      int value = atoi(argv[++i]);
+      if (value < 1) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *backlog = value;
+    } else if (((!strncmp(argv[i], "-k", 2)) ||
+               (!strncmp(argv[i], "-K", 2))) && (i + 1 < argc)) {
+      int value = atoi(argv[++i]);
+      if (value < 0) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *idleTimeout = value;
+    } else {
+      helpMessage(argv[0], std::cout);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -1,9 +1,10 @@
 // Simple video player client for CSE422 SS17 lab 3
 #include "simpleClient.h"
+#include "MappedFile.h"
 #include "VideoPlayer.h"
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
+#include <string>
 #include <unistd.h>
 
 int main(int argc, char* argv[]) {
@@ -13,9 +14,10 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  // Open the video file for playback
-  std::ifstream videoIn(filename);
-  if (!videoIn.good()) {  // make sure the opening is successful
+  // Map the video file for playback, so it is read straight from the
+  // page cache
+  MappedFile* video = MappedFile::open(filename);
+  if (video == NULL) {  // make sure the opening is successful
     std::cout << "Unable to open file " << filename << " for playback."
               << std::endl;
     return 2;
@@ -25,25 +27,24 @@ int main(int argc, char* argv[]) {
   VideoPlayer* player = VideoPlayer::create();
   if (!player) {
     std::cout << "Unable to create video player." << std::endl;
+    delete video;
     return 3;
   }
 
   // Ask the player to get ready for play back
   player->start();
 
-  // the program reads the files piece by piece and feeds the 
-  // pieces to the player
-  char dataBuffer[BUFFER_SIZE];
-  while (videoIn.good()) {
-    // read a piece of the file and store the piece in dataBuffer
-    size_t bytesRead = videoIn.readsome(dataBuffer, sizeof(dataBuffer));
-    if (bytesRead == 0) {  // reads no more from the file
-      break;
+  // Hand the whole file to the player's pipe in one go; the mapped pages
+  // go in as they are, without being copied through a buffer
+  int playerFd = player->getInputDescriptor();
+  if (playerFd >= 0) {
+    try {
+      video->writeTo(playerFd);
+    } catch (std::string msg) {
+      std::cout << msg << std::endl;  // the user closed the player early
     }
-
-    // feeds the piece to the player
-    player->stream(dataBuffer, bytesRead);
   }
+  delete video;
 
   // The player is playing the video in another thread. The main thread
   // has to wait until it ends or until the user closes the playback window.
@@ -1,23 +1,481 @@
 // Example driver/solution for Lab 4.
 
+#include "BitrateController.h"
+#include "BodySink.h"
 #include "HTTPRequest.h"
 #include "HTTPResponse.h"
+#include "MappedFile.h"
+#include "MasterPlaylist.h"
 #include "Playlist.h"
+#include "SegmentCache.h"
+#include "SegmentFetcher.h"
 #include "URL.h"
-//#include "VideoPlayer.h"
+#ifndef NO_VIDEO_PLAYER
+#include "VideoPlayer.h"
+#endif
 #include "streamClient.h"
 #include <climits>
+#include <csignal>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <netdb.h>
 #include <string>
+#include <time.h>
 #include <unistd.h>
+#include <vector>
+
+// A live playlist is joined this many segments from its end, as the HLS
+// spec asks (no closer than three target durations).
+const unsigned int LIVE_START_SEGMENTS = 3;
+
+// A live playlist that gains nothing for this many target durations is
+// taken to be dead.
+const unsigned int LIVE_STALL_DURATIONS = 6;
+
+// How long the variant playlists of a master playlist may take to download
+// together, in ms.
+const int VARIANT_PREFETCH_TIMEOUT = 5000;
+
+// Byte-range segments that follow each other in one file are fetched with
+// a single request, up to this many bytes.
+const unsigned int MAX_COALESCED_BYTES = 8 * 1024 * 1024;
+
+// Downloads every segment of the playlist into sinkFd with pipelined
+// requests. Returns the exit status.
+int streamPipelined(const Playlist& playlist, SegmentFetcher& fetcher,
+                    int sinkFd, unsigned int depth) {
+  std::vector<URL*> segmentUrls;
+  int status = 0;
+
+  for (unsigned int i = 0; i < playlist.getNumSegments(); i++) {
+    std::string segmentUrlStr = playlist.getSegmentUrl(i);
+    URL* segmentUrl = URL::parse(segmentUrlStr);
+    if (segmentUrl == NULL) {
+      std::cerr << "Unable to parse segment URL " << segmentUrlStr
+                << std::endl;
+      status = 6;
+      break;
+    }
+    segmentUrls.push_back(segmentUrl);
+  }
+
+  if (status == 0) {
+    try {
+      fetcher.fetchPipelined(segmentUrls, sinkFd, depth);
+    } catch (std::string msg) {
+      std::cerr << "Unable to download segments: " << msg << std::endl;
+      status = 7;
+    }
+  }
+
+  for (unsigned int i = 0; i < segmentUrls.size(); i++) {
+    delete segmentUrls[i];
+  }
+  return status;
+}
+
+// The text of a playlist: mapped from a local file, or downloaded.
+struct PlaylistText {
+  MappedFile* file;
+  std::string body;
+
+  PlaylistText() : file(NULL) {
+  }
+
+  ~PlaylistText() {
+    delete file;
+  }
+
+  const char* getData() const {
+    return (file != NULL) ? file->getData() : body.data();
+  }
+
+  unsigned int getLength() const {
+    return (file != NULL) ? file->getLength() : body.size();
+  }
+};
+
+// Whether a URL names a local file (file://), read straight from disk.
+bool isLocal(const URL& url) {
+  return url.getProtocol() == "file";
+}
+
+// Reads the playlist at url. A local one is mapped, to be parsed where it
+// lies; any other is downloaded, unless it has not changed since the copy
+// the validators came from. Returns false if it has not changed. Throws a
+// std::string if it cannot be read.
+bool readPlaylist(const URL& url, SegmentFetcher& fetcher,
+                  SegmentFetcher::Validators& validators, PlaylistText& text) {
+  if (!isLocal(url)) {
+    return fetcher.fetchIfChanged(url, text.body, validators);
+  }
+
+  text.file = MappedFile::open(url.getPath());
+  if (text.file == NULL) {
+    throw std::string("Unable to open ") + url.getPath();
+  }
+  return true;
+}
+
+// Plays a local segment into sinkFd, handing its mapped pages to the pipe
+// without copying them. Returns the exit status.
+int streamLocalSegment(const URL& segmentUrl, unsigned int i, int sinkFd) {
+  MappedFile* file = MappedFile::open(segmentUrl.getPath());
+  if (file == NULL) {
+    std::cerr << "Unable to open segment " << i << ": "
+              << segmentUrl.getPath() << std::endl;
+    return 7;
+  }
+
+  int status = 0;
+  try {
+    file->writeTo(sinkFd);
+  } catch (std::string msg) {
+    std::cerr << "Unable to play segment " << i << ": " << msg
+              << std::endl;
+    status = 7;
+  }
+  delete file;
+  return status;
+}
+
+// Reads the monotonic clock, in milliseconds.
+long long monotonicMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<long long>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+// Plays segment i of the playlist, a byte range of its file, into sinkFd,
+// along with the byte-range segments after it that carry on where it stops
+// in the same file, up to MAX_COALESCED_BYTES: one Range request (or one
+// write from a local file) covers them all. Sets played to the number of
+// segments played. Returns the exit status.
+int streamRangedSegments(const Playlist& playlist, unsigned int i,
+                         SegmentFetcher& fetcher, BitrateController* abr,
+                         int sinkFd, unsigned int& played) {
+  std::string segmentUrlStr = playlist.getSegmentUrl(i);
+  unsigned int offset = 0;
+  unsigned int length = 0;
+  playlist.getSegmentRange(i, offset, length);
+  unsigned int durationMs = playlist.getSegmentDurationMs(i);
+
+  played = 1;
+  unsigned int nextOffset, nextLength;
+  while ((i + played < playlist.getNumSegments()) &&
+         playlist.getSegmentRange(i + played, nextOffset, nextLength) &&
+         (nextOffset == offset + length) &&
+         (length + nextLength <= MAX_COALESCED_BYTES) &&
+         (playlist.getSegmentUrl(i + played) == segmentUrlStr)) {
+    length += nextLength;
+    durationMs += playlist.getSegmentDurationMs(i + played);
+    played++;
+  }
+
+  URL* segmentUrl = URL::parse(segmentUrlStr);
+  if (segmentUrl == NULL) {
+    std::cerr << "Unable to parse segment URL " << segmentUrlStr
+              << std::endl;
+    return 6;
+  }
+
+  int status = 0;
+  long long start = monotonicMs();
+  unsigned int bytes = 0;
+  if (isLocal(*segmentUrl)) {
+    MappedFile* file = MappedFile::open(segmentUrl->getPath());
+    if (file == NULL) {
+      std::cerr << "Unable to open segment " << i << ": "
+                << segmentUrl->getPath() << std::endl;
+      status = 7;
+    } else {
+      try {
+        file->writeTo(sinkFd, offset, length);
+      } catch (std::string msg) {
+        std::cerr << "Unable to play segment " << i << ": " << msg
+                  << std::endl;
+        status = 7;
+      }
+      delete file;
+    }
+  } else {
+    try {
+      bytes = fetcher.fetchRangeToDescriptor(*segmentUrl, offset, length,
+                                             sinkFd);
+    } catch (std::string msg) {
+      std::cerr << "Unable to download segment " << i << ": " << msg
+                << std::endl;
+      status = 7;
+    }
+  }
+  delete segmentUrl;
+
+  // Local reads say nothing about the network; like cache hits, they
+  // only fill the buffer.
+  if ((status == 0) && (abr != NULL)) {
+    abr->addSegment(durationMs, bytes,
+                    (bytes > 0) ? monotonicMs() - start : 0);
+  }
+  return status;
+}
+
+// Plays segment i of the playlist into sinkFd: straight from disk if it is
+// local, from the cache if it is there, otherwise downloaded, and then kept
+// in the cache if there is one. A byte-range segment is played with those
+// following it, see streamRangedSegments; ranges are not cached. The
+// bitrate controller, if any, is told how the download went. Sets played
+// to the number of segments played. Returns the exit status.
+int streamSegment(const Playlist& playlist, unsigned int i,
+                  SegmentFetcher& fetcher, SegmentCache* cache,
+                  BitrateController* abr, int sinkFd, unsigned int& played) {
+  unsigned int offset, length;
+  if (playlist.getSegmentRange(i, offset, length)) {
+    return streamRangedSegments(playlist, i, fetcher, abr, sinkFd, played);
+  }
+  played = 1;
+
+  std::string segmentUrlStr = playlist.getSegmentUrl(i);
+  unsigned int durationMs = playlist.getSegmentDurationMs(i);
+  FdSink sink(sinkFd);
+
+  URL* segmentUrl = URL::parse(segmentUrlStr);
+  if (segmentUrl == NULL) {
+    std::cerr << "Unable to parse segment URL " << segmentUrlStr
+              << std::endl;
+    return 6;
+  }
+
+  int status = 0;
+  const std::string* cached = NULL;
+  if (isLocal(*segmentUrl)) {
+    // Local segments are already in memory, or nearly: no need to cache
+    // them.
+    status = streamLocalSegment(*segmentUrl, i, sinkFd);
+    if ((status == 0) && (abr != NULL)) {
+      abr->addSegment(durationMs, 0, 0);
+    }
+  } else if ((cache != NULL) &&
+             ((cached = cache->find(segmentUrlStr)) != NULL)) {
+    try {
+      sink.write(cached->data(), cached->size());
+      if (abr != NULL) {
+        abr->addSegment(durationMs, 0, 0);
+      }
+    } catch (std::string msg) {
+      std::cerr << "Unable to play segment " << i << ": " << msg
+                << std::endl;
+      status = 7;
+    }
+  } else {
+    long long start = monotonicMs();
+    try {
+      unsigned int bytes;
+      if (cache == NULL) {
+        bytes = fetcher.fetchToDescriptor(*segmentUrl, sinkFd);
+      } else {
+        // The body has to be kept anyway, so it is downloaded into the
+        // string that the cache will take over.
+        std::string body;
+        fetcher.fetch(*segmentUrl, body);
+        bytes = body.size();
+        sink.write(body.data(), body.size());
+        cache->insert(segmentUrlStr, body);
+      }
+      if (abr != NULL) {
+        abr->addSegment(durationMs, bytes, monotonicMs() - start);
+      }
+    } catch (std::string msg) {
+      std::cerr << "Unable to download segment " << i << ": " << msg
+                << std::endl;
+      status = 7;
+    }
+  }
+  delete segmentUrl;
+  return status;
+}
+
+// Reads the playlist again if it has changed since the copy the
+// validators came from, and replaces playlist with the new copy. An
+// unchanged playlist (304 Not Modified) is neither sent nor parsed again.
+// If the refresh fails, the old playlist keeps playing.
+void refreshPlaylist(const URL& playlistUrl, SegmentFetcher& fetcher,
+                     SegmentFetcher::Validators& validators,
+                     Playlist*& playlist) {
+  PlaylistText playlistText;
+  try {
+    if (!readPlaylist(playlistUrl, fetcher, validators, playlistText)) {
+      return;
+    }
+  } catch (std::string msg) {
+    std::cerr << "Unable to refresh playlist: " << msg << std::endl;
+    return;
+  }
+
+  Playlist* newPlaylist = Playlist::parse(playlistText.getData(),
+                                          playlistText.getLength());
+  if (newPlaylist == NULL) {
+    std::cerr << "Unable to parse the refreshed playlist." << std::endl;
+    // Make the next refresh download it again instead of being told that
+    // the unusable copy has not changed.
+    validators = SegmentFetcher::Validators();
+    return;
+  }
+  newPlaylist->setBaseUrl(playlistUrl);
+  delete playlist;
+  playlist = newPlaylist;
+}
+
+// Reloads a live playlist if it has changed, and merges the segments added
+// since the last load into it. Returns how many were added; a failed
+// reload adds none, and the next one tries again.
+int reloadLivePlaylist(const URL& playlistUrl, SegmentFetcher& fetcher,
+                       SegmentFetcher::Validators& validators,
+                       Playlist& playlist) {
+  PlaylistText playlistText;
+  try {
+    if (!readPlaylist(playlistUrl, fetcher, validators, playlistText)) {
+      return 0;
+    }
+  } catch (std::string msg) {
+    std::cerr << "Unable to reload playlist: " << msg << std::endl;
+    return 0;
+  }
+
+  int added = playlist.update(playlistText.getData(),
+                              playlistText.getLength());
+  if (added < 0) {
+    std::cerr << "Unable to parse the reloaded playlist." << std::endl;
+    validators = SegmentFetcher::Validators();
+    return 0;
+  }
+  return added;
+}
+
+// Downloads the media playlists of every variant of the master playlist
+// at once, so that starting on one and switching to another later do not
+// each wait for a download. Variants that cannot be fetched this way are
+// left empty in texts, and downloaded when they are needed.
+void prefetchVariants(const MasterPlaylist& master, const URL& masterUrl,
+                      SegmentFetcher& fetcher,
+                      std::vector<std::string>& texts) {
+  std::vector<URL*> variantUrls;
+  for (unsigned int i = 0; i < master.getNumVariants(); i++) {
+    std::string variantUrlStr;
+    masterUrl.resolve(master.getVariant(i).getUrl(), variantUrlStr);
+    URL* variantUrl = URL::parse(variantUrlStr);
+    if ((variantUrl != NULL) && isLocal(*variantUrl)) {
+      delete variantUrl;  // read from disk when needed
+      variantUrl = NULL;
+    }
+    if (variantUrl == NULL) {
+      break;
+    }
+    variantUrls.push_back(variantUrl);
+  }
+
+  if (variantUrls.size() == master.getNumVariants()) {
+    try {
+      fetcher.fetchAll(variantUrls, texts, VARIANT_PREFETCH_TIMEOUT);
+    } catch (std::string msg) {
+      texts.clear();  // each is downloaded on its own instead
+    }
+  }
+
+  for (unsigned int i = 0; i < variantUrls.size(); i++) {
+    delete variantUrls[i];
+  }
+}
+
+// Reads the media playlist of a variant of the master playlist, whose
+// URL is relative to masterUrl, or takes it from the texts prefetched,
+// once. On success it replaces playlist, and playlistUrl and validators
+// with the variant's, so refreshes and reloads go to it; on failure all
+// three are left alone.
+bool loadVariant(const MasterPlaylist& master, const URL& masterUrl,
+                 unsigned int variant, std::vector<std::string>& prefetched,
+                 SegmentFetcher& fetcher, URL*& playlistUrl,
+                 SegmentFetcher::Validators& validators,
+                 Playlist*& playlist) {
+  std::string variantUrlStr;
+  masterUrl.resolve(master.getVariant(variant).getUrl(), variantUrlStr);
+  URL* variantUrl = URL::parse(variantUrlStr);
+  if (variantUrl == NULL) {
+    std::cerr << "Unable to parse variant URL " << variantUrlStr
+              << std::endl;
+    return false;
+  }
+
+  // A prefetched copy is only fresh once; a live playlist moves on.
+  PlaylistText playlistText;
+  SegmentFetcher::Validators variantValidators;
+  if ((variant < prefetched.size()) && !prefetched[variant].empty()) {
+    playlistText.body.swap(prefetched[variant]);
+  } else {
+    try {
+      readPlaylist(*variantUrl, fetcher, variantValidators, playlistText);
+    } catch (std::string msg) {
+      std::cerr << "Unable to download variant playlist: " << msg
+                << std::endl;
+      delete variantUrl;
+      return false;
+    }
+  }
+
+  Playlist* variantPlaylist = Playlist::parse(playlistText.getData(),
+                                              playlistText.getLength());
+  if (variantPlaylist == NULL) {
+    std::cerr << "Unable to parse the variant playlist." << std::endl;
+    delete variantUrl;
+    return false;
+  }
+  variantPlaylist->setBaseUrl(*variantUrl);
+
+  delete playlistUrl;
+  playlistUrl = variantUrl;
+  validators = variantValidators;
+  delete playlist;
+  playlist = variantPlaylist;
+  return true;
+}
+
+// Asks the bitrate controller which variant the next segment should come
+// from, and switches to it if it is not the one playing. Variants are
+// expected to number their segments alike, so the next segment keeps its
+// index (or sequence number) across the switch. If the switch fails, the
+// current variant keeps playing.
+void adaptVariant(BitrateController& abr, const MasterPlaylist& master,
+                  const URL& masterUrl, unsigned int& variant,
+                  std::vector<std::string>& prefetched,
+                  SegmentFetcher& fetcher, URL*& playlistUrl,
+                  SegmentFetcher::Validators& validators,
+                  Playlist*& playlist) {
+  unsigned int chosen = abr.chooseVariant();
+  if (chosen == variant) {
+    return;
+  }
+
+  std::cerr << "Switching to variant " << chosen << " ("
+            << master.getVariant(chosen).getBandwidth() << " bps) at "
+            << static_cast<unsigned long>(abr.getThroughput())
+            << " bps measured, " << abr.getBufferLevel()
+            << " ms buffered" << std::endl;
+  if (loadVariant(master, masterUrl, chosen, prefetched, fetcher,
+                  playlistUrl, validators, playlist)) {
+    variant = chosen;
+  }
+}
 
 int main(int argc, char* argv[]) {
   char* playlistUrlStr = NULL;
+  bool autoTune = false;
+  char* congestion = NULL;
+  unsigned int pipelineDepth = 1;
+  unsigned int loops = 1;
+  unsigned int cacheMegabytes = 0;
 
-  if (!parseArgs(argc, argv, &playlistUrlStr)) {
+  if (!parseArgs(argc, argv, &playlistUrlStr, &autoTune, &congestion,
+                 &pipelineDepth, &loops, &cacheMegabytes)) {
     return 1;
   }
 
@@ -27,52 +485,265 @@ int main(int argc, char* argv[]) {
   // video segments. The playlist and the video segments are obtained over
   // HTTP.
 
-  // Both playlist and video segments are sent using default transfer
-  // encoding, which means they can share some code.
+  // Status messages go to std::cerr: without a video player (built with
+  // NO_VIDEO_PLAYER) the video itself is written to standard output.
+  std::cerr << "Attempting to stream video from: " << playlistUrlStr
+            << std::endl;
 
-  // Basically, this is combining the client program in lab 2 and the
-  // simpleClient in this skeleton code. For more information, please refer
-  // to the handout.
+  // A player or server going away should show up as a failed write, not
+  // kill the client.
+  signal(SIGPIPE, SIG_IGN);
 
-  std::cout << "Attempting to stream video from: " << playlistUrlStr
-            << std::endl;
+  // Parse the playlistUrlStr as a URL object. A path to a playlist on disk
+  // is played from there, as a file:// URL.
+  std::string urlStr = playlistUrlStr;
+  char localPath[PATH_MAX];
+  if (!URL::isAbsolute(urlStr) &&
+      (realpath(playlistUrlStr, localPath) != NULL)) {
+    urlStr = std::string("file://") + localPath;
+  }
+  URL* playlistUrl = URL::parse(urlStr);
+  if (playlistUrl == NULL) {
+    std::cerr << "Unable to parse playlist URL " << playlistUrlStr
+              << std::endl;
+    return 2;
+  }
+
+  // Download the playlist through HTTP; 404 Not Found, 403 Forbidden and
+  // the like come back as exceptions.
+  SegmentFetcher fetcher;
+  SocketOptions options;
+  options.noDelay = true;  // requests are small and wait for a reply
+  if (congestion != NULL) {
+    options.congestion = congestion;
+  }
+  fetcher.setSocketOptions(options);
+  fetcher.setAutoTuneBuffers(autoTune);
+
+  // The playlist's validators are kept, so that playing it again only
+  // downloads it again if it has changed.
+  PlaylistText playlistText;
+  SegmentFetcher::Validators playlistValidators;
+  try {
+    readPlaylist(*playlistUrl, fetcher, playlistValidators, playlistText);
+  } catch (std::string msg) {
+    std::cerr << "Unable to download playlist: " << msg << std::endl;
+    delete playlistUrl;
+    return 3;
+  }
 
-  // Parse the playlistUrlStr as a URL object. Just like what we did in
-  // lab 2.
+  // A master playlist lists the stream at several bitrates; the variant
+  // to play is picked again before every segment, from how fast segments
+  // download and how much video is buffered.
+  // Variant URLs are relative to the master playlist's, which is kept.
+  MasterPlaylist* master = MasterPlaylist::parse(playlistText.getData(),
+                                                 playlistText.getLength());
+  URL* masterUrl = NULL;
+  std::vector<std::string> variantTexts;
+  BitrateController* abr = NULL;
+  unsigned int variant = 0;
+  Playlist* playlist = NULL;
+  if (master != NULL) {
+    std::cerr << "Master playlist with " << master->getNumVariants()
+              << " variants" << std::endl;
+    masterUrl = new URL(*playlistUrl);
+    prefetchVariants(*master, *masterUrl, fetcher, variantTexts);
+    abr = new BitrateController(*master);
+    variant = abr->chooseVariant();
+    if (!loadVariant(*master, *masterUrl, variant, variantTexts, fetcher,
+                     playlistUrl, playlistValidators, playlist)) {
+      delete abr;
+      delete masterUrl;
+      delete master;
+      delete playlistUrl;
+      return 4;
+    }
+  } else {
+    playlist = Playlist::parse(playlistText.getData(),
+                               playlistText.getLength());
+    if (playlist != NULL) {
+      playlist->setBaseUrl(*playlistUrl);
+    }
+  }
+  if (playlist == NULL) {
+    std::cerr << "Unable to parse the playlist." << std::endl;
+    delete playlistUrl;
+    return 4;
+  }
 
-  // Attempt to download the playlist through HTTP, as if the playlist is an
-  // base HTML file
-  // Note:
-  //  - Handle 404 Not found and 403 Forbidden are required
+#ifndef NO_VIDEO_PLAYER
+  VideoPlayer* player = VideoPlayer::create();
+  if (!player) {
+    std::cerr << "Unable to create video player." << std::endl;
+    delete abr;
+    delete masterUrl;
+    delete master;
+    delete playlist;
+    delete playlistUrl;
+    return 5;
+  }
+  player->start();
+#endif
 
-  // If the download succeeded, try to parse the response body as a Playlist 
-  // object using Playlist::parse
+  // With a cache, segments that are played again come from memory. The
+  // bodies it keeps are downloaded into it first; everything else moves
+  // straight into the player's pipe, so the video data is never copied
+  // through this process.
+  SegmentCache* cache = NULL;
+  if (cacheMegabytes > 0) {
+    cache = new SegmentCache(static_cast<size_t>(cacheMegabytes) << 20);
+  }
 
-  // Note:
-  //  - remember to delete any object that is no longer needed, for example
-  //    we do not need the playlist's URL object now)
-  //  - Also, make sure any parsed object is not NULL (URL, Playlist ...)
+  int status = 0;
+  bool playerClosed = false;
 
-  // Get a video player. Refer to simpleClient.cc for more information
+  // A live playlist is played from near its end and reloaded as it grows,
+  // until the server ends it with #EXT-X-ENDLIST. Segments are tracked by
+  // sequence number, since the playlist drops them from its start.
+  bool live = !playlist->isEnded();
+  if (live) {
+    unsigned int next = playlist->getMediaSequence();
+    if (playlist->getNumSegments() > LIVE_START_SEGMENTS) {
+      next += playlist->getNumSegments() - LIVE_START_SEGMENTS;
+    }
+    long long lastReload = monotonicMs();
+    long long lastGrowth = lastReload;
+    bool grew = true;
 
-  // For each video segment in the Playlist object, download the video segment
-  // as over HTTP, as if the video segments are HTTP reference objects
-  // Note:
-  //  - Make sure each segment is downloaded successfully. If not, show some
-  //    error messages and exit the program is fine.
+    while ((status == 0) && !playerClosed) {
+      // Fell so far behind that the segments left the playlist: skip on.
+      if (next < playlist->getMediaSequence()) {
+        next = playlist->getMediaSequence();
+      }
+      while (next < playlist->getMediaSequence() +
+                    playlist->getNumSegments()) {
+#ifndef NO_VIDEO_PLAYER
+        int sinkFd = player->getInputDescriptor();
+        if (sinkFd < 0) {  // the user closed the player early
+          playerClosed = true;
+          break;
+        }
+#else
+        int sinkFd = STDOUT_FILENO;
+#endif
 
-  // Stream the video segment (in the response body) to the player using
-  // Player::stream
-  // Note:
-  //  - Make sure Player::stream returns true. (What if a user closes the
-  //    VideoPlayer early?)
+        if (abr != NULL) {
+          adaptVariant(*abr, *master, *masterUrl, variant, variantTexts,
+                       fetcher, playlistUrl, playlistValidators, playlist);
+          if (next < playlist->getMediaSequence()) {
+            next = playlist->getMediaSequence();
+          }
+          if (next >= playlist->getMediaSequence() +
+                      playlist->getNumSegments()) {
+            break;  // the new variant's playlist is behind
+          }
+        }
+        unsigned int played;
+        status = streamSegment(*playlist, next - playlist->getMediaSequence(),
+                               fetcher, cache, abr, sinkFd, played);
+        if (status != 0) {
+          break;
+        }
+        next += played;
+      }
+      playlist->discardSegments(next);
+      if ((status != 0) || playerClosed || playlist->isEnded()) {
+        break;
+      }
+
+      // Reload a target duration after the last reload, or half of one if
+      // that found nothing new.
+      long long targetMs = 1000LL *
+          ((playlist->getTargetDuration() > 0) ?
+           playlist->getTargetDuration() : 1);
+      if (monotonicMs() - lastGrowth > LIVE_STALL_DURATIONS * targetMs) {
+        std::cerr << "The live playlist stopped growing." << std::endl;
+        status = 8;
+        break;
+      }
+      long long wait = lastReload + (grew ? targetMs : targetMs / 2) -
+                       monotonicMs();
+      if (wait > 0) {
+        usleep(wait * 1000);
+      }
+
+      lastReload = monotonicMs();
+      grew = reloadLivePlaylist(*playlistUrl, fetcher, playlistValidators,
+                                *playlist) > 0;
+      if (grew) {
+        lastGrowth = lastReload;
+      }
+    }
+  }
 
+  // Play the playlist as many times as asked for, 0 meaning forever. A
+  // live stream is only played once, however it ended.
+  for (unsigned int pass = 0; !live && (status == 0) && !playerClosed &&
+       ((loops == 0) || (pass < loops)); pass++) {
+    if (pass > 0) {
+      refreshPlaylist(*playlistUrl, fetcher, playlistValidators, playlist);
+    }
+
+    if ((pipelineDepth > 1) && (cache == NULL) && (abr == NULL) &&
+        !isLocal(*playlistUrl) && !playlist->hasByteRanges()) {
+#ifndef NO_VIDEO_PLAYER
+      int sinkFd = player->getInputDescriptor();
+#else
+      int sinkFd = STDOUT_FILENO;
+#endif
+      if (sinkFd < 0) {
+        break;
+      }
+      status = streamPipelined(*playlist, fetcher, sinkFd, pipelineDepth);
+      continue;
+    }
+
+    unsigned int played = 1;
+    for (unsigned int i = 0; i < playlist->getNumSegments(); i += played) {
+#ifndef NO_VIDEO_PLAYER
+      int sinkFd = player->getInputDescriptor();
+      if (sinkFd < 0) {  // the user closed the player early
+        playerClosed = true;
+        break;
+      }
+#else
+      int sinkFd = STDOUT_FILENO;
+#endif
+
+      if (abr != NULL) {
+        adaptVariant(*abr, *master, *masterUrl, variant, variantTexts,
+                     fetcher, playlistUrl, playlistValidators, playlist);
+        if (i >= playlist->getNumSegments()) {
+          break;  // the new variant is shorter
+        }
+      }
+      status = streamSegment(*playlist, i, fetcher, cache, abr, sinkFd,
+                             played);
+      if (status != 0) {
+        break;
+      }
+    }
+  }
+
+  if (cache != NULL) {
+    std::cerr << "Segment cache: " << cache->getNumHits() << " hits, "
+              << cache->getNumMisses() << " misses" << std::endl;
+    delete cache;
+  }
 
-  // Because the main thread (this thread) is downloading the video and is very
-  // likely to end before the playback, which is handled by another thread.
-  // If we let the main thread to terminate, the child thread (VideoPlayer)
-  // also ends. Wait for the player to finish playback using
-  // VideoPlayer::waitForClose
+#ifndef NO_VIDEO_PLAYER
+  // Because the main thread (this thread) is downloading the video and is
+  // very likely to end before the playback, which is handled by another
+  // thread, wait for the player to finish playback.
+  player->waitForClose();
+  delete player;
+#endif
 
   // Clean up!
+  delete abr;
+  delete masterUrl;
+  delete master;
+  delete playlist;
+  delete playlistUrl;
+  return status;
 }
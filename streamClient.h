@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
 
 /*********************************
@@ -12,7 +13,18 @@
 void helpMessage(const char* exeName, std::ostream& out) {
   out << "Usage: " << exeName << " -p playlistUrl" << std::endl;
   out << "The following options are required:" << std::endl;
-  out << "    -p URL to a playlist" << std::endl;
+  out << "    -p URL to a playlist, or the path of one on disk; for a "
+      << "master playlist the variant is picked per segment" << std::endl;
+  out << "The following options are optional:" << std::endl;
+  out << "    -a size receive buffers from the measured bandwidth-delay "
+      << "product" << std::endl;
+  out << "    -c TCP congestion control algorithm, e.g. bbr" << std::endl;
+  out << "    -n pipeline up to n segment requests on a connection"
+      << std::endl;
+  out << "    -l play the playlist n times, 0 to loop forever; default 1. "
+      << "A live playlist is played until it ends" << std::endl;
+  out << "    -m keep up to n megabytes of segments in memory, so repeats "
+      << "are not downloaded again" << std::endl;
   out << std::endl;
   out << "Example: " << exeName
       << " -f http://someUrl/somePlaylist.m3u8" << std::endl;
@@ -22,14 +34,51 @@ void helpMessage(const char* exeName, std::ostream& out) {
  * Name:    parseArgs 
  * Purpose: parse the parameters
  * Receive: argv and argc
- *          filename - the file to be played
+ *          playlistUrlStr - the playlist to be played
+ *          autoTune - set to true if -a is given
+ *          congestion - set to the -c argument, if given
+ *          pipelineDepth - set to the -n argument, if given
+ *          loops - set to the -l argument, if given
+ *          cacheMegabytes - set to the -m argument, if given
  * Return:  True if filename is gotten, false otherwise
  *********************************/
-bool parseArgs(int argc, char *argv[], char **playlistUrlStr) {
+bool parseArgs(int argc, char *argv[], char **playlistUrlStr, bool* autoTune,
+               char **congestion, unsigned int* pipelineDepth,
+               unsigned int* loops, unsigned int* cacheMegabytes) {
   for (int i = 1; i < argc; i++) {
     if ((!strncmp(argv[i], "-p", 2)) ||
        (!strncmp(argv[i], "-P", 2))) {
       *playlistUrlStr = argv[++i];
+    } else if ((!strncmp(argv[i], "-a", 2)) ||
+              (!strncmp(argv[i], "-A", 2))) {
+      *autoTune = true;
+    } else if (((!strncmp(argv[i], "-c", 2)) ||
+               (!strncmp(argv[i], "-C", 2))) && (i + 1 < argc)) {
+      *congestion = argv[++i];
+    } else if (((!strncmp(argv[i], "-n", 2)) ||
+               (!strncmp(argv[i], "-N", 2))) && (i + 1 < argc)) {
+      int depth = atoi(argv[++i]);
+      if (depth < 1) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *pipelineDepth = depth;
+    } else if (((!strncmp(argv[i], "-l", 2)) ||
+               (!strncmp(argv[i], "-L", 2))) && (i + 1 < argc)) {
+      int count = atoi(argv[++i]);
+      if (count < 0) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *loops = count;
+    } else if (((!strncmp(argv[i], "-m", 2)) ||
+               (!strncmp(argv[i], "-M", 2))) && (i + 1 < argc)) {
+      int megabytes = atoi(argv[++i]);
+      if (megabytes < 0) {
+        helpMessage(argv[0], std::cout);
+        return false;
+      }
+      *cacheMegabytes = megabytes;
     } else if ((!strncmp(argv[i], "-h", 2)) ||
               (!strncmp(argv[i], "-H", 2))) {
       helpMessage(argv[0], std::cout);